@@ -0,0 +1,329 @@
+#include "bayer_demosaic.hpp"
+#include "bayer_demosaic_simd.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr int MAX_V8 = 8 * 1023 + 2 * 4 * 1023;  // Largest interpolated value scaled by 8
+
+// Gain, clamp and 10-to-8-bit scaling with rounding, as the original floating-point demosaic did it
+uint8_t scale_sample(double value, double gain) {
+    value *= gain;
+    if (value < 0) value = 0;
+    if (value > 1023) value = 1023;
+    return static_cast<uint8_t>((value * 255 + 511) / 1023);
+}
+
+// Multiply, add and shift that give exactly the table over its whole range,
+// within the SIMD kernels' 16-bit multiplier and 31-bit sums
+bool fit_scale(const std::vector<uint8_t>& table, double gain, DemosaicScale& scale) {
+    const int64_t limit = static_cast<int64_t>(table.size()) - 1;
+    const double slope = gain * 255 / (8 * 1023.0);
+    for (int shift = 8; shift <= 24; shift++) {
+        const int64_t ideal = static_cast<int64_t>(std::floor(std::ldexp(slope, shift)));
+        for (int64_t mul = ideal - 2; mul <= ideal + 2; mul++) {
+            if (mul <= 0 || mul > 0xFFFF)
+                continue;
+            int64_t low = 0, high = std::numeric_limits<int64_t>::max();  // Offsets that fit every entry
+            for (int64_t v = 0; v <= limit && low < high; v++) {
+                low = std::max(low, (int64_t{table[v]} << shift) - v * mul);
+                high = std::min(high, (int64_t{table[v] + 1} << shift) - v * mul);
+            }
+            if (low < high && limit * mul + low < (int64_t{1} << 31)) {
+                scale = {static_cast<int32_t>(limit), static_cast<uint32_t>(mul), static_cast<uint32_t>(low), shift};
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+constexpr int STRIP_ROWS = 16;  // RGB rows converted to YCbCr at a time, even
+
+using demosaic_simd::YCC_BITS;
+using demosaic_simd::YCC_HALF;
+using demosaic_simd::YCC_OFFSET;
+
+inline uint8_t luma(const uint8_t* rgb) {
+    using namespace demosaic_simd;
+    return static_cast<uint8_t>((Y_R * rgb[0] + Y_G * rgb[1] + Y_B * rgb[2] + YCC_HALF) >> YCC_BITS);
+}
+// Full-resolution Cb and Cr, before 2x2 averaging
+inline int chroma_blue(const uint8_t* rgb) {
+    using namespace demosaic_simd;
+    return (-CB_R * rgb[0] - CB_G * rgb[1] + (rgb[2] << (YCC_BITS - 1)) + YCC_OFFSET + YCC_HALF - 1) >> YCC_BITS;
+}
+inline int chroma_red(const uint8_t* rgb) {
+    using namespace demosaic_simd;
+    return ((rgb[0] << (YCC_BITS - 1)) - CR_G * rgb[1] - CR_B * rgb[2] + YCC_OFFSET + YCC_HALF - 1) >> YCC_BITS;
+}
+
+// End (exclusive) of the rows or columns covered by whole interior quads:
+// a quad at r needs rows r-2 .. r+3
+int interior_end(int size) {
+    return std::max(2, (size - 4) / 2 * 2 + 2);
+}
+
+}  // namespace
+
+BayerDemosaic::BayerDemosaic(double rGain, double gGain, double bGain, DemosaicKernel kernel)
+    : kernel_(kernel) {
+    const double gains[3] = {rGain, gGain, bGain};
+    for (int ch = 0; ch < 3; ch++) {
+        if (!(gains[ch] > 0))
+            throw std::invalid_argument("Demosaic gains must be positive");
+        std::vector<uint8_t>& table = table_[ch];
+        fixed_[ch] = {};
+        for (int v8 = 0; v8 <= MAX_V8; v8++) {// Stop at the first saturated entry
+            table.push_back(scale_sample(v8 / 8.0, gains[ch]));
+            if (table.back() == 255)
+                break;
+        }
+        limit_[ch] = static_cast<int>(table.size()) - 1;
+        if (!fit_scale(table, gains[ch], fixed_[ch]))
+            kernel_ = DemosaicKernel::Scalar;
+    }
+    if (!demosaic_kernel_supported(kernel_))
+        kernel_ = DemosaicKernel::Scalar;
+}
+
+inline uint8_t BayerDemosaic::scale(Channel channel, int v8) const {
+    return table_[channel][std::min(std::max(v8, 0), limit_[channel])];
+}
+
+void BayerDemosaic::process(const uint16_t* bayer, int width, int height, int rawStride, int shift, uint8_t* rgb) const {
+    process_rows(bayer, width, height, rawStride, shift, 0, height, rgb);
+}
+
+void BayerDemosaic::process(const uint16_t* bayer, int width, int height, int rawStride, int shift, uint8_t* rgb,
+                            WorkerPool& pool) const {
+    const int bands = pool.size();
+    pool.run(bands, [&](int band) {
+        process_rows(bayer, width, height, rawStride, shift, band_start(height, bands, band),
+                     band_start(height, bands, band + 1), rgb);
+    });
+}
+
+void BayerDemosaic::process_rows(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                 int rowBegin, int rowEnd, uint8_t* rgb) const {
+    rowBegin = std::max(rowBegin, 0);
+    rowEnd = std::min(rowEnd, height);
+    if (width <= 0 || rowBegin >= rowEnd)
+        return;
+    process_interior(bayer, width, height, rawStride, shift, rowBegin, rowEnd, rgb, 0);
+    process_border(bayer, width, height, rawStride, shift, rowBegin, rowEnd, rgb, 0);
+}
+
+void BayerDemosaic::process_ycbcr(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                  const YCbCrPlanes& planes) const {
+    process_ycbcr_rows(bayer, width, height, rawStride, shift, 0, height, planes);
+}
+
+void BayerDemosaic::process_ycbcr(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                  const YCbCrPlanes& planes, WorkerPool& pool) const {
+    const int bands = pool.size();
+    pool.run(bands, [&](int band) {
+        process_ycbcr_rows(bayer, width, height, rawStride, shift, band_start(height, bands, band),
+                           band_start(height, bands, band + 1), planes);
+    });
+}
+
+void BayerDemosaic::process_ycbcr_rows(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                       int rowBegin, int rowEnd, const YCbCrPlanes& planes) const {
+    rowBegin = std::max(rowBegin, 0);
+    rowEnd = std::min(rowEnd, height);
+    if (width <= 0 || rowBegin >= rowEnd)
+        return;
+    // RGB a strip at a time, small enough to stay in cache until converted
+    std::vector<uint8_t> strip(static_cast<size_t>(STRIP_ROWS) * width * 3);
+    // Per-pixel Cb and Cr summed over a row pair, one spare column for odd widths
+    std::vector<int16_t> sumCb(width + 1), sumCr(width + 1);
+    const demosaic_simd::YCbCrRowPairKernel vectorKernel = demosaic_simd::ycbcr_row_pair_kernel(kernel_);
+    for (int r0 = rowBegin; r0 < rowEnd; r0 += STRIP_ROWS) {
+        const int r1 = std::min(r0 + STRIP_ROWS, rowEnd);
+        process_interior(bayer, width, height, rawStride, shift, r0, r1, strip.data(), r0);
+        process_border(bayer, width, height, rawStride, shift, r0, r1, strip.data(), r0);
+        for (int r = r0; r < r1; r += 2) {
+            const uint8_t* rgb0 = strip.data() + static_cast<size_t>(r - r0) * width * 3;
+            const uint8_t* rgb1 = r + 1 < r1 ? rgb0 + static_cast<size_t>(width) * 3 : rgb0;  // Last row of odd frames
+            uint8_t* y0 = planes.y + static_cast<size_t>(r) * planes.yStride;
+            uint8_t* y1 = r + 1 < r1 ? y0 + planes.yStride : y0;
+            uint8_t* cb = planes.cb + static_cast<size_t>(r / 2) * planes.cStride;
+            uint8_t* cr = planes.cr + static_cast<size_t>(r / 2) * planes.cStride;
+            const int start = vectorKernel ? vectorKernel(rgb0, rgb1, width, y0, y1, cb, cr) : 0;
+            for (int c = start; c < width; c++) {
+                const uint8_t* p = rgb0 + c * 3;
+                y0[c] = luma(p);
+                sumCb[c] = static_cast<int16_t>(chroma_blue(p));
+                sumCr[c] = static_cast<int16_t>(chroma_red(p));
+            }
+            for (int c = start; c < width; c++) {
+                const uint8_t* p = rgb1 + c * 3;
+                y1[c] = luma(p);
+                sumCb[c] = static_cast<int16_t>(sumCb[c] + chroma_blue(p));
+                sumCr[c] = static_cast<int16_t>(sumCr[c] + chroma_red(p));
+            }
+            sumCb[width] = sumCb[width - 1];
+            sumCr[width] = sumCr[width - 1];
+            for (int c = start / 2; c < (width + 1) / 2; c++) {
+                const int bias = 1 + (c & 1);  // Alternates as in libjpeg's h2v2 downsampling
+                cb[c] = static_cast<uint8_t>((sumCb[2 * c] + sumCb[2 * c + 1] + bias) >> 2);
+                cr[c] = static_cast<uint8_t>((sumCr[2 * c] + sumCr[2 * c + 1] + bias) >> 2);
+            }
+        }
+    }
+}
+
+int BayerDemosaic::band_start(int height, int bands, int band) {
+    if (band >= bands)
+        return height;
+    return static_cast<int>(static_cast<int64_t>(height) * band / bands) & ~1;
+}
+// Quads whose 5x5 neighbourhoods lie inside the frame
+void BayerDemosaic::process_interior(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                     int rowBegin, int rowEnd, uint8_t* rgb, int rgbRow) const {
+    const int quadBegin = std::max(rowBegin, 2);
+    const int quadEnd = std::min(interior_end(height), rowEnd);
+    const int colEnd = interior_end(width);
+    if (quadBegin >= quadEnd || colEnd <= 2)
+        return;
+    // Tables in locals: the byte stores could alias the vectors and force reloads
+    const uint8_t* const tr = table_[Red].data();
+    const uint8_t* const tg = table_[Green].data();
+    const uint8_t* const tb = table_[Blue].data();
+    const int lr = limit_[Red], lg = limit_[Green], lb = limit_[Blue];
+    const demosaic_simd::RowPairKernel vectorKernel = demosaic_simd::row_pair_kernel(kernel_);
+    auto red = [=](int v8) { return tr[std::min(std::max(v8, 0), lr)]; };
+    auto green = [=](int v8) { return tg[std::min(std::max(v8, 0), lg)]; };
+    auto blue = [=](int v8) { return tb[std::min(std::max(v8, 0), lb)]; };
+
+    // 16-bit formats are shifted down once per row into a ring of six rows
+    std::vector<uint16_t> shifted(shift ? 6 * static_cast<size_t>(width) : 0);
+    int nextRow = 0;  // First raw row not yet in the ring
+    const uint16_t* rows[6];
+    for (int r = quadBegin; r < quadEnd; r += 2) {
+        for (int i = 0; i < 6; i++) {
+            const int y = r - 2 + i;
+            if (!shift) {
+                rows[i] = bayer + static_cast<size_t>(y) * rawStride;
+                continue;
+            }
+            uint16_t* slot = shifted.data() + static_cast<size_t>(y % 6) * width;
+            if (y >= nextRow) {
+                const uint16_t* src = bayer + static_cast<size_t>(y) * rawStride;
+                for (int c = 0; c < width; c++) slot[c] = src[c] >> shift;
+                nextRow = y + 1;
+            }
+            rows[i] = slot;
+        }
+        const uint16_t* m2 = rows[0];
+        const uint16_t* m1 = rows[1];
+        const uint16_t* p0 = rows[2];  // G B G B ...
+        const uint16_t* p1 = rows[3];  // R G R G ...
+        const uint16_t* p2 = rows[4];
+        const uint16_t* p3 = rows[5];
+        uint8_t* out0 = rgb + static_cast<size_t>(r - rgbRow) * width * 3;
+        uint8_t* out1 = out0 + static_cast<size_t>(width) * 3;
+        const int vectorEnd = vectorKernel ? vectorKernel(rows, colEnd, fixed_, out0, out1) : 2;
+        for (int c = vectorEnd; c < colEnd; c += 2) {
+            // G at (r, c): R from above and below, B from left and right
+            {
+                const int x8 = 8 * p0[c];
+                const int vert = 2 * (m1[c] + p1[c]) - (m2[c] + p2[c]);
+                const int horz = 2 * (p0[c - 1] + p0[c + 1]) - (p0[c - 2] + p0[c + 2]);
+                uint8_t* o = out0 + c * 3;
+                o[0] = red(x8 + vert);
+                o[1] = green(x8);
+                o[2] = blue(x8 + horz);
+            }
+            // B at (r, c+1): G from the cross, R from the diagonals
+            {
+                const int k = c + 1;
+                const int x8 = 8 * p0[k];
+                const int far = p0[k - 2] + p0[k + 2] + m2[k] + p2[k];
+                const int cross = p0[k - 1] + p0[k + 1] + m1[k] + p1[k];
+                const int diag = m1[k - 1] + m1[k + 1] + p1[k - 1] + p1[k + 1];
+                uint8_t* o = out0 + k * 3;
+                o[0] = red(x8 + 2 * diag - far);
+                o[1] = green(x8 + 2 * cross - far);
+                o[2] = blue(x8);
+            }
+            // R at (r+1, c): G from the cross, B from the diagonals
+            {
+                const int x8 = 8 * p1[c];
+                const int far = p1[c - 2] + p1[c + 2] + m1[c] + p3[c];
+                const int cross = p1[c - 1] + p1[c + 1] + p0[c] + p2[c];
+                const int diag = p0[c - 1] + p0[c + 1] + p2[c - 1] + p2[c + 1];
+                uint8_t* o = out1 + c * 3;
+                o[0] = red(x8);
+                o[1] = green(x8 + 2 * cross - far);
+                o[2] = blue(x8 + 2 * diag - far);
+            }
+            // G at (r+1, c+1): R from left and right, B from above and below
+            {
+                const int k = c + 1;
+                const int x8 = 8 * p1[k];
+                const int horz = 2 * (p1[k - 1] + p1[k + 1]) - (p1[k - 2] + p1[k + 2]);
+                const int vert = 2 * (p0[k] + p2[k]) - (m1[k] + p3[k]);
+                uint8_t* o = out1 + k * 3;
+                o[0] = red(x8 + horz);
+                o[1] = green(x8);
+                o[2] = blue(x8 + vert);
+            }
+        }
+    }
+}
+// Everything process_interior() leaves: the outer rows and columns, plus
+// the odd row or column of frames whose size is not a multiple of the quad
+void BayerDemosaic::process_border(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                   int rowBegin, int rowEnd, uint8_t* rgb, int rgbRow) const {
+    const int quadEnd = interior_end(height);
+    const int colEnd = interior_end(width);
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const bool interiorRow = r >= 2 && r < quadEnd && colEnd > 2;
+        for (int c = 0; c < width; c++) {
+            if (interiorRow && c == 2) {
+                c = colEnd - 1;  // Skip the quads already done
+                continue;
+            }
+            process_pixel(bayer, r, c, width, height, rawStride, shift,
+                          rgb + (static_cast<size_t>(r - rgbRow) * width + c) * 3);
+        }
+    }
+}
+// One pixel with neighbours outside the frame replaced by the nearest edge pixel
+void BayerDemosaic::process_pixel(const uint16_t* bayer, int r, int c, int width, int height, int rawStride,
+                                  int shift, uint8_t* out) const {
+    auto px = [&](int dr, int dc) -> int {
+        const int rr = std::min(std::max(r + dr, 0), height - 1);
+        const int cc = std::min(std::max(c + dc, 0), width - 1);
+        return bayer[rr * rawStride + cc] >> shift;
+    };
+    const int x8 = 8 * px(0, 0);
+    const int vert = 2 * (px(-1, 0) + px(1, 0)) - (px(-2, 0) + px(2, 0));
+    const int horz = 2 * (px(0, -1) + px(0, 1)) - (px(0, -2) + px(0, 2));
+    const int far = px(0, -2) + px(0, 2) + px(-2, 0) + px(2, 0);
+    const int cross = px(0, -1) + px(0, 1) + px(-1, 0) + px(1, 0);
+    const int diag = px(-1, -1) + px(-1, 1) + px(1, -1) + px(1, 1);
+    if ((r % 2 == 1) && (c % 2 == 0)) {// Red site
+        out[0] = scale(Red, x8);
+        out[1] = scale(Green, x8 + 2 * cross - far);
+        out[2] = scale(Blue, x8 + 2 * diag - far);
+    } else if ((r % 2 == 0) && (c % 2 == 1)) {// Blue site
+        out[0] = scale(Red, x8 + 2 * diag - far);
+        out[1] = scale(Green, x8 + 2 * cross - far);
+        out[2] = scale(Blue, x8);
+    } else if (r % 2 == 0) {// Green on a blue row
+        out[0] = scale(Red, x8 + vert);
+        out[1] = scale(Green, x8);
+        out[2] = scale(Blue, x8 + horz);
+    } else {// Green on a red row
+        out[0] = scale(Red, x8 + horz);
+        out[1] = scale(Green, x8);
+        out[2] = scale(Blue, x8 + vert);
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef BAYER_DEMOSAIC_HPP
+#define BAYER_DEMOSAIC_HPP
+
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Channel gains of the reverse camera, applied before the 10-to-8-bit scaling
+constexpr double BAYER_GAIN_R = 5.0;
+constexpr double BAYER_GAIN_G = 4.5;
+constexpr double BAYER_GAIN_B = 4.8;
+
+// Interior kernels. The SIMD ones are compiled into every build for their
+// architecture and picked at run time from what the CPU supports; on 64-bit
+// ARM NEON is always there.
+enum class DemosaicKernel { Scalar, SSE41, AVX2, NEON };
+const char* demosaic_kernel_name(DemosaicKernel kernel);
+bool demosaic_kernel_supported(DemosaicKernel kernel);
+// Widest kernel this CPU can run
+DemosaicKernel best_demosaic_kernel();
+
+// One channel's output table as integer arithmetic the SIMD kernels can do:
+// out = (min(max(v8, 0), limit) * mul + add) >> shift
+struct DemosaicScale {
+    int32_t limit;
+    uint32_t mul;  // Below 2^16
+    uint32_t add;
+    int shift;
+};
+
+// Planes for BayerDemosaic::process_ycbcr(): full-resolution Y and, at half
+// resolution both ways, Cb and Cr ((width + 1) / 2 by (height + 1) / 2)
+struct YCbCrPlanes {
+    uint8_t* y;
+    uint8_t* cb;
+    uint8_t* cr;
+    int yStride;  // Bytes per row
+    int cStride;  // Bytes per row of cb and cr
+};
+
+// Malvar-style demosaic of SGBRG Bayer data to interleaved 8-bit RGB.
+//
+// The sensor pattern repeats every 2x2 quad (G B / R G), so the interior is
+// walked one quad at a time with every colour position known in advance: no
+// parity branches and no coordinate clamps. The two-pixel frame around it,
+// where the 5x5 kernel reaches past the edge, goes through a separate path
+// that replicates the edge pixels. All interpolation is in integers scaled by
+// 8; gain, clamping and the 10-to-8-bit scaling are one table lookup per
+// channel, built from the same arithmetic the floating-point version used,
+// so the output is identical to it. The SIMD kernels do a run of quads per
+// vector with a parity mask in place of the branches, and scale with a
+// multiply and shift that is checked against the tables over their whole
+// range; without an exact one they are not used. Rows only read the source
+// two rows either side, so a frame can be split into horizontal bands that
+// run in parallel and write disjoint output. For JPEG the same RGB can be
+// turned into YCbCr 4:2:0 a strip at a time, never holding a whole RGB frame.
+class BayerDemosaic {
+public:
+    // kernel falls back to Scalar if the CPU lacks it or the gains have no
+    // exact fixed-point scale
+    BayerDemosaic(double rGain = BAYER_GAIN_R, double gGain = BAYER_GAIN_G, double bGain = BAYER_GAIN_B,
+                  DemosaicKernel kernel = best_demosaic_kernel());
+
+    DemosaicKernel kernel() const { return kernel_; }
+
+    // bayer: 10-bit samples after a right shift by shift (6 for 16-bit
+    // formats), rawStride samples per row. rgb receives width * height * 3
+    // bytes.
+    void process(const uint16_t* bayer, int width, int height, int rawStride, int shift, uint8_t* rgb) const;
+    // The same, as pool.size() bands run on the pool; returns when all are done
+    void process(const uint16_t* bayer, int width, int height, int rawStride, int shift, uint8_t* rgb,
+                 WorkerPool& pool) const;
+    // Only output rows rowBegin .. rowEnd - 1 (rgb is still the whole frame).
+    // rowBegin must be even so no quad is split.
+    void process_rows(const uint16_t* bayer, int width, int height, int rawStride, int shift, int rowBegin,
+                      int rowEnd, uint8_t* rgb) const;
+    // JFIF YCbCr with chroma averaged over each 2x2 block (the last column
+    // or row repeated for odd sizes), the same values libjpeg computes from
+    // the RGB output
+    void process_ycbcr(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                       const YCbCrPlanes& planes) const;
+    void process_ycbcr(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                       const YCbCrPlanes& planes, WorkerPool& pool) const;
+    // Rows rowBegin .. rowEnd - 1 and their chroma rows; rowBegin must be
+    // even, and rowEnd too unless it is height
+    void process_ycbcr_rows(const uint16_t* bayer, int width, int height, int rawStride, int shift, int rowBegin,
+                            int rowEnd, const YCbCrPlanes& planes) const;
+    // First row of band out of bands equal bands (height for band == bands),
+    // always even
+    static int band_start(int height, int bands, int band);
+
+private:
+    enum Channel { Red = 0, Green = 1, Blue = 2 };
+
+    // Interpolated value scaled by 8 to output byte
+    uint8_t scale(Channel channel, int v8) const;
+    // rgb holds rows from rgbRow on
+    void process_interior(const uint16_t* bayer, int width, int height, int rawStride, int shift, int rowBegin,
+                          int rowEnd, uint8_t* rgb, int rgbRow) const;
+    void process_border(const uint16_t* bayer, int width, int height, int rawStride, int shift, int rowBegin,
+                        int rowEnd, uint8_t* rgb, int rgbRow) const;
+    void process_pixel(const uint16_t* bayer, int r, int c, int width, int height, int rawStride, int shift,
+                       uint8_t* out) const;
+
+    std::vector<uint8_t> table_[3];  // Indexed by the clamped value scaled by 8
+    int limit_[3];                   // First value that saturates to 255
+    DemosaicScale fixed_[3];         // The tables for the SIMD kernels
+    DemosaicKernel kernel_;
+};
+
+#endif // BAYER_DEMOSAIC_HPP
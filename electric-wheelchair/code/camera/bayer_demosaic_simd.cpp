@@ -0,0 +1,509 @@
+#include "bayer_demosaic_simd.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DEMOSAIC_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define DEMOSAIC_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Every kernel works on one row of the pair at a time, a vector of
+// consecutive columns per step. Even lanes hold the green (blue row) or red
+// (red row) sites and odd lanes the other, so both interpolations are
+// computed for all lanes and the parity mask picks per lane. In terms of
+//   x8   = 8 * centre                h1 = left + right     v1 = up + down
+//   horz = 2 * h1 - (left2 + right2) vert = 2 * v1 - (up2 + down2)
+//   diag = the four diagonal neighbours
+// the chroma site gets G = x8 + horz + vert and the opposite chroma
+// x8 + 2 * diag - (left2 + right2 + up2 + down2), exactly as the scalar path.
+
+namespace demosaic_simd {
+
+#if DEMOSAIC_X86
+
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace {
+
+// R, G, B bytes of 8 pixels (R and G in one vector) to 24 interleaved bytes
+TARGET_SSE41 inline void store_rgb8(uint8_t* out, __m128i rg, __m128i b) {
+    const __m128i rgFirst = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+    const __m128i bFirst = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i rgLast = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bLast = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                     _mm_or_si128(_mm_shuffle_epi8(rg, rgFirst), _mm_shuffle_epi8(b, bFirst)));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16),
+                     _mm_or_si128(_mm_shuffle_epi8(rg, rgLast), _mm_shuffle_epi8(b, bLast)));
+}
+
+// Clamp, multiply and shift 8 values to 16-bit results of at most 255
+TARGET_SSE41 inline __m128i scale8(__m128i v, const DemosaicScale& s) {
+    v = _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), _mm_set1_epi16(static_cast<int16_t>(s.limit)));
+    const __m128i mul = _mm_set1_epi32(static_cast<int32_t>(s.mul));
+    const __m128i add = _mm_set1_epi32(static_cast<int32_t>(s.add));
+    const __m128i shift = _mm_cvtsi32_si128(s.shift);
+    const __m128i lo = _mm_srl_epi32(_mm_add_epi32(_mm_mullo_epi32(_mm_cvtepu16_epi32(v), mul), add), shift);
+    const __m128i hi = _mm_srl_epi32(
+        _mm_add_epi32(_mm_mullo_epi32(_mm_unpackhi_epi16(v, _mm_setzero_si128()), mul), add), shift);
+    return _mm_packus_epi32(lo, hi);
+}
+
+TARGET_SSE41 inline __m128i load8(const uint16_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// One row of the pair, 8 columns from c. blueRow: G B G B, else R G R G.
+TARGET_SSE41 inline void row8(const uint16_t* const rows[6], int centre, int c, bool blueRow,
+                              const DemosaicScale scale[3], uint8_t* out) {
+    const uint16_t* up2 = rows[centre - 2];
+    const uint16_t* up = rows[centre - 1];
+    const uint16_t* x = rows[centre];
+    const uint16_t* down = rows[centre + 1];
+    const uint16_t* down2 = rows[centre + 2];
+    const __m128i even = _mm_set1_epi32(0x0000FFFF);
+
+    const __m128i x8 = _mm_slli_epi16(load8(x + c), 3);
+    const __m128i h2 = _mm_add_epi16(load8(x + c - 2), load8(x + c + 2));
+    const __m128i v2 = _mm_add_epi16(load8(up2 + c), load8(down2 + c));
+    const __m128i horz = _mm_sub_epi16(_mm_slli_epi16(_mm_add_epi16(load8(x + c - 1), load8(x + c + 1)), 1), h2);
+    const __m128i vert = _mm_sub_epi16(_mm_slli_epi16(_mm_add_epi16(load8(up + c), load8(down + c)), 1), v2);
+    const __m128i diag = _mm_add_epi16(_mm_add_epi16(load8(up + c - 1), load8(up + c + 1)),
+                                       _mm_add_epi16(load8(down + c - 1), load8(down + c + 1)));
+    const __m128i siteG = _mm_add_epi16(x8, _mm_add_epi16(horz, vert));
+    const __m128i opposite = _mm_sub_epi16(_mm_add_epi16(x8, _mm_slli_epi16(diag, 1)), _mm_add_epi16(h2, v2));
+    const __m128i xh = _mm_add_epi16(x8, horz);
+    const __m128i xv = _mm_add_epi16(x8, vert);
+
+    __m128i r, g, b;  // _mm_blendv_epi8(odd, even, mask)
+    if (blueRow) {
+        r = _mm_blendv_epi8(opposite, xv, even);
+        g = _mm_blendv_epi8(siteG, x8, even);
+        b = _mm_blendv_epi8(x8, xh, even);
+    } else {
+        r = _mm_blendv_epi8(xh, x8, even);
+        g = _mm_blendv_epi8(x8, siteG, even);
+        b = _mm_blendv_epi8(xv, opposite, even);
+    }
+    const __m128i rg = _mm_packus_epi16(scale8(r, scale[0]), scale8(g, scale[1]));
+    store_rgb8(out + c * 3, rg, _mm_packus_epi16(scale8(b, scale[2]), _mm_setzero_si128()));
+}
+
+TARGET_SSE41 int row_pair_sse41(const uint16_t* const rows[6], int colEnd, const DemosaicScale scale[3],
+                                uint8_t* out0, uint8_t* out1) {
+    int c = 2;
+    for (; c + 8 <= colEnd; c += 8) {
+        row8(rows, 2, c, true, scale, out0);
+        row8(rows, 3, c, false, scale, out1);
+    }
+    return c;
+}
+
+// 16 interleaved RGB pixels to one vector of bytes per channel
+TARGET_SSE41 inline void load_rgb16(const uint8_t* p, __m128i& r, __m128i& g, __m128i& b) {
+    const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+    r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(v0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(v0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(v0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// Y, Cb and Cr of 4 pixels (16-bit channels in the low half of r, g and b)
+// as 32-bit lanes. The coefficients above 2^15 are split as libjpeg-turbo
+// does, so every product fits a signed 16-bit multiply-add.
+TARGET_SSE41 inline void ycc4(__m128i r, __m128i g, __m128i b, __m128i& y, __m128i& cb, __m128i& cr) {
+    const __m128i rg = _mm_unpacklo_epi16(r, g);
+    const __m128i bg = _mm_unpacklo_epi16(b, g);
+    const __m128i gb = _mm_unpacklo_epi16(g, b);
+    const __m128i chromaOffset = _mm_set1_epi32(YCC_OFFSET + YCC_HALF - 1);
+    y = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set1_epi32((Y_G - (1 << 14)) << 16 | Y_R)),
+                      _mm_madd_epi16(bg, _mm_set1_epi32((1 << 14) << 16 | Y_B)));
+    y = _mm_srli_epi32(_mm_add_epi32(y, _mm_set1_epi32(YCC_HALF)), YCC_BITS);
+    cb = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set1_epi32(static_cast<int32_t>(-CB_G * 65536 + (-CB_R & 0xFFFF)))),
+                       _mm_slli_epi32(_mm_cvtepu16_epi32(b), YCC_BITS - 1));
+    cb = _mm_srai_epi32(_mm_add_epi32(cb, chromaOffset), YCC_BITS);
+    cr = _mm_add_epi32(_mm_madd_epi16(gb, _mm_set1_epi32(static_cast<int32_t>(-CR_B * 65536 + (-CR_G & 0xFFFF)))),
+                       _mm_slli_epi32(_mm_cvtepu16_epi32(r), YCC_BITS - 1));
+    cr = _mm_srai_epi32(_mm_add_epi32(cr, chromaOffset), YCC_BITS);
+}
+
+// One row of 16 pixels: stores Y and adds the per-pixel Cb and Cr to the sums
+TARGET_SSE41 inline void ycc_row16(const uint8_t* rgb, uint8_t* y, __m128i cbSum[2], __m128i crSum[2]) {
+    __m128i r8, g8, b8;
+    load_rgb16(rgb, r8, g8, b8);
+    __m128i luma[2];
+    for (int half = 0; half < 2; half++) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i r = half ? _mm_unpackhi_epi8(r8, zero) : _mm_cvtepu8_epi16(r8);
+        const __m128i g = half ? _mm_unpackhi_epi8(g8, zero) : _mm_cvtepu8_epi16(g8);
+        const __m128i b = half ? _mm_unpackhi_epi8(b8, zero) : _mm_cvtepu8_epi16(b8);
+        __m128i yLo, cbLo, crLo, yHi, cbHi, crHi;
+        ycc4(r, g, b, yLo, cbLo, crLo);
+        ycc4(_mm_unpackhi_epi64(r, r), _mm_unpackhi_epi64(g, g), _mm_unpackhi_epi64(b, b), yHi, cbHi, crHi);
+        luma[half] = _mm_packs_epi32(yLo, yHi);
+        cbSum[half] = _mm_add_epi16(cbSum[half], _mm_packs_epi32(cbLo, cbHi));
+        crSum[half] = _mm_add_epi16(crSum[half], _mm_packs_epi32(crLo, crHi));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y), _mm_packus_epi16(luma[0], luma[1]));
+}
+
+TARGET_SSE41 int ycbcr_row_pair_sse41(const uint8_t* rgb0, const uint8_t* rgb1, int width, uint8_t* y0,
+                                      uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+    const __m128i bias = _mm_set1_epi32(2 << 16 | 1);  // Even chroma columns 1, odd 2
+    int c = 0;
+    for (; c + 16 <= width; c += 16) {
+        __m128i cbSum[2] = {_mm_setzero_si128(), _mm_setzero_si128()};
+        __m128i crSum[2] = {_mm_setzero_si128(), _mm_setzero_si128()};
+        ycc_row16(rgb0 + c * 3, y0 + c, cbSum, crSum);
+        ycc_row16(rgb1 + c * 3, y1 + c, cbSum, crSum);
+        // Horizontal pairs, then the mean of the four
+        const __m128i cb8 = _mm_srli_epi16(_mm_add_epi16(_mm_hadd_epi16(cbSum[0], cbSum[1]), bias), 2);
+        const __m128i cr8 = _mm_srli_epi16(_mm_add_epi16(_mm_hadd_epi16(crSum[0], crSum[1]), bias), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(cb + c / 2), _mm_packus_epi16(cb8, cb8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(cr + c / 2), _mm_packus_epi16(cr8, cr8));
+    }
+    return c;
+}
+
+// As scale8 for 16 values
+TARGET_AVX2 inline __m256i scale16(__m256i v, const DemosaicScale& s) {
+    v = _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()),
+                         _mm256_set1_epi16(static_cast<int16_t>(s.limit)));
+    const __m256i mul = _mm256_set1_epi32(static_cast<int32_t>(s.mul));
+    const __m256i add = _mm256_set1_epi32(static_cast<int32_t>(s.add));
+    const __m128i shift = _mm_cvtsi32_si128(s.shift);
+    const __m256i lo = _mm256_srl_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)), mul), add), shift);
+    const __m256i hi = _mm256_srl_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)), mul), add),
+        shift);
+    // packus works within 128-bit lanes; put the four quarters back in order
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+}
+
+TARGET_AVX2 inline __m256i load16(const uint16_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 inline void row16(const uint16_t* const rows[6], int centre, int c, bool blueRow,
+                              const DemosaicScale scale[3], uint8_t* out) {
+    const uint16_t* up2 = rows[centre - 2];
+    const uint16_t* up = rows[centre - 1];
+    const uint16_t* x = rows[centre];
+    const uint16_t* down = rows[centre + 1];
+    const uint16_t* down2 = rows[centre + 2];
+    const __m256i even = _mm256_set1_epi32(0x0000FFFF);
+
+    const __m256i x8 = _mm256_slli_epi16(load16(x + c), 3);
+    const __m256i h2 = _mm256_add_epi16(load16(x + c - 2), load16(x + c + 2));
+    const __m256i v2 = _mm256_add_epi16(load16(up2 + c), load16(down2 + c));
+    const __m256i horz =
+        _mm256_sub_epi16(_mm256_slli_epi16(_mm256_add_epi16(load16(x + c - 1), load16(x + c + 1)), 1), h2);
+    const __m256i vert =
+        _mm256_sub_epi16(_mm256_slli_epi16(_mm256_add_epi16(load16(up + c), load16(down + c)), 1), v2);
+    const __m256i diag = _mm256_add_epi16(_mm256_add_epi16(load16(up + c - 1), load16(up + c + 1)),
+                                          _mm256_add_epi16(load16(down + c - 1), load16(down + c + 1)));
+    const __m256i siteG = _mm256_add_epi16(x8, _mm256_add_epi16(horz, vert));
+    const __m256i opposite =
+        _mm256_sub_epi16(_mm256_add_epi16(x8, _mm256_slli_epi16(diag, 1)), _mm256_add_epi16(h2, v2));
+    const __m256i xh = _mm256_add_epi16(x8, horz);
+    const __m256i xv = _mm256_add_epi16(x8, vert);
+
+    __m256i r, g, b;
+    if (blueRow) {
+        r = _mm256_blendv_epi8(opposite, xv, even);
+        g = _mm256_blendv_epi8(siteG, x8, even);
+        b = _mm256_blendv_epi8(x8, xh, even);
+    } else {
+        r = _mm256_blendv_epi8(xh, x8, even);
+        g = _mm256_blendv_epi8(x8, siteG, even);
+        b = _mm256_blendv_epi8(xv, opposite, even);
+    }
+    r = scale16(r, scale[0]);
+    g = scale16(g, scale[1]);
+    b = scale16(b, scale[2]);
+    // Bytes of the first and second 8 pixels, interleaved 8 at a time
+    const __m256i rg = _mm256_packus_epi16(r, g);  // R0-7 G0-7 | R8-15 G8-15
+    const __m256i bb = _mm256_packus_epi16(b, _mm256_setzero_si256());
+    store_rgb8(out + c * 3, _mm256_castsi256_si128(rg), _mm256_castsi256_si128(bb));
+    store_rgb8(out + c * 3 + 24, _mm256_extracti128_si256(rg, 1), _mm256_extracti128_si256(bb, 1));
+}
+
+TARGET_AVX2 int row_pair_avx2(const uint16_t* const rows[6], int colEnd, const DemosaicScale scale[3],
+                              uint8_t* out0, uint8_t* out1) {
+    int c = 2;
+    for (; c + 16 <= colEnd; c += 16) {
+        row16(rows, 2, c, true, scale, out0);
+        row16(rows, 3, c, false, scale, out1);
+    }
+    return c;
+}
+
+// As ycc4 for 8 pixels, 4 in each 128-bit lane
+TARGET_AVX2 inline void ycc8(__m256i r, __m256i g, __m256i b, __m256i& y, __m256i& cb, __m256i& cr) {
+    const __m256i rg = _mm256_unpacklo_epi16(r, g);
+    const __m256i bg = _mm256_unpacklo_epi16(b, g);
+    const __m256i gb = _mm256_unpacklo_epi16(g, b);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i chromaOffset = _mm256_set1_epi32(YCC_OFFSET + YCC_HALF - 1);
+    y = _mm256_add_epi32(_mm256_madd_epi16(rg, _mm256_set1_epi32((Y_G - (1 << 14)) << 16 | Y_R)),
+                         _mm256_madd_epi16(bg, _mm256_set1_epi32((1 << 14) << 16 | Y_B)));
+    y = _mm256_srli_epi32(_mm256_add_epi32(y, _mm256_set1_epi32(YCC_HALF)), YCC_BITS);
+    cb = _mm256_add_epi32(
+        _mm256_madd_epi16(rg, _mm256_set1_epi32(static_cast<int32_t>(-CB_G * 65536 + (-CB_R & 0xFFFF)))),
+        _mm256_slli_epi32(_mm256_unpacklo_epi16(b, zero), YCC_BITS - 1));
+    cb = _mm256_srai_epi32(_mm256_add_epi32(cb, chromaOffset), YCC_BITS);
+    cr = _mm256_add_epi32(
+        _mm256_madd_epi16(gb, _mm256_set1_epi32(static_cast<int32_t>(-CR_B * 65536 + (-CR_G & 0xFFFF)))),
+        _mm256_slli_epi32(_mm256_unpacklo_epi16(r, zero), YCC_BITS - 1));
+    cr = _mm256_srai_epi32(_mm256_add_epi32(cr, chromaOffset), YCC_BITS);
+}
+
+// As the SSE4.1 ycc_row16. Unpacking and packing within lanes keeps the
+// pixels in order.
+TARGET_AVX2 inline void ycc_row16(const uint8_t* rgb, uint8_t* y, __m256i& cbSum, __m256i& crSum) {
+    __m128i r8, g8, b8;
+    load_rgb16(rgb, r8, g8, b8);
+    const __m256i r = _mm256_cvtepu8_epi16(r8);
+    const __m256i g = _mm256_cvtepu8_epi16(g8);
+    const __m256i b = _mm256_cvtepu8_epi16(b8);
+    __m256i yLo, cbLo, crLo, yHi, cbHi, crHi;
+    ycc8(r, g, b, yLo, cbLo, crLo);
+    ycc8(_mm256_unpackhi_epi64(r, r), _mm256_unpackhi_epi64(g, g), _mm256_unpackhi_epi64(b, b), yHi, cbHi, crHi);
+    const __m256i luma = _mm256_packs_epi32(yLo, yHi);
+    cbSum = _mm256_add_epi16(cbSum, _mm256_packs_epi32(cbLo, cbHi));
+    crSum = _mm256_add_epi16(crSum, _mm256_packs_epi32(crLo, crHi));
+    const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(luma, luma), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y), _mm256_castsi256_si128(bytes));
+}
+
+// Means of horizontal pairs of the 2x2 sums of 16 pixels as 8 bytes
+TARGET_AVX2 inline __m128i chroma8(__m256i sum) {
+    const __m256i bias = _mm256_set1_epi64x(int64_t{2} << 32 | 1);  // Even chroma columns 1, odd 2
+    const __m256i mean = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(sum, _mm256_set1_epi16(1)), bias), 2);
+    const __m128i words = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(mean, mean), 0x08));
+    return _mm_packus_epi16(words, words);
+}
+
+TARGET_AVX2 int ycbcr_row_pair_avx2(const uint8_t* rgb0, const uint8_t* rgb1, int width, uint8_t* y0,
+                                    uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+    int c = 0;
+    for (; c + 16 <= width; c += 16) {
+        __m256i cbSum = _mm256_setzero_si256();
+        __m256i crSum = _mm256_setzero_si256();
+        ycc_row16(rgb0 + c * 3, y0 + c, cbSum, crSum);
+        ycc_row16(rgb1 + c * 3, y1 + c, cbSum, crSum);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(cb + c / 2), chroma8(cbSum));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(cr + c / 2), chroma8(crSum));
+    }
+    return c;
+}
+
+}  // namespace
+
+#elif DEMOSAIC_NEON
+
+namespace {
+
+inline int16x8_t load8(const uint16_t* p) {
+    return vreinterpretq_s16_u16(vld1q_u16(p));
+}
+
+// Clamp, multiply and shift 8 values to bytes
+inline uint8x8_t scale8(int16x8_t v, const DemosaicScale& s) {
+    v = vminq_s16(vmaxq_s16(v, vdupq_n_s16(0)), vdupq_n_s16(static_cast<int16_t>(s.limit)));
+    const uint16x8_t u = vreinterpretq_u16_s16(v);
+    const uint16x4_t mul = vdup_n_u16(static_cast<uint16_t>(s.mul));
+    const uint32x4_t add = vdupq_n_u32(s.add);
+    const int32x4_t shift = vdupq_n_s32(-s.shift);
+    const uint32x4_t lo = vshlq_u32(vmlal_u16(add, vget_low_u16(u), mul), shift);
+    const uint32x4_t hi = vshlq_u32(vmlal_u16(add, vget_high_u16(u), mul), shift);
+    return vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+
+inline void row8(const uint16_t* const rows[6], int centre, int c, bool blueRow, const DemosaicScale scale[3],
+                 uint8_t* out) {
+    const uint16_t* up2 = rows[centre - 2];
+    const uint16_t* up = rows[centre - 1];
+    const uint16_t* x = rows[centre];
+    const uint16_t* down = rows[centre + 1];
+    const uint16_t* down2 = rows[centre + 2];
+    const uint16x8_t even = vreinterpretq_u16_u32(vdupq_n_u32(0x0000FFFF));
+
+    const int16x8_t x8 = vshlq_n_s16(load8(x + c), 3);
+    const int16x8_t h2 = vaddq_s16(load8(x + c - 2), load8(x + c + 2));
+    const int16x8_t v2 = vaddq_s16(load8(up2 + c), load8(down2 + c));
+    const int16x8_t horz = vsubq_s16(vshlq_n_s16(vaddq_s16(load8(x + c - 1), load8(x + c + 1)), 1), h2);
+    const int16x8_t vert = vsubq_s16(vshlq_n_s16(vaddq_s16(load8(up + c), load8(down + c)), 1), v2);
+    const int16x8_t diag = vaddq_s16(vaddq_s16(load8(up + c - 1), load8(up + c + 1)),
+                                     vaddq_s16(load8(down + c - 1), load8(down + c + 1)));
+    const int16x8_t siteG = vaddq_s16(x8, vaddq_s16(horz, vert));
+    const int16x8_t opposite = vsubq_s16(vaddq_s16(x8, vshlq_n_s16(diag, 1)), vaddq_s16(h2, v2));
+    const int16x8_t xh = vaddq_s16(x8, horz);
+    const int16x8_t xv = vaddq_s16(x8, vert);
+
+    int16x8_t r, g, b;  // vbslq_s16(mask, even, odd)
+    if (blueRow) {
+        r = vbslq_s16(even, xv, opposite);
+        g = vbslq_s16(even, x8, siteG);
+        b = vbslq_s16(even, xh, x8);
+    } else {
+        r = vbslq_s16(even, x8, xh);
+        g = vbslq_s16(even, siteG, x8);
+        b = vbslq_s16(even, opposite, xv);
+    }
+    uint8x8x3_t rgb;
+    rgb.val[0] = scale8(r, scale[0]);
+    rgb.val[1] = scale8(g, scale[1]);
+    rgb.val[2] = scale8(b, scale[2]);
+    vst3_u8(out + c * 3, rgb);
+}
+
+int row_pair_neon(const uint16_t* const rows[6], int colEnd, const DemosaicScale scale[3], uint8_t* out0,
+                  uint8_t* out1) {
+    int c = 2;
+    for (; c + 8 <= colEnd; c += 8) {
+        row8(rows, 2, c, true, scale, out0);
+        row8(rows, 3, c, false, scale, out1);
+    }
+    return c;
+}
+
+// Y of 4 pixels and their per-pixel Cb and Cr, the chroma computed
+// unsigned: the offset and the B / 2 or R / 2 term always cover the
+// subtracted products
+inline void ycc4(uint16x4_t r, uint16x4_t g, uint16x4_t b, uint16x4_t& y, uint16x4_t& cb, uint16x4_t& cr) {
+    uint32x4_t acc = vmlal_n_u16(vmull_n_u16(r, Y_R), g, Y_G);
+    acc = vmlal_n_u16(acc, b, Y_B);
+    y = vshrn_n_u32(vaddq_u32(acc, vdupq_n_u32(YCC_HALF)), YCC_BITS);
+    const uint32x4_t chromaOffset = vdupq_n_u32(YCC_OFFSET + YCC_HALF - 1);
+    acc = vmlal_n_u16(chromaOffset, b, 1 << (YCC_BITS - 1));
+    acc = vmlsl_n_u16(vmlsl_n_u16(acc, r, CB_R), g, CB_G);
+    cb = vshrn_n_u32(acc, YCC_BITS);
+    acc = vmlal_n_u16(chromaOffset, r, 1 << (YCC_BITS - 1));
+    acc = vmlsl_n_u16(vmlsl_n_u16(acc, g, CR_G), b, CR_B);
+    cr = vshrn_n_u32(acc, YCC_BITS);
+}
+
+// One row of 16 pixels: stores Y and adds the per-pixel Cb and Cr to the sums
+inline void ycc_row16(const uint8_t* rgb, uint8_t* y, uint16x8_t cbSum[2], uint16x8_t crSum[2]) {
+    const uint8x16x3_t px = vld3q_u8(rgb);
+    uint16x8_t luma[2];
+    for (int half = 0; half < 2; half++) {
+        const uint16x8_t r = vmovl_u8(half ? vget_high_u8(px.val[0]) : vget_low_u8(px.val[0]));
+        const uint16x8_t g = vmovl_u8(half ? vget_high_u8(px.val[1]) : vget_low_u8(px.val[1]));
+        const uint16x8_t b = vmovl_u8(half ? vget_high_u8(px.val[2]) : vget_low_u8(px.val[2]));
+        uint16x4_t yLo, cbLo, crLo, yHi, cbHi, crHi;
+        ycc4(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), yLo, cbLo, crLo);
+        ycc4(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), yHi, cbHi, crHi);
+        luma[half] = vcombine_u16(yLo, yHi);
+        cbSum[half] = vaddq_u16(cbSum[half], vcombine_u16(cbLo, cbHi));
+        crSum[half] = vaddq_u16(crSum[half], vcombine_u16(crLo, crHi));
+    }
+    vst1q_u8(y, vcombine_u8(vmovn_u16(luma[0]), vmovn_u16(luma[1])));
+}
+
+int ycbcr_row_pair_neon(const uint8_t* rgb0, const uint8_t* rgb1, int width, uint8_t* y0, uint8_t* y1,
+                        uint8_t* cb, uint8_t* cr) {
+    const uint16x8_t bias = vreinterpretq_u16_u32(vdupq_n_u32(2 << 16 | 1));  // Even chroma columns 1, odd 2
+    int c = 0;
+    for (; c + 16 <= width; c += 16) {
+        uint16x8_t cbSum[2] = {vdupq_n_u16(0), vdupq_n_u16(0)};
+        uint16x8_t crSum[2] = {vdupq_n_u16(0), vdupq_n_u16(0)};
+        ycc_row16(rgb0 + c * 3, y0 + c, cbSum, crSum);
+        ycc_row16(rgb1 + c * 3, y1 + c, cbSum, crSum);
+        // Horizontal pairs, then the mean of the four
+        vst1_u8(cb + c / 2, vmovn_u16(vshrq_n_u16(vaddq_u16(vpaddq_u16(cbSum[0], cbSum[1]), bias), 2)));
+        vst1_u8(cr + c / 2, vmovn_u16(vshrq_n_u16(vaddq_u16(vpaddq_u16(crSum[0], crSum[1]), bias), 2)));
+    }
+    return c;
+}
+
+}  // namespace
+
+#endif
+
+RowPairKernel row_pair_kernel(DemosaicKernel kernel) {
+    switch (kernel) {
+#if DEMOSAIC_X86
+    case DemosaicKernel::SSE41:
+        return row_pair_sse41;
+    case DemosaicKernel::AVX2:
+        return row_pair_avx2;
+#elif DEMOSAIC_NEON
+    case DemosaicKernel::NEON:
+        return row_pair_neon;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+YCbCrRowPairKernel ycbcr_row_pair_kernel(DemosaicKernel kernel) {
+    switch (kernel) {
+#if DEMOSAIC_X86
+    case DemosaicKernel::SSE41:
+        return ycbcr_row_pair_sse41;
+    case DemosaicKernel::AVX2:
+        return ycbcr_row_pair_avx2;
+#elif DEMOSAIC_NEON
+    case DemosaicKernel::NEON:
+        return ycbcr_row_pair_neon;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+}  // namespace demosaic_simd
+
+const char* demosaic_kernel_name(DemosaicKernel kernel) {
+    switch (kernel) {
+    case DemosaicKernel::SSE41:
+        return "SSE4.1";
+    case DemosaicKernel::AVX2:
+        return "AVX2";
+    case DemosaicKernel::NEON:
+        return "NEON";
+    default:
+        return "scalar";
+    }
+}
+
+bool demosaic_kernel_supported(DemosaicKernel kernel) {
+    switch (kernel) {
+    case DemosaicKernel::Scalar:
+        return true;
+#if DEMOSAIC_X86
+    case DemosaicKernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case DemosaicKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#elif DEMOSAIC_NEON
+    case DemosaicKernel::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+DemosaicKernel best_demosaic_kernel() {
+    for (DemosaicKernel kernel : {DemosaicKernel::AVX2, DemosaicKernel::NEON, DemosaicKernel::SSE41}) {
+        if (demosaic_kernel_supported(kernel))
+            return kernel;
+    }
+    return DemosaicKernel::Scalar;
+}
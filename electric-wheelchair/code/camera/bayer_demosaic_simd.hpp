@@ -0,0 +1,44 @@
+#ifndef BAYER_DEMOSAIC_SIMD_HPP
+#define BAYER_DEMOSAIC_SIMD_HPP
+
+#include <cstdint>
+#include "bayer_demosaic.hpp"
+
+namespace demosaic_simd {
+
+// Demosaics one row pair of interior quads from column 2 in whole vectors
+// and returns the column where it stopped (at most colEnd); the caller does
+// the rest. rows are the six 10-bit rows from two above the pair to two
+// below it, out0 and out1 the RGB rows of the pair.
+using RowPairKernel = int (*)(const uint16_t* const rows[6], int colEnd, const DemosaicScale scale[3],
+                              uint8_t* out0, uint8_t* out1);
+
+// nullptr for Scalar or kernels not built for this architecture
+RowPairKernel row_pair_kernel(DemosaicKernel kernel);
+
+// JFIF colour conversion in libjpeg's fixed point (16 fractional bits), so
+// the planes match what it would make of the RGB
+constexpr int YCC_BITS = 16;
+constexpr int32_t ycc_fix(double x) {
+    return static_cast<int32_t>(x * (1 << YCC_BITS) + 0.5);
+}
+constexpr int32_t Y_R = ycc_fix(0.29900), Y_G = ycc_fix(0.58700), Y_B = ycc_fix(0.11400);
+constexpr int32_t CB_R = ycc_fix(0.16874), CB_G = ycc_fix(0.33126);  // Cb = B / 2 - CB_R * R - CB_G * G
+constexpr int32_t CR_G = ycc_fix(0.41869), CR_B = ycc_fix(0.08131);  // Cr = R / 2 - CR_G * G - CR_B * B
+constexpr int32_t YCC_HALF = 1 << (YCC_BITS - 1);
+constexpr int32_t YCC_OFFSET = 128 << YCC_BITS;
+
+// Converts a pair of RGB rows (the same row twice for the last row of odd
+// frames) to their Y rows and one row of Cb and Cr, each the rounded mean of
+// the per-pixel values over 2x2 blocks with libjpeg's alternating bias. Works
+// in whole vectors from column 0 and returns the (even) column where it
+// stopped; the caller does the rest.
+using YCbCrRowPairKernel = int (*)(const uint8_t* rgb0, const uint8_t* rgb1, int width, uint8_t* y0, uint8_t* y1,
+                                   uint8_t* cb, uint8_t* cr);
+
+// nullptr for Scalar or kernels not built for this architecture
+YCbCrRowPairKernel ycbcr_row_pair_kernel(DemosaicKernel kernel);
+
+}  // namespace demosaic_simd
+
+#endif // BAYER_DEMOSAIC_SIMD_HPP
@@ -32,117 +32,37 @@ std::atomic<bool> MJPEGServer::running_{true};
 
 //------------------------------------------------------------------------------
 // Image Processing Helper Functions
-// Boundary clipping: If the row or column is out of range, "clip" to the nearest legal value
-uint16_t MJPEGServer::get_pixel(const uint16_t* bayer, int r, int c, int width, int height, int rawStride, int shift) {
-    if (r < 0)
-        r = 0;
-    if (r >= height)
-        r = height - 1;
-    if (c < 0)
-        c = 0;
-    if (c >= width)
-        c = width - 1;
-    return bayer[r * rawStride + c] >> shift; // Access the original data and shift right by shift bits (processing 10/16 bit data)
+// Repeat the last column and row of a plane out to its padded size, as libjpeg does for partial MCUs
+static void pad_plane(uint8_t* plane, int stride, int width, int height, int paddedHeight) {
+    for (int r = 0; r < height; r++)
+        std::fill(plane + r * stride + width, plane + (r + 1) * stride, plane[r * stride + width - 1]);
+    for (int r = height; r < paddedHeight; r++)
+        std::copy(plane + (height - 1) * stride, plane + height * stride, plane + r * stride);
 }
-// Use the Malvar demosaicing algorithm to convert the Bayer format to RGB
-std::vector<uint8_t> MJPEGServer::demosaic_malvar(const uint16_t* bayer, int width, int height, int rawStride, int shift) {// Gain coefficient for each channel to increase color saturation
-    const double R_gain = 5.0;
-    const double G_gain = 4.5;
-    const double B_gain = 4.8;
-// Allocate RGB buffer: 3 bytes per pixel
-    std::vector<uint8_t> rgb(width * height * 3, 0);
-    for (int r = 0; r < height; r++) { // Iterate through each pixel
-        for (int c = 0; c < width; c++) {
-            double R = 0.0, G = 0.0, B = 0.0;// Calculate R/G/B according to different coordinates of RGGB mode
-            if ((r % 2 == 1) && (c % 2 == 0)) { // Determine the pixel position of the Bayer format
-                R = get_pixel(bayer, r, c, width, height, rawStride, shift); // Read the red component of the current pixel from the Bayer data
-                double sum1 = get_pixel(bayer, r, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r, c + 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r - 1, c, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c, width, height, rawStride, shift);
-                double sum2 = get_pixel(bayer, r, c - 2, width, height, rawStride, shift) +
-                              get_pixel(bayer, r, c + 2, width, height, rawStride, shift) +
-                              get_pixel(bayer, r - 2, c, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 2, c, width, height, rawStride, shift);
-                G = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * sum1 - sum2);// Calculate adjacent green pixel interpolation
-                double diag = get_pixel(bayer, r - 1, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r - 1, c + 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c + 1, width, height, rawStride, shift);
-                double sumB2 = get_pixel(bayer, r - 2, c, width, height, rawStride, shift) +
-                               get_pixel(bayer, r + 2, c, width, height, rawStride, shift) +
-                               get_pixel(bayer, r, c - 2, width, height, rawStride, shift) +
-                               get_pixel(bayer, r, c + 2, width, height, rawStride, shift);
-                B = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * diag - sumB2);// Calculate adjacent blue pixel interpolation
-            } else if ((r % 2 == 0) && (c % 2 == 1)) { 
-				    B = get_pixel(bayer, r, c, width, height, rawStride, shift);// Blue pixel position
-                double sum1 = get_pixel(bayer, r, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r, c + 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r - 1, c, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c, width, height, rawStride, shift);
-                double sum2 = get_pixel(bayer, r, c - 2, width, height, rawStride, shift) +
-                              get_pixel(bayer, r, c + 2, width, height, rawStride, shift) +
-                              get_pixel(bayer, r - 2, c, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 2, c, width, height, rawStride, shift);
-                G = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * sum1 - sum2);// Calculate green interpolation
-                double diag = get_pixel(bayer, r - 1, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r - 1, c + 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c + 1, width, height, rawStride, shift);
-                double sumR2 = get_pixel(bayer, r - 2, c, width, height, rawStride, shift) +
-                               get_pixel(bayer, r + 2, c, width, height, rawStride, shift) +
-                               get_pixel(bayer, r, c - 2, width, height, rawStride, shift) +
-                               get_pixel(bayer, r, c + 2, width, height, rawStride, shift);
-                R = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * diag - sumR2);// Calculate red interpolation
-            } else if ((r % 2 == 0) && (c % 2 == 0)) { 
-                G = get_pixel(bayer, r, c, width, height, rawStride, shift);// Green pixel (G1) position
-                double sumR = get_pixel(bayer, r - 1, c, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c, width, height, rawStride, shift);
-                double sumB = get_pixel(bayer, r, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r, c + 1, width, height, rawStride, shift);
-                double sumR2 = get_pixel(bayer, r - 2, c, width, height, rawStride, shift) +
-                               get_pixel(bayer, r + 2, c, width, height, rawStride, shift);
-                double sumB2 = get_pixel(bayer, r, c - 2, width, height, rawStride, shift) +
-                               get_pixel(bayer, r, c + 2, width, height, rawStride, shift); 
-                R = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * sumR - sumR2);// Calculate red interpolation
-                B = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * sumB - sumB2);// Calculate blue interpolation
-            } else {
-                G = get_pixel(bayer, r, c, width, height, rawStride, shift);// Another green pixel (G2) position, same as above
-                double sumR = get_pixel(bayer, r, c - 1, width, height, rawStride, shift) +
-                              get_pixel(bayer, r, c + 1, width, height, rawStride, shift);
-                double sumB = get_pixel(bayer, r - 1, c, width, height, rawStride, shift) +
-                              get_pixel(bayer, r + 1, c, width, height, rawStride, shift);
-                double sumR2 = get_pixel(bayer, r, c - 2, width, height, rawStride, shift) +
-                               get_pixel(bayer, r, c + 2, width, height, rawStride, shift);
-                double sumB2 = get_pixel(bayer, r - 2, c, width, height, rawStride, shift) +
-                               get_pixel(bayer, r + 2, c, width, height, rawStride, shift);// Interpolation calculation R and B
-                R = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * sumR - sumR2);
-                B = get_pixel(bayer, r, c, width, height, rawStride, shift) + 0.125 * (2 * sumB - sumB2);
-            }
-            R *= R_gain;
-            G *= G_gain;
-            B *= B_gain;// Apply gain to increase saturation
-            auto clamp_scale = [](double val) -> uint8_t {
-                if (val < 0) val = 0;
-                if (val > 1023) val = 1023;
-                return static_cast<uint8_t>((val * 255 + 511) / 1023);
-            };// Map the range of 0~1023 to 0~255 and round it up
-            int index = (r * width + c) * 3;// Calculate the starting position of the pixel in the RGB one-dimensional array
-            rgb[index]     = clamp_scale(R);
-            rgb[index + 1] = clamp_scale(G);
-            rgb[index + 2] = clamp_scale(B);
-        }
-    }
-    return rgb;
+
+// Use the Malvar demosaicing algorithm to convert the Bayer format straight to YCbCr 4:2:0 planes, in horizontal
+// bands across the pool, padded to whole 16x16 MCUs for jpeg_write_raw_data
+YCbCrPlanes MJPEGServer::demosaic_ycbcr(const uint16_t* bayer, int width, int height, int rawStride, int shift) {
+    const int paddedWidth = (width + 15) / 16 * 16;
+    const int paddedHeight = (height + 15) / 16 * 16;
+    yPlane_.resize(static_cast<size_t>(paddedWidth) * paddedHeight);// Reused from frame to frame
+    cbPlane_.resize(yPlane_.size() / 4);
+    crPlane_.resize(yPlane_.size() / 4);
+    const YCbCrPlanes planes = {yPlane_.data(), cbPlane_.data(), crPlane_.data(), paddedWidth, paddedWidth / 2};
+    demosaic_.process_ycbcr(bayer, width, height, rawStride, shift, planes, demosaicPool_);// Returns once every band is done
+    pad_plane(planes.y, planes.yStride, width, height, paddedHeight);
+    pad_plane(planes.cb, planes.cStride, (width + 1) / 2, (height + 1) / 2, paddedHeight / 2);
+    pad_plane(planes.cr, planes.cStride, (width + 1) / 2, (height + 1) / 2, paddedHeight / 2);
+    return planes;
 }
 
-std::vector<unsigned char> MJPEGServer::encode_jpeg(const libcamera::FrameBuffer* buffer) {// Compress the RGB buffer to JPEG format and return a byte array
+std::vector<unsigned char> MJPEGServer::encode_jpeg(const libcamera::FrameBuffer* buffer) {// Compress the frame to JPEG format and return a byte array
     const auto& planes = buffer->planes();
     const auto& streamConfig = config_->at(0);
     const unsigned int width = streamConfig.size.width;
     const unsigned int height = streamConfig.size.height;
 
-    std::vector<uint8_t> rgbBuffer;// Only supports SGBRG10 / SGBRG16 raw Bayer format
+    YCbCrPlanes ycbcr;// Only supports SGBRG10 / SGBRG16 raw Bayer format
     if (streamConfig.pixelFormat == libcamera::formats::SGBRG10 ||
         streamConfig.pixelFormat == libcamera::formats::SGBRG16) {
         if (planes.size() != 1) {// Make sure there is only one plane, otherwise the logic cannot handle it
@@ -155,7 +75,7 @@ std::vector<unsigned char> MJPEGServer::encode_jpeg(const libcamera::FrameBuffer
         const uint16_t* bayer = reinterpret_cast<const uint16_t*>(data);// reinterpret as 16-bit unsigned
         int rawStride = streamConfig.stride / 2; // Calculate the number of pixels per row (stride is in bytes, divided by 2 to get the number of pixels)
         int shift = (streamConfig.pixelFormat == libcamera::formats::SGBRG16) ? 6 : 0;// If it is a 16-bit format, you need to shift right 6 bits to match the 10-bit precision
-        rgbBuffer = demosaic_malvar(bayer, width, height, rawStride, shift);// De-mosaic, generate RGB buffer
+        ycbcr = demosaic_ycbcr(bayer, width, height, rawStride, shift);// De-mosaic, generate Y, Cb and Cr planes
         munmap(data, planes[0].length);// Unmap the memory
     } else {
         throw std::runtime_error("This example only supports SGBRG10/SGBRG16 raw Bayer format");
@@ -171,16 +91,33 @@ std::vector<unsigned char> MJPEGServer::encode_jpeg(const libcamera::FrameBuffer
     // Configure output image parameters
     cinfo.image_width = width;
     cinfo.image_height = height;
-    cinfo.input_components = 3;//RGB three channels
-    cinfo.in_color_space = JCS_RGB;// Input color space
+    cinfo.input_components = 3;// Y, Cb and Cr
+    cinfo.in_color_space = JCS_YCbCr;// Input color space, already converted
     jpeg_set_defaults(&cinfo);//Default compression settings
     jpeg_set_quality(&cinfo, 80, TRUE);// Quality level 80
+    cinfo.raw_data_in = TRUE;// Take the planes as they are: no color conversion or downsampling in libjpeg
+    cinfo.comp_info[0].h_samp_factor = 2;// 4:2:0, matching the planes
+    cinfo.comp_info[0].v_samp_factor = 2;
+    for (int ci = 1; ci < 3; ci++) {
+        cinfo.comp_info[ci].h_samp_factor = 1;
+        cinfo.comp_info[ci].v_samp_factor = 1;
+    }
+#if JPEG_LIB_VERSION >= 70
+    cinfo.do_fancy_downsampling = FALSE;// Needed for raw data with libjpeg 7 and later
+#endif
     jpeg_start_compress(&cinfo, TRUE);
-    // Write JPEG data line by line
-    JSAMPROW rowPointer[1];
+    // Write JPEG data one MCU row (16 luma rows, 8 chroma rows) at a time
+    JSAMPROW yRows[16], cbRows[8], crRows[8];
+    JSAMPARRAY planeRows[3] = {yRows, cbRows, crRows};
     while (cinfo.next_scanline < cinfo.image_height) {
-        rowPointer[0] = &rgbBuffer[cinfo.next_scanline * width * 3];
-        jpeg_write_scanlines(&cinfo, rowPointer, 1);
+        const unsigned int row = cinfo.next_scanline;
+        for (int i = 0; i < 16; i++)
+            yRows[i] = ycbcr.y + (row + i) * ycbcr.yStride;
+        for (int i = 0; i < 8; i++) {
+            cbRows[i] = ycbcr.cb + (row / 2 + i) * ycbcr.cStride;
+            crRows[i] = ycbcr.cr + (row / 2 + i) * ycbcr.cStride;
+        }
+        jpeg_write_raw_data(&cinfo, planeRows, 16);
     }
     // Complete compression and cleanup
     jpeg_finish_compress(&cinfo);
@@ -196,6 +133,56 @@ std::vector<unsigned char> MJPEGServer::encode_jpeg(const libcamera::FrameBuffer
 
 
 
+//------------------------------------------------------------------------------
+// Capture Methods
+
+// Capture/encode stage: the only consumer of completed requests. Each one is encoded once and published as the
+// latest frame; if requests piled up while encoding, the older ones are requeued unencoded so clients never lag.
+void MJPEGServer::capture_loop() {
+    while (running_.load()) {
+        std::vector<libcamera::Request*> ready;
+        {
+            std::unique_lock<std::mutex> lock(completedMutex_);
+            completedCV_.wait(lock, [this] { return !completed_.empty() || !running_.load(); });
+            ready.assign(completed_.begin(), completed_.end());// Oldest first
+            completed_.clear();
+        }
+        if (ready.empty())
+            continue;
+        for (size_t i = 0; i + 1 < ready.size(); i++)
+            requeue(ready[i]);// Superseded before it could be encoded
+        libcamera::Request* request = ready.back();
+        try {
+            const libcamera::FrameBuffer* frameBuffer = request->buffers().begin()->second;
+            auto frame = std::make_shared<JpegFrame>();
+            frame->sequence = frameBuffer->metadata().sequence;
+            frame->timestamp = frameBuffer->metadata().timestamp;
+            frame->jpeg = encode_jpeg(frameBuffer);// Encode frame data as JPEG
+            {
+                std::lock_guard<std::mutex> lock(frameMutex_);
+                latestFrame_ = std::move(frame);
+            }
+            frameCV_.notify_all();// Wake every client
+        } catch (const std::exception& e) {
+            std::cerr << "Processing error: " << e.what() << std::endl;
+        }
+        requeue(request);
+    }
+}
+
+void MJPEGServer::requeue(libcamera::Request* request) {
+    if (!running_.load())
+        return;
+    request->reuse(libcamera::Request::ReuseFlag::ReuseBuffers);// Reuse the buffer for the next capture
+    if (camera_->queueRequest(request) < 0)
+        std::cerr << "Requeue failed" << std::endl;
+}
+
+std::shared_ptr<const JpegFrame> MJPEGServer::latest_frame() const {
+    std::lock_guard<std::mutex> lock(frameMutex_);
+    return latestFrame_;
+}
+
 //------------------------------------------------------------------------------
 // Server Methods
 
@@ -211,54 +198,42 @@ void MJPEGServer::handle_client(tcp::socket socket) {
             return;
         }
         auto last_frame = std::chrono::steady_clock::now();// Last frame sent time, used to limit the frame rate (about 30 FPS)
+        std::shared_ptr<const JpegFrame> sent;// Last frame sent, so a slow client skips frames instead of repeating them
         while (socket.is_open() && running_.load()) {// Loop to send each frame
-            std::unique_lock<std::mutex> lock(cameraMutex_);
             auto now = std::chrono::steady_clock::now();// Control frame rate: minimum interval 33ms
             auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_frame);
             if (elapsed < std::chrono::milliseconds(33))
                 std::this_thread::sleep_for(std::chrono::milliseconds(33) - elapsed);
-            last_frame = now;
-            bool frame_ready = requestCV_.wait_for(lock, std::chrono::seconds(1), [&] {// Wait for a new frame to be ready or timeout
-                return std::any_of(requests_.begin(), requests_.end(), [](const auto& req) {// Check if any request is completed
-                    return req->status() == libcamera::Request::RequestComplete;
+            last_frame = std::chrono::steady_clock::now();
+            std::shared_ptr<const JpegFrame> frame;
+            {
+                std::unique_lock<std::mutex> lock(frameMutex_);
+                frameCV_.wait_for(lock, std::chrono::seconds(1), [&] {// Wait for a new frame to be ready or timeout
+                    return !running_.load() || (latestFrame_ && latestFrame_ != sent);
                 });
-            });
-            if (!frame_ready)
-                continue;
+                frame = latestFrame_;
+            }
             // Run flag check
             if (!running_.load())
                 break;
-            for (auto& request : requests_) {// Traverse all completed requests, encode and send
-                if (request->status() != libcamera::Request::RequestComplete)
-                    continue;
-                if (!socket.is_open())
-                    break;
-                try {
-                    auto jpeg_buffer = encode_jpeg(request->buffers().begin()->second);// Encode frame data as JPEG
-                    std::string part_header = // Construct segment header
-                        "--frame\r\n"
-                        "Content-Type: image/jpeg\r\n"
-                        "Content-Length: " + std::to_string(jpeg_buffer.size()) + "\r\n\r\n";
-                    std::vector<const_buffer> buffers;// Aggregate header and image data
-                    buffers.push_back(buffer(part_header));
-                    buffers.push_back(buffer(jpeg_buffer));
-                    buffers.push_back(buffer("\r\n"));
-                    write(socket, buffers, ec);// Asynchronous write
-                    if (ec) {
-                        std::cerr << "Write error: " << ec.message() << std::endl;
-                        socket.close();
-                        break;
-                    }
-                    request->reuse(libcamera::Request::ReuseFlag::ReuseBuffers);// Reuse the buffer and continue with the next request
-                    if (camera_->queueRequest(request.get()) < 0)
-                        throw std::runtime_error("Requeue failed");
-                } catch (const std::exception& e) {
-                    std::cerr << "Processing error: " << e.what() << std::endl;
-                    try {// When an error occurs, try to requeue the request
-                        request->reuse(libcamera::Request::ReuseFlag::ReuseBuffers);
-                        camera_->queueRequest(request.get());
-                    } catch (...) {}
-                }
+            if (!frame || frame == sent)
+                continue;
+            sent = frame;
+            std::string part_header = // Construct segment header
+                "--frame\r\n"
+                "Content-Type: image/jpeg\r\n"
+                "Content-Length: " + std::to_string(frame->jpeg.size()) + "\r\n"
+                "X-Frame-Sequence: " + std::to_string(frame->sequence) + "\r\n"
+                "X-Timestamp-Ns: " + std::to_string(frame->timestamp) + "\r\n\r\n";
+            std::vector<const_buffer> buffers;// Aggregate header and image data; the frame is shared, not copied
+            buffers.push_back(buffer(part_header));
+            buffers.push_back(buffer(frame->jpeg));
+            buffers.push_back(buffer("\r\n", 2));
+            write(socket, buffers, ec);
+            if (ec) {
+                std::cerr << "Write error: " << ec.message() << std::endl;
+                socket.close();
+                break;
             }
         }
     } catch (const std::exception& e) {
@@ -326,6 +301,15 @@ bool MJPEGServer::init_camera() {
                 requests_.push_back(std::move(request));
             }
         }
+        camera_->requestCompleted.connect(camera_.get(), [this](libcamera::Request* request) {// Hand each completed request to the capture thread
+            if (request->status() != libcamera::Request::RequestComplete)
+                return;// Cancelled when the camera stops
+            {
+                std::lock_guard<std::mutex> lock(completedMutex_);
+                completed_.push_back(request);
+            }
+            completedCV_.notify_one();
+        });
         if (camera_->start() || requests_.empty()) {// Start the camera, if it fails or there is no request, return false
             std::cerr << "Camera startup failed" << std::endl;
             return false;
@@ -333,9 +317,6 @@ bool MJPEGServer::init_camera() {
          for (auto& request : requests_) {// Put all requests into the shooting queue
             camera_->queueRequest(request.get());
         }
-        camera_->requestCompleted.connect(camera_.get(), [this](libcamera::Request* request) {//When each request is completed, notify the waiting thread
-            requestCV_.notify_all();
-        });
     }
     return true;
 }
@@ -363,6 +344,7 @@ bool MJPEGServer::start() {
     if (!init_camera())// Initialize the camera and return false if failed
         return false;
     running_.store(true);// Flag set to run
+    captureThread_ = std::thread(&MJPEGServer::capture_loop, this);// Encode frames once for all clients
     // Start the server thread which will run the asynchronous accept loop.
     serverThread_ = std::thread(&MJPEGServer::run_server, this);
     return true;
@@ -402,4 +384,14 @@ void MJPEGServer::stop() {
     io_.stop();// Stop io_context
     if (serverThread_.joinable())// Wait for the server thread to exit
         serverThread_.join();
+    {
+        std::lock_guard<std::mutex> lock(completedMutex_);// Wake the capture thread and any waiting client
+    }
+    completedCV_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(frameMutex_);
+    }
+    frameCV_.notify_all();
+    if (captureThread_.joinable())
+        captureThread_.join();
 }
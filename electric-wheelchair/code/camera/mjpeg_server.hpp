@@ -5,6 +5,7 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <cstdint>
@@ -14,6 +15,17 @@
 #include <libcamera/libcamera.h>
 #include <jpeglib.h>
 
+#include "bayer_demosaic.hpp"
+#include "worker_pool.hpp"
+
+// One encoded camera frame. Built once by the capture thread and shared,
+// read-only, by every client that sends it.
+struct JpegFrame {
+    uint32_t sequence;   // Sensor frame sequence number
+    uint64_t timestamp;  // Sensor timestamp, ns
+    std::vector<unsigned char> jpeg;
+};
+
 class MJPEGServer {
 public:
     // Constructor: port defaults to 8080.
@@ -28,6 +40,9 @@ public:
     // Static signal handler for SIGINT (Ctrl+C).
     static void signal_handler(int signal);
 
+    // Most recently encoded frame, or nullptr before the first one.
+    std::shared_ptr<const JpegFrame> latest_frame() const;
+
 private:
     // Global pointer to the running instance (for signal handling).
     //static MJPEGServer* instance_;
@@ -41,7 +56,16 @@ private:
     std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
     std::vector<std::unique_ptr<libcamera::Request>> requests_;
     std::mutex cameraMutex_;
-    std::condition_variable requestCV_;
+
+    // Capture/encode stage: completed requests in completion order, turned
+    // into JPEG frames by one thread whatever the number of clients.
+    std::deque<libcamera::Request*> completed_;
+    std::mutex completedMutex_;
+    std::condition_variable completedCV_;
+    std::thread captureThread_;
+    std::shared_ptr<const JpegFrame> latestFrame_;  // Broadcast to every client
+    mutable std::mutex frameMutex_;
+    std::condition_variable frameCV_;
 
     // Boost.Asio server members.
     boost::asio::io_context io_;
@@ -52,14 +76,20 @@ private:
     // Helper method to start asynchronous accept.
     void start_accept();
 
+    // Capture methods.
+    void capture_loop();
+    void requeue(libcamera::Request* request);
+
     // Server methods.
     void run_server();
     void handle_client(boost::asio::ip::tcp::socket socket);
 
     // Image processing helper functions.
-    uint16_t get_pixel(const uint16_t* bayer, int r, int c, int width, int height, int rawStride, int shift);
-    std::vector<uint8_t> demosaic_malvar(const uint16_t* bayer, int width, int height, int rawStride, int shift);
+    YCbCrPlanes demosaic_ycbcr(const uint16_t* bayer, int width, int height, int rawStride, int shift);
     std::vector<unsigned char> encode_jpeg(const libcamera::FrameBuffer* buffer);
+    BayerDemosaic demosaic_;  // Fixed-point demosaic with the channel gains built in
+    WorkerPool demosaicPool_;  // One thread per available core
+    std::vector<uint8_t> yPlane_, cbPlane_, crPlane_;  // 4:2:0 planes for the encoder, capture thread only
 
     // Camera initialization.
     bool init_camera();
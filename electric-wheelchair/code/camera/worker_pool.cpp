@@ -0,0 +1,85 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <sched.h>
+
+WorkerPool::WorkerPool(int threads) {
+    for (int i = 1; i < threads; i++) {
+        workers_.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    startCV_.notify_all();
+    for (std::thread& worker : workers_) worker.join();
+}
+
+int WorkerPool::available_cores() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        return std::max(CPU_COUNT(&set), 1);
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+void WorkerPool::run(int count, const std::function<void(int)>& task) {
+    std::lock_guard<std::mutex> runLock(runMutex_);
+    if (count <= 0)
+        return;
+    if (workers_.empty() || count == 1) {// Nothing to hand out
+        for (int i = 0; i < count; i++) task(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        count_ = count;
+        next_.store(0);
+        error_ = nullptr;
+        busy_ = static_cast<int>(workers_.size());
+        generation_++;
+    }
+    startCV_.notify_all();
+    run_tasks();
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCV_.wait(lock, [this] { return busy_ == 0; });
+        task_ = nullptr;
+        std::swap(error, error_);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void WorkerPool::worker_loop() {
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            startCV_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_)
+                return;
+            seen = generation_;
+        }
+        run_tasks();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0)
+            doneCV_.notify_one();
+    }
+}
+
+void WorkerPool::run_tasks() {
+    for (int i = next_.fetch_add(1); i < count_; i = next_.fetch_add(1)) {
+        try {
+            (*task_)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+        }
+    }
+}
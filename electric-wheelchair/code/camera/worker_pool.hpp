@@ -0,0 +1,54 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for splitting one frame's work into tasks.
+// run() hands task indices out to the workers and the calling thread and
+// returns once every task has finished, so the threads are created once
+// instead of per frame. Calls from several threads are served one at a time.
+class WorkerPool {
+public:
+    // threads counts the calling thread, so WorkerPool(1) starts no workers
+    explicit WorkerPool(int threads = available_cores());
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Threads taking part in run(), the caller included
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    // Calls task(0) .. task(count - 1), each once and in any order across the
+    // threads. The first exception a task throws is rethrown here after the
+    // others have finished.
+    void run(int count, const std::function<void(int)>& task);
+
+    // CPUs this process may run on (its affinity mask), at least 1
+    static int available_cores();
+
+private:
+    void worker_loop();
+    void run_tasks();
+
+    std::vector<std::thread> workers_;
+    std::mutex runMutex_;  // One run() at a time
+    std::mutex mutex_;
+    std::condition_variable startCV_;
+    std::condition_variable doneCV_;
+    const std::function<void(int)>* task_ = nullptr;
+    int count_ = 0;
+    unsigned generation_ = 0;  // Bumped per run() to wake the workers
+    int busy_ = 0;             // Workers still inside the current run()
+    std::atomic<int> next_{0};  // Next task index to hand out
+    std::exception_ptr error_;
+    bool stopping_ = false;
+};
+
+#endif // WORKER_POOL_HPP
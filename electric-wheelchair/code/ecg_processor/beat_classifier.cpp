@@ -0,0 +1,341 @@
+#include "beat_classifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include "simd_double.hpp"
+
+namespace {
+std::size_t next_power_of_two(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+constexpr double ENTROPY_BIN_MS = 25.0;        // RR histogram bin width
+constexpr std::size_t ENTROPY_BINS = 16;        // Occupied bins that score an entropy of 1
+constexpr std::size_t ENTROPY_TRIM = 2;         // Shortest and longest intervals left out of the histogram
+constexpr double TEMPLATE_WEIGHT_DECAY = 1.0 / 64;  // Dominance follows roughly the last 64 beats
+constexpr uint64_t TEMPLATE_MAX_AVERAGE = 16;   // Template learning rate settles at 1/16
+constexpr std::size_t RATE_CHANGE_BEATS = 4;    // Early or long beats in a row that reset the reference RR
+constexpr double PAUSE_RATIO = 1.3;             // Longer intervals (pauses, missed beats) leave the reference alone
+constexpr int HISTORY_SECONDS = 4;              // Longest detection delay (search-back) covered
+}
+
+BeatClassifier::BeatClassifier(int sample_rate, uint64_t input_delay)
+    : sample_rate(sample_rate),
+      input_delay(input_delay),
+      before(static_cast<std::size_t>(sample_rate) * BEAT_WINDOW_BEFORE_MS / 1000),
+      window(before + static_cast<std::size_t>(sample_rate) * BEAT_WINDOW_AFTER_MS / 1000),
+      align(static_cast<std::size_t>(sample_rate) * BEAT_ALIGN_MS / 1000),
+      history(next_power_of_two(static_cast<std::size_t>(sample_rate) * HISTORY_SECONDS + window + 2 * align)),
+      history_mask(history.size() - 1),
+      segment(window + 2 * align),
+      prefix(segment.size() + 1),
+      prefix_squares(segment.size() + 1),
+      templates(BEAT_TEMPLATES)
+{
+    for (Template& t : templates) t.shape.resize(window);
+    reset();
+}
+
+void BeatClassifier::reset() {
+    std::fill(history.begin(), history.end(), 0.0);
+    samples_seen = 0;
+    pending_count = 0;
+    for (Template& t : templates) {
+        std::fill(t.shape.begin(), t.shape.end(), 0.0);
+        t.norm = 0.0;
+        t.count = 0;
+        t.weight = 0.0;
+    }
+    have_last_beat = false;
+    last_beat = 0;
+    rhythm_break = false;
+    break_index = 0;
+    last_premature = false;
+    last_ectopic = false;
+    rr_reference = 0.0;
+    early_run = 0;
+    long_run = 0;
+    rr_window.fill(0.0);
+    rr_pos = 0;
+    rr_count = 0;
+    irregularity = 0.0;
+    rr_entropy = 0.0;
+    counters = RhythmStatus{};
+    publish();
+}
+
+void BeatClassifier::restart_rhythm(uint64_t sample_index) {
+    // Beats still waiting for their window came before the gap and keep their RR
+    rhythm_break = true;
+    break_index = sample_index;
+    early_run = 0;
+    long_run = 0;
+    rr_window.fill(0.0);
+    rr_pos = 0;
+    rr_count = 0;
+    irregularity = 0.0;
+    rr_entropy = 0.0;
+    publish();
+}
+
+void BeatClassifier::set_callback(std::function<void(const BeatInfo&)> callback) {
+    beat_callback = std::move(callback);
+}
+
+RhythmStatus BeatClassifier::status() const {
+    return published.load();
+}
+
+void BeatClassifier::add_samples(const double* samples, std::size_t count, std::size_t stride) {
+    for (std::size_t i = 0; i < count; ++i) {
+        history[samples_seen++ & history_mask] = samples[i * stride];
+    }
+    classify_ready();
+}
+
+void BeatClassifier::add_beat(uint64_t sample_index) {
+    if (pending_count == pending.size()) {
+        // Cannot happen at physiological rates; classify the oldest on timing alone
+        classify(pending[0]);
+        std::copy(pending.begin() + 1, pending.end(), pending.begin());
+        --pending_count;
+    }
+    pending[pending_count++] = sample_index;
+    classify_ready();
+}
+
+// Classify every pending beat whose window (plus alignment margin) has arrived
+void BeatClassifier::classify_ready() {
+    std::size_t done = 0;
+    while (done < pending_count && pending[done] + (window - before) + align <= samples_seen) {
+        classify(pending[done++]);
+    }
+    if (done == 0) return;
+    std::copy(pending.begin() + done, pending.begin() + pending_count, pending.begin());
+    pending_count -= done;
+}
+
+void BeatClassifier::classify(uint64_t r_index) {
+    BeatInfo info{r_index > input_delay ? r_index - input_delay : 0, BeatType::Learning, false, 0.0, 0.0};
+    if (rhythm_break && r_index >= break_index) {
+        rhythm_break = false;
+        have_last_beat = false;
+        last_premature = false;
+        last_ectopic = false;
+    }
+    if (have_last_beat && r_index > last_beat) {
+        info.rr_ms = (r_index - last_beat) * 1000.0 / sample_rate;
+    }
+    info.premature = rr_reference > 0.0 && info.rr_ms > 0.0 && info.rr_ms < BEAT_PREMATURE_RATIO * rr_reference;
+
+    // The window must have arrived and must not have been overwritten yet
+    const bool have_shape = r_index >= before + align &&
+                            r_index + (window - before) + align <= samples_seen &&
+                            samples_seen - (r_index - before - align) <= history.size();
+    bool ectopic = false;
+    if (have_shape) {
+        const uint64_t first = r_index - before - align;
+        for (std::size_t i = 0; i < segment.size(); ++i) {
+            const double x = history[(first + i) & history_mask];
+            segment[i] = x;
+            prefix[i + 1] = prefix[i] + x;
+            prefix_squares[i + 1] = prefix_squares[i] + x * x;
+        }
+
+        std::array<double, BEAT_TEMPLATES> ncc;
+        std::array<std::size_t, BEAT_TEMPLATES> shift;
+        match(ncc, shift);
+        const std::size_t previous_dominant = dominant();
+        std::size_t best = BEAT_TEMPLATES;
+        for (std::size_t t = 0; t < BEAT_TEMPLATES; ++t) {
+            if (templates[t].count > 0 && (best == BEAT_TEMPLATES || ncc[t] > ncc[best])) best = t;
+        }
+
+        for (Template& t : templates) t.weight *= 1.0 - TEMPLATE_WEIGHT_DECAY;
+        if (best < BEAT_TEMPLATES && ncc[best] >= BEAT_MATCH_CORRELATION) {
+            update_template(templates[best], shift[best]);
+        } else {
+            // New morphology: take a free slot, else the weakest non-dominant template
+            best = BEAT_TEMPLATES;
+            for (std::size_t t = 0; t < BEAT_TEMPLATES && best == BEAT_TEMPLATES; ++t) {
+                if (templates[t].count == 0) best = t;
+            }
+            for (std::size_t t = 0; t < BEAT_TEMPLATES && best == BEAT_TEMPLATES; ++t) {
+                if (t != previous_dominant) best = t;
+            }
+            for (std::size_t t = 0; t < BEAT_TEMPLATES; ++t) {
+                if (t != previous_dominant && templates[t].count > 0 && templates[t].weight < templates[best].weight) {
+                    best = t;
+                }
+            }
+            templates[best].count = 0;
+            templates[best].weight = 0.0;
+            update_template(templates[best], align);
+            ncc[best] = 1.0;
+        }
+        const std::size_t dom = dominant();
+        info.correlation = ncc[dom];
+        ectopic = best != dom;
+    }
+
+    if (counters.beats >= BEAT_LEARNING_BEATS) {
+        if (ectopic) {
+            info.type = BeatType::Ectopic;
+            ++counters.ectopic;
+        } else if (info.premature) {
+            info.type = BeatType::Premature;
+            ++counters.premature;
+        } else {
+            info.type = BeatType::Normal;
+            ++counters.normal;
+        }
+    }
+
+    // Reference RR: on-time beats of dominant shape, not right after an early or
+    // ectopic beat (compensatory pause) nor after a pause. A run of early or of
+    // long normal beats is a rate change.
+    const bool pause = rr_reference > 0.0 && info.rr_ms >= PAUSE_RATIO * rr_reference;
+    if (info.rr_ms > 0.0 && counters.beats >= BEAT_LEARNING_BEATS) {
+        if (info.type == BeatType::Normal) {
+            early_run = 0;
+            if (!pause) {
+                long_run = 0;
+                if (!last_premature && !last_ectopic) rr_reference += 0.25 * (info.rr_ms - rr_reference);
+            } else if (++long_run >= RATE_CHANGE_BEATS) {
+                rr_reference = info.rr_ms;
+                long_run = 0;
+            }
+        } else if (info.type == BeatType::Premature) {
+            long_run = 0;
+            if (++early_run >= RATE_CHANGE_BEATS) {
+                rr_reference = info.rr_ms;
+                early_run = 0;
+            }
+        } else {
+            early_run = 0;
+            long_run = 0;
+        }
+    }
+    // Intervals touching an ectopic beat say nothing about the underlying
+    // rhythm, and a pause or missed beat is not an irregular one
+    if (info.rr_ms > 0.0 && !ectopic && !last_ectopic && !pause) update_rhythm(info.rr_ms);
+
+    ++counters.beats;
+    if (counters.beats == BEAT_LEARNING_BEATS && rr_count > 0) rr_reference = rr_median();
+    counters.last_type = info.type;
+    counters.last_correlation = info.correlation;
+    have_last_beat = true;
+    last_beat = r_index;
+    last_premature = info.premature;
+    last_ectopic = ectopic;
+    publish();
+    if (beat_callback) beat_callback(info);
+}
+
+// Best normalised cross-correlation of the segment with each template, over
+// every alignment shift. Templates are zero mean, so the segment mean drops out
+// of the dot product and only its variance is needed.
+void BeatClassifier::match(std::array<double, BEAT_TEMPLATES>& ncc,
+                           std::array<std::size_t, BEAT_TEMPLATES>& shift) const {
+    for (std::size_t t = 0; t < BEAT_TEMPLATES; ++t) {
+        ncc[t] = -1.0;
+        shift[t] = align;
+        if (templates[t].count == 0) continue;
+        for (std::size_t s = 0; s <= 2 * align; ++s) {
+            const double c = correlation(templates[t], s);
+            if (c > ncc[t]) {
+                ncc[t] = c;
+                shift[t] = s;
+            }
+        }
+    }
+}
+
+double BeatClassifier::correlation(const Template& t, std::size_t shift) const {
+    const double n = static_cast<double>(window);
+    const double sum = prefix[shift + window] - prefix[shift];
+    const double variance = prefix_squares[shift + window] - prefix_squares[shift] - sum * sum / n;
+    if (variance <= 0.0 || t.norm <= 0.0) return 0.0;
+    return simd::dot(t.shape.data(), segment.data() + shift, window) / (t.norm * std::sqrt(variance));
+}
+
+// Running average of the aligned, zero-mean windows
+void BeatClassifier::update_template(Template& t, std::size_t shift) {
+    const double mean = (prefix[shift + window] - prefix[shift]) / window;
+    t.count = std::min(t.count + 1, TEMPLATE_MAX_AVERAGE);
+    const double rate = 1.0 / t.count;
+    const double* x = segment.data() + shift;
+    double norm = 0.0;
+    for (std::size_t i = 0; i < window; ++i) {
+        t.shape[i] += rate * (x[i] - mean - t.shape[i]);
+        norm += t.shape[i] * t.shape[i];
+    }
+    t.norm = std::sqrt(norm);
+    t.weight += 1.0;
+}
+
+// Template carrying most of the recent beats
+std::size_t BeatClassifier::dominant() const {
+    std::size_t best = 0;
+    for (std::size_t t = 1; t < BEAT_TEMPLATES; ++t) {
+        if (templates[t].weight > templates[best].weight) best = t;
+    }
+    return best;
+}
+
+// Normalised RMSSD and RR histogram entropy over the recent intervals
+void BeatClassifier::update_rhythm(double rr_ms) {
+    rr_window[rr_pos] = rr_ms;
+    rr_pos = (rr_pos + 1) % RHYTHM_WINDOW_BEATS;
+    rr_count = std::min(rr_count + 1, RHYTHM_WINDOW_BEATS);
+    if (rr_count < 2) return;
+
+    const std::size_t oldest = (rr_pos + RHYTHM_WINDOW_BEATS - rr_count) % RHYTHM_WINDOW_BEATS;
+    double sum = 0.0;
+    double diff_squares = 0.0;
+    double previous = rr_window[oldest];
+    std::array<double, RHYTHM_WINDOW_BEATS> sorted;
+    for (std::size_t i = 0; i < rr_count; ++i) {
+        const double rr = rr_window[(oldest + i) % RHYTHM_WINDOW_BEATS];
+        sum += rr;
+        diff_squares += (rr - previous) * (rr - previous);
+        previous = rr;
+        sorted[i] = rr;
+    }
+    irregularity = std::sqrt(diff_squares / (rr_count - 1)) / (sum / rr_count);
+
+    // Histogram in fixed ENTROPY_BIN_MS bins, so beat-to-beat jitter of a
+    // regular rhythm stays in one or two bins however small it is. Sorted
+    // intervals fill each bin in one run.
+    std::sort(sorted.begin(), sorted.begin() + rr_count);
+    const std::size_t trim = rr_count > 4 * ENTROPY_TRIM ? ENTROPY_TRIM : 0;
+    const double total = static_cast<double>(rr_count - 2 * trim);
+    double entropy = 0.0;
+    for (std::size_t i = trim; i < rr_count - trim; ) {
+        const double bin = std::floor(sorted[i] / ENTROPY_BIN_MS);
+        std::size_t run = 0;
+        while (i < rr_count - trim && std::floor(sorted[i] / ENTROPY_BIN_MS) == bin) {
+            ++run;
+            ++i;
+        }
+        const double p = run / total;
+        entropy -= p * std::log(p);
+    }
+    rr_entropy = std::min(entropy / std::log(static_cast<double>(ENTROPY_BINS)), 1.0);
+}
+
+double BeatClassifier::rr_median() const {
+    std::array<double, RHYTHM_WINDOW_BEATS> sorted;
+    std::copy(rr_window.begin(), rr_window.begin() + rr_count, sorted.begin());
+    std::sort(sorted.begin(), sorted.begin() + rr_count);
+    return sorted[rr_count / 2];
+}
+
+void BeatClassifier::publish() {
+    counters.irregularity = irregularity;
+    counters.rr_entropy = rr_entropy;
+    counters.af_like = rr_count >= RHYTHM_WINDOW_BEATS / 2 &&
+                       irregularity > AF_MIN_IRREGULARITY && rr_entropy > AF_MIN_ENTROPY;
+    published.store(counters);
+}
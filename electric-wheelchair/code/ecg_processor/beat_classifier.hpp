@@ -0,0 +1,147 @@
+#ifndef BEAT_CLASSIFIER_HPP
+#define BEAT_CLASSIFIER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "seqlock.hpp"
+
+constexpr int BEAT_WINDOW_BEFORE_MS = 100;        // Beat window before the R peak
+constexpr int BEAT_WINDOW_AFTER_MS = 150;         // and after it
+constexpr int BEAT_ALIGN_MS = 10;                 // Template alignment search, +/-
+constexpr std::size_t BEAT_TEMPLATES = 4;         // Morphology clusters kept
+constexpr std::size_t BEAT_LEARNING_BEATS = 8;    // Beats used to learn the dominant template and RR
+constexpr double BEAT_MATCH_CORRELATION = 0.85;   // Least correlation for a beat to join a template
+constexpr double BEAT_PREMATURE_RATIO = 0.85;     // RR below this fraction of the reference is premature
+constexpr std::size_t RHYTHM_WINDOW_BEATS = 32;   // RR intervals in the irregularity index
+constexpr double AF_MIN_IRREGULARITY = 0.1;       // Normalised RMSSD above which the rhythm may be AF
+constexpr double AF_MIN_ENTROPY = 0.7;            // and normalised RR entropy
+
+enum class BeatType : uint8_t {
+    Learning,   // Still building the templates
+    Normal,     // Dominant morphology, on time
+    Premature,  // Dominant morphology, early (supraventricular-like)
+    Ectopic     // Morphology that does not match the dominant template
+};
+
+// One classified beat
+struct BeatInfo {
+    uint64_t sample_index;  // R peak, in the unfiltered signal
+    BeatType type;
+    bool premature;         // RR below BEAT_PREMATURE_RATIO of the reference, whatever the shape
+    double correlation;     // Normalised cross-correlation with the dominant template
+    double rr_ms;           // Interval from the previous beat, 0 for the first
+};
+
+// Beat mix and rhythm over the recent beats
+struct RhythmStatus {
+    uint64_t beats;       // Beats classified so far (learning beats included)
+    uint64_t normal;
+    uint64_t premature;
+    uint64_t ectopic;
+    double irregularity;  // RMSSD / mean RR over the last RHYTHM_WINDOW_BEATS intervals
+    double rr_entropy;    // Shannon entropy of their fixed-width histogram, 0..1
+    bool af_like;         // Both above the AF thresholds
+    BeatType last_type;
+    double last_correlation;
+};
+
+// Morphology and timing classification of detected beats.
+// The classifier keeps its own history of the filtered signal. For each R
+// peak it cuts a window of BEAT_WINDOW_BEFORE_MS + BEAT_WINDOW_AFTER_MS around
+// it once the samples after the peak have arrived, and scores it against up to
+// BEAT_TEMPLATES running-average templates with a normalised cross-correlation
+// over +/-BEAT_ALIGN_MS shifts. The template matched by most recent beats is
+// the dominant (normal) morphology; a beat that matches no template starts a
+// new one in place of the least used.
+// Timing is judged against a reference RR averaged over on-time beats, and the
+// rhythm irregularity uses normalised RMSSD and RR entropy (as used for AF
+// screening) over the recent intervals, leaving out pauses and missed beats.
+// Work per beat is bounded by (2 * align + 1) * BEAT_TEMPLATES dot products of
+// one window, computed with SIMD, plus a sort of RHYTHM_WINDOW_BEATS
+// intervals; nothing allocates after construction.
+// Single producer: add_samples() and add_beat() are called from one thread.
+class BeatClassifier {
+public:
+    // input_delay: samples by which the filtered input lags the raw signal;
+    // taken off the positions reported in BeatInfo
+    explicit BeatClassifier(int sample_rate, uint64_t input_delay = 0);
+
+    // Append filtered samples, stride values apart (one lead of interleaved frames)
+    void add_samples(const double* samples, std::size_t count, std::size_t stride = 1);
+    // Register an R peak of the filtered input; it is classified as soon as its window is complete.
+    // Beats must arrive in increasing order.
+    void add_beat(uint64_t sample_index);
+    // Called for every classified beat, on the thread feeding the classifier
+    void set_callback(std::function<void(const BeatInfo&)> callback);
+    // Forget templates, RR history and signal history
+    void reset();
+    // Beat detection stopped at sample_index (e.g. an electrode came off): the
+    // rhythm window starts over, and the first beat from sample_index on gets
+    // no RR interval. Templates and the reference RR are kept.
+    void restart_rhythm(uint64_t sample_index);
+
+    // Lock-free snapshot, safe from any thread
+    RhythmStatus status() const;
+
+    // Samples in one beat window
+    std::size_t window_length() const { return window; }
+
+private:
+    struct Template {
+        std::vector<double> shape;  // Zero-mean running average
+        double norm;                // Euclidean norm of shape
+        uint64_t count;             // Beats merged in, capped (sets the averaging rate)
+        double weight;              // Decaying count of recent matches
+    };
+
+    void classify_ready();
+    void classify(uint64_t r_index);
+    void match(std::array<double, BEAT_TEMPLATES>& ncc, std::array<std::size_t, BEAT_TEMPLATES>& shift) const;
+    double correlation(const Template& t, std::size_t shift) const;
+    void update_template(Template& t, std::size_t shift);
+    void update_rhythm(double rr_ms);
+    double rr_median() const;
+    std::size_t dominant() const;
+    void publish();
+
+    const int sample_rate;
+    const uint64_t input_delay;
+    const std::size_t before;  // Samples before the R peak
+    const std::size_t window;  // Samples per beat window
+    const std::size_t align;   // Shift search, +/- samples
+    std::vector<double> history;  // Ring of filtered samples, power of two
+    std::size_t history_mask;
+    uint64_t samples_seen;
+
+    std::array<uint64_t, 4> pending;  // R peaks waiting for their window
+    std::size_t pending_count;
+
+    std::vector<double> segment;  // Window plus alignment margin, copied out of the ring
+    std::vector<double> prefix;   // Prefix sums of segment and of its squares
+    std::vector<double> prefix_squares;
+    std::vector<Template> templates;
+
+    bool have_last_beat;
+    uint64_t last_beat;
+    bool rhythm_break;     // Beats from break_index on do not follow last_beat
+    uint64_t break_index;
+    bool last_premature;
+    bool last_ectopic;
+    double rr_reference;  // ms, 0 until learned
+    std::size_t early_run;  // Consecutive premature beats of dominant shape
+    std::size_t long_run;   // Consecutive normal beats after a pause-length interval
+    std::array<double, RHYTHM_WINDOW_BEATS> rr_window;
+    std::size_t rr_pos;
+    std::size_t rr_count;
+    double irregularity;
+    double rr_entropy;
+
+    std::function<void(const BeatInfo&)> beat_callback;
+    RhythmStatus counters;
+    SeqLock<RhythmStatus> published;
+};
+
+#endif // BEAT_CLASSIFIER_HPP
@@ -0,0 +1,73 @@
+#include "decimator.hpp"
+#include "simd_double.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+PolyphaseDecimator::PolyphaseDecimator(std::size_t ratio, std::size_t leads)
+    : decimation(ratio), lead_count(leads)
+{
+    if (ratio == 0 || ratio > DECIMATOR_MAX_RATIO) {
+        throw std::invalid_argument("Decimation ratio must be 1 to " + std::to_string(DECIMATOR_MAX_RATIO));
+    }
+    if (leads == 0 || leads > DECIMATOR_MAX_LEADS) {
+        throw std::invalid_argument("Decimator supports 1 to " + std::to_string(DECIMATOR_MAX_LEADS) + " leads");
+    }
+
+    if (ratio == 1) {
+        coefficients.assign(1, 1.0);
+    } else {
+        // Windowed sinc, cutoff in cycles per input sample
+        const std::size_t n = DECIMATOR_TAPS_PER_PHASE * ratio;
+        const double cutoff = DECIMATOR_CUTOFF / ratio;
+        const double centre = (n - 1) / 2.0;
+        coefficients.resize(n);
+        double sum = 0.0;
+        for (std::size_t k = 0; k < n; ++k) {
+            if (k >= n / 2) {
+                coefficients[k] = coefficients[n - 1 - k];  // Exactly symmetric: linear phase
+            } else {
+                const double t = k - centre;
+                const double window = 0.54 - 0.46 * std::cos(2.0 * M_PI * k / (n - 1));
+                coefficients[k] = std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t) * window;
+            }
+            sum += coefficients[k];
+        }
+        for (double& c : coefficients) c /= sum;
+    }
+    history.resize(2 * coefficients.size() * leads);
+    reset();
+}
+
+void PolyphaseDecimator::reset() {
+    std::fill(history.begin(), history.end(), 0.0);
+    position = 0;
+    phase = 0;
+    output_count = 0;
+}
+
+std::size_t PolyphaseDecimator::process(const double* frames, std::size_t count, std::size_t stride, double* out) {
+    if (stride == 0) stride = lead_count;
+    const std::size_t n = coefficients.size();
+    std::size_t produced = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const double* frame = frames + i * stride;
+        for (std::size_t lead = 0; lead < lead_count; ++lead) {
+            double* h = history.data() + lead * 2 * n;
+            h[position] = frame[lead];
+            h[position + n] = frame[lead];
+        }
+        position = position + 1 == n ? 0 : position + 1;
+        if (++phase < decimation) continue;
+        phase = 0;
+        // The oldest of the last n inputs is at position
+        for (std::size_t lead = 0; lead < lead_count; ++lead) {
+            out[produced * lead_count + lead] =
+                simd::dot(coefficients.data(), history.data() + lead * 2 * n + position, n);
+        }
+        ++produced;
+    }
+    output_count += produced;
+    return produced;
+}
@@ -0,0 +1,55 @@
+#ifndef DECIMATOR_HPP
+#define DECIMATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr std::size_t DECIMATOR_TAPS_PER_PHASE = 12;  // Filter length is this times the ratio
+constexpr double DECIMATOR_CUTOFF = 0.4;              // Low-pass cutoff as a fraction of the output rate
+constexpr std::size_t DECIMATOR_MAX_RATIO = 64;
+constexpr std::size_t DECIMATOR_MAX_LEADS = 8;
+
+// FIR decimator by an integer ratio for one or more interleaved leads.
+// The anti-aliasing low-pass is a Hamming-windowed sinc of
+// DECIMATOR_TAPS_PER_PHASE * ratio taps with unity DC gain, cutting off at
+// DECIMATOR_CUTOFF of the output rate: everything that would fold back into
+// that band is at least ~50 dB down. Decimation uses the polyphase identity:
+// only the outputs that are kept are computed, so each input sample costs
+// DECIMATOR_TAPS_PER_PHASE multiply-adds per lead whatever the ratio.
+//
+// Output m is produced by input sample (m + 1) * ratio - 1 and is centred
+// delay() input samples before it. Ratio 1 passes samples through unchanged.
+class PolyphaseDecimator {
+public:
+    explicit PolyphaseDecimator(std::size_t ratio = 1, std::size_t leads = 1);
+
+    // Feed count frames of leads() values, frames stride values apart (stride
+    // 0 means leads()). Writes the decimated frames packed to out, which must
+    // hold output_capacity(count) frames; returns how many were written.
+    std::size_t process(const double* frames, std::size_t count, std::size_t stride, double* out);
+    // Most frames process() can produce from count input frames
+    std::size_t output_capacity(std::size_t count) const { return count / decimation + 1; }
+    void reset();
+
+    std::size_t ratio() const { return decimation; }
+    std::size_t leads() const { return lead_count; }
+    std::size_t taps() const { return coefficients.size(); }
+    // Group delay in input samples
+    double delay() const { return (coefficients.size() - 1) / 2.0; }
+    // Outputs produced so far
+    uint64_t outputs() const { return output_count; }
+    const std::vector<double>& filter() const { return coefficients; }
+
+private:
+    std::size_t decimation;
+    std::size_t lead_count;
+    std::vector<double> coefficients;  // Symmetric, so also the time-reversed filter
+    // Per lead, the last taps() inputs stored twice so the window is contiguous
+    std::vector<double> history;
+    std::size_t position;  // Next history slot
+    std::size_t phase;     // Inputs since the last output
+    uint64_t output_count;
+};
+
+#endif // DECIMATOR_HPP
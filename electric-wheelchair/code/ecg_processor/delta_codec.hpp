@@ -0,0 +1,77 @@
+#ifndef DELTA_CODEC_HPP
+#define DELTA_CODEC_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compact encoding of slowly changing sample streams: values are quantized to
+// a fixed step, each lead is replaced by its difference from the previous
+// frame, and the differences are written as zig-zag varints (LEB128), so the
+// small steps of an ECG trace take one or two bytes instead of eight.
+namespace delta_codec {
+
+inline uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// Reads one varint at pos and advances pos; false if it runs past end
+inline bool get_varint(const uint8_t* data, std::size_t size, std::size_t& pos, uint64_t& v) {
+    v = 0;
+    for (unsigned shift = 0; pos < size && shift < 64; shift += 7) {
+        const uint8_t byte = data[pos++];
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Appends frames of leads values, quantized to step. previous holds the last
+// quantized frame of the stream (leads values, all zero to start a
+// self-contained block) and is updated.
+inline void encode(std::string& out, const double* frames, std::size_t count, std::size_t leads, double step,
+                   int64_t* previous) {
+    for (std::size_t i = 0; i < count * leads; ++i) {
+        const int64_t q = std::llround(frames[i] / step);
+        put_varint(out, zigzag(q - previous[i % leads]));
+        previous[i % leads] = q;
+    }
+}
+
+// Inverse of encode(); returns the number of whole frames decoded, stopping
+// early at corrupt or truncated input
+inline std::size_t decode(const uint8_t* data, std::size_t size, std::size_t leads, double step,
+                          int64_t* previous, std::vector<double>& out) {
+    std::size_t pos = 0, values = 0;
+    std::vector<int64_t> frame(previous, previous + leads);
+    while (pos < size) {
+        uint64_t v;
+        if (!get_varint(data, size, pos, v)) break;
+        frame[values % leads] += unzigzag(v);
+        if (++values % leads == 0) {
+            for (std::size_t lead = 0; lead < leads; ++lead) {
+                previous[lead] = frame[lead];
+                out.push_back(static_cast<double>(frame[lead]) * step);
+            }
+        }
+    }
+    return values / leads;
+}
+
+}  // namespace delta_codec
+
+#endif // DELTA_CODEC_HPP
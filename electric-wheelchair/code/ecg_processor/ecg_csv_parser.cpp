@@ -0,0 +1,94 @@
+#include "ecg_csv_parser.hpp"
+#include <charconv>
+#include <cstring>
+
+EcgCsvTokenizer::EcgCsvTokenizer(std::size_t column, std::size_t columns)
+    : column(column), column_count(columns == 0 ? 1 : columns), partial_length(0), partial_overflow(false), line_count(0), malformed_count(0) {}
+
+void EcgCsvTokenizer::reset() {
+    partial_length = 0;
+    partial_overflow = false;
+    line_count = 0;
+    malformed_count = 0;
+}
+
+std::size_t EcgCsvTokenizer::feed(const char* data, std::size_t count, double* values, std::size_t max_frames) {
+    std::size_t produced = 0;
+    const char* cursor = data;
+    const char* const end = data + count;
+
+    while (cursor < end) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if (!newline) {
+            // Keep the unterminated tail for the next read
+            const std::size_t tail = end - cursor;
+            if (partial_length + tail <= MAX_LINE) {
+                std::memcpy(partial + partial_length, cursor, tail);
+                partial_length += tail;
+            } else {
+                partial_overflow = true;
+            }
+            break;
+        }
+
+        if (partial_length > 0 || partial_overflow) {
+            // Complete the line carried over from the previous read
+            const std::size_t head = newline - cursor;
+            if (!partial_overflow && partial_length + head <= MAX_LINE) {
+                std::memcpy(partial + partial_length, cursor, head);
+                finish_line(partial, partial + partial_length + head, values, max_frames, produced);
+            } else {
+                ++line_count;
+                ++malformed_count;
+            }
+            partial_length = 0;
+            partial_overflow = false;
+        } else if (static_cast<std::size_t>(newline - cursor) <= MAX_LINE) {
+            finish_line(cursor, newline, values, max_frames, produced);
+        } else {
+            // Same limit as a line carried over between reads
+            ++line_count;
+            ++malformed_count;
+        }
+        cursor = newline + 1;
+    }
+    return produced;
+}
+
+void EcgCsvTokenizer::finish_line(const char* begin, const char* end, double* values, std::size_t max_frames,
+                                  std::size_t& produced) {
+    if (produced < max_frames) {
+        if (parse_line(begin, end, values + produced * column_count)) ++produced;
+    }
+}
+
+bool EcgCsvTokenizer::parse_line(const char* begin, const char* end, double* frame) {
+    // Trim line ending and leading whitespace; blank lines are not data
+    if (end > begin && end[-1] == '\r') --end;
+    while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '\r')) ++begin;
+    if (begin == end) return false;
+    ++line_count;
+
+    // Walk to the wanted fields, skipping empty ones
+    std::size_t field = 0;
+    std::size_t parsed = 0;
+    const char* p = begin;
+    while (p < end) {
+        const char* comma = static_cast<const char*>(std::memchr(p, ',', end - p));
+        const char* field_end = comma ? comma : end;
+        if (field_end > p) {
+            if (field >= column) {
+                while (p < field_end && (*p == ' ' || *p == '\t')) ++p;
+                if (p < field_end && *p == '+') ++p;  // from_chars does not take a leading '+'
+                const auto result = std::from_chars(p, field_end, frame[parsed]);
+                if (result.ec != std::errc() || result.ptr == p) break;
+                if (++parsed == column_count) return true;
+            }
+            ++field;
+        }
+        if (!comma) break;
+        p = comma + 1;
+    }
+    ++malformed_count;
+    return false;
+}
@@ -0,0 +1,50 @@
+#ifndef ECG_CSV_PARSER_HPP
+#define ECG_CSV_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming tokenizer for the comma-separated lines sent by the ECG board
+// ("a,b,ecg", or "a,b,lead1,lead2,..." from a multi-lead board). Bytes are
+// scanned in place as they arrive from the port; only the wanted columns are
+// converted (std::from_chars) and no strings are built.
+// A line split across reads is carried over in a fixed buffer. Lines that
+// cannot be parsed are counted, never thrown.
+class EcgCsvTokenizer {
+public:
+    static constexpr std::size_t MAX_LINE = 128;  // Longer lines (without the '\n') are rejected
+
+    // column: zero-based index of the first field to extract; columns: how
+    // many consecutive fields form one frame (one per lead). Empty fields are
+    // skipped.
+    explicit EcgCsvTokenizer(std::size_t column = 2, std::size_t columns = 1);
+
+    // Scan count bytes and store one frame of columns() values for every
+    // complete line in values. Returns the number of frames written (never
+    // more than max_frames; room for count + 1 frames always suffices).
+    std::size_t feed(const char* data, std::size_t count, double* values, std::size_t max_frames);
+
+    // Drop any partial line and zero the counters
+    void reset();
+
+    uint64_t lines() const { return line_count; }
+    uint64_t malformed_lines() const { return malformed_count; }
+    std::size_t columns() const { return column_count; }
+
+private:
+    // Parse one line without its terminating '\n' into columns() values;
+    // false if it must be skipped
+    bool parse_line(const char* begin, const char* end, double* frame);
+    void finish_line(const char* begin, const char* end, double* values, std::size_t max_frames,
+                     std::size_t& produced);
+
+    std::size_t column;
+    std::size_t column_count;
+    char partial[MAX_LINE];
+    std::size_t partial_length;
+    bool partial_overflow;
+    uint64_t line_count;
+    uint64_t malformed_count;
+};
+
+#endif // ECG_CSV_PARSER_HPP
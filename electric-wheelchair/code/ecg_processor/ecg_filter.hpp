@@ -0,0 +1,166 @@
+#ifndef ECG_FILTER_HPP
+#define ECG_FILTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include "simd_double.hpp"
+
+// One second-order section: H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+struct Biquad {
+    double b0, b1, b2;
+    double a1, a2;
+};
+
+// Filter for ECG signals: baseline drift removal followed by a cascade of
+// second-order sections in transposed direct form II.
+// Order must be even; the cascade holds Order / 2 sections. All state lives in
+// fixed-size arrays owned by the instance, so process() never allocates and
+// several filters (one per lead) never share state.
+template <std::size_t Order>
+class EnhancedFilter {
+    static_assert(Order > 0 && Order % 2 == 0, "EnhancedFilter order must be a positive even number");
+public:
+    static constexpr std::size_t SECTIONS = Order / 2;
+
+    // baseline_alpha is the smoothing factor of the baseline tracker; 0 disables it
+    explicit EnhancedFilter(const std::array<Biquad, SECTIONS>& sections, double baseline_alpha = 0.995)
+        : sos(sections), baseline_alpha(baseline_alpha) {
+        reset();
+    }
+
+    // Filter count samples from input into output (input and output may alias)
+    void process(const double* input, double* output, std::size_t count) {
+        for (std::size_t n = 0; n < count; ++n) {
+            output[n] = step(input[n]);
+        }
+    }
+
+    // Filter count samples in place
+    void process(double* data, std::size_t count) {
+        process(data, data, count);
+    }
+
+    // Filter a single sample
+    double step(double sample) {
+        // Baseline drift removal
+        baseline = baseline_alpha * baseline + (1.0 - baseline_alpha) * sample;
+        double v = sample - baseline;
+        // Transposed direct form II, one section after the other
+        for (std::size_t s = 0; s < SECTIONS; ++s) {
+            const Biquad& q = sos[s];
+            double y = q.b0 * v + z[s][0];
+            z[s][0] = q.b1 * v - q.a1 * y + z[s][1];
+            z[s][1] = q.b2 * v - q.a2 * y;
+            v = y;
+        }
+        return v;
+    }
+
+    // Clear the delay lines and the baseline estimate
+    void reset() {
+        for (auto& d : z) {
+            d[0] = 0.0;
+            d[1] = 0.0;
+        }
+        baseline = 0.0;
+    }
+
+    const std::array<Biquad, SECTIONS>& sections() const { return sos; }
+
+private:
+    std::array<Biquad, SECTIONS> sos;
+    std::array<std::array<double, 2>, SECTIONS> z;  // Per-section delay line
+    double baseline_alpha;
+    double baseline;
+};
+
+// The same filter applied to several leads at once.
+// Samples arrive as frames, one value per lead, padded to stride() values so a
+// frame is a whole number of SIMD vectors. The filter state is kept as a
+// structure of arrays (one array per delay element, indexed by lead), so each
+// arithmetic step of the cascade runs on simd::LANES leads in one instruction.
+// The recursion is sequential in time, which is why the vectors span leads and
+// not consecutive samples. Each lead gives the same result as an
+// EnhancedFilter with the same coefficients.
+template <std::size_t Order>
+class MultiLeadFilter {
+    static_assert(Order > 0 && Order % 2 == 0, "MultiLeadFilter order must be a positive even number");
+public:
+    static constexpr std::size_t SECTIONS = Order / 2;
+    static constexpr std::size_t MAX_LEADS = 8;
+
+    MultiLeadFilter(const std::array<Biquad, SECTIONS>& sections, std::size_t leads, double baseline_alpha = 0.995)
+        : sos(sections), lead_count(leads), frame_stride(simd::padded(leads)), baseline_alpha(baseline_alpha) {
+        if (leads == 0 || leads > MAX_LEADS) {
+            throw std::invalid_argument("MultiLeadFilter supports 1 to 8 leads");
+        }
+        reset();
+    }
+
+    // Filter count frames in place; frame n starts at frames + n * stride()
+    void process(double* frames, std::size_t count) {
+        const simd::vdouble alpha = simd::broadcast(baseline_alpha);
+        const simd::vdouble beta = simd::broadcast(1.0 - baseline_alpha);
+        simd::vdouble b0[SECTIONS], b1[SECTIONS], b2[SECTIONS], a1[SECTIONS], a2[SECTIONS];
+        for (std::size_t s = 0; s < SECTIONS; ++s) {
+            b0[s] = simd::broadcast(sos[s].b0);
+            b1[s] = simd::broadcast(sos[s].b1);
+            b2[s] = simd::broadcast(sos[s].b2);
+            a1[s] = simd::broadcast(sos[s].a1);
+            a2[s] = simd::broadcast(sos[s].a2);
+        }
+
+        // One group of lanes at a time so its state stays in registers for the whole block
+        for (std::size_t lane = 0; lane < frame_stride; lane += simd::LANES) {
+            simd::vdouble baseline = simd::load(&baselines[lane]);
+            simd::vdouble d0[SECTIONS], d1[SECTIONS];
+            for (std::size_t s = 0; s < SECTIONS; ++s) {
+                d0[s] = simd::load(&z0[s][lane]);
+                d1[s] = simd::load(&z1[s][lane]);
+            }
+            double* p = frames + lane;
+            for (std::size_t n = 0; n < count; ++n, p += frame_stride) {
+                const simd::vdouble x = simd::load(p);
+                baseline = simd::add(simd::mul(alpha, baseline), simd::mul(beta, x));
+                simd::vdouble v = simd::sub(x, baseline);
+                for (std::size_t s = 0; s < SECTIONS; ++s) {
+                    const simd::vdouble y = simd::add(simd::mul(b0[s], v), d0[s]);
+                    d0[s] = simd::add(simd::sub(simd::mul(b1[s], v), simd::mul(a1[s], y)), d1[s]);
+                    d1[s] = simd::sub(simd::mul(b2[s], v), simd::mul(a2[s], y));
+                    v = y;
+                }
+                simd::store(p, v);
+            }
+            simd::store(&baselines[lane], baseline);
+            for (std::size_t s = 0; s < SECTIONS; ++s) {
+                simd::store(&z0[s][lane], d0[s]);
+                simd::store(&z1[s][lane], d1[s]);
+            }
+        }
+    }
+
+    // Clear the delay lines and baseline estimates of every lead
+    void reset() {
+        for (std::size_t s = 0; s < SECTIONS; ++s) {
+            z0[s].fill(0.0);
+            z1[s].fill(0.0);
+        }
+        baselines.fill(0.0);
+    }
+
+    std::size_t leads() const { return lead_count; }
+    // Values per frame, leads() rounded up to whole SIMD vectors
+    std::size_t stride() const { return frame_stride; }
+
+private:
+    std::array<Biquad, SECTIONS> sos;
+    std::size_t lead_count;
+    std::size_t frame_stride;
+    double baseline_alpha;
+    std::array<double, MAX_LEADS> baselines;
+    std::array<std::array<double, MAX_LEADS>, SECTIONS> z0;  // First delay element per section, per lead
+    std::array<std::array<double, MAX_LEADS>, SECTIONS> z1;  // Second delay element
+};
+
+#endif // ECG_FILTER_HPP
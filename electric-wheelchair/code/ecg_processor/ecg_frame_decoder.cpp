@@ -0,0 +1,93 @@
+#include "ecg_frame_decoder.hpp"
+#include <cstring>
+
+uint16_t ecg_frame_crc16(const uint8_t* data, std::size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (std::size_t i = 0; i < length; ++i) {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+EcgFrameDecoder::EcgFrameDecoder() {
+    reset();
+}
+
+void EcgFrameDecoder::reset() {
+    length = 0;
+    have_sequence = false;
+    expected_sequence = 0;
+    frame_count = 0;
+    dropped_count = 0;
+    crc_error_count = 0;
+    skipped_count = 0;
+}
+
+std::size_t EcgFrameDecoder::append(const uint8_t* data, std::size_t count) {
+    const std::size_t space = sizeof(buffer) - length;
+    const std::size_t n = count < space ? count : space;
+    std::memcpy(buffer + length, data, n);
+    length += n;
+    return n;
+}
+
+void EcgFrameDecoder::discard(std::size_t count) {
+    std::memmove(buffer, buffer + count, length - count);
+    length -= count;
+}
+
+bool EcgFrameDecoder::next_frame(EcgFrame& frame) {
+    while (length >= 2) {
+        // Resynchronise on the sync word
+        if (buffer[0] != ECG_FRAME_SYNC0 || buffer[1] != ECG_FRAME_SYNC1) {
+            const void* sync = std::memchr(buffer + 1, ECG_FRAME_SYNC0, length - 1);
+            const std::size_t skip = sync ? static_cast<const uint8_t*>(sync) - buffer : length;
+            skipped_count += skip;
+            discard(skip);
+            continue;
+        }
+        if (length < ECG_FRAME_HEADER_SIZE) return false;
+
+        const uint8_t leads = buffer[4];
+        const uint8_t samples_per_lead = buffer[5];
+        if (leads == 0 || leads > ECG_FRAME_MAX_LEADS ||
+            samples_per_lead == 0 || samples_per_lead > ECG_FRAME_MAX_SAMPLES) {
+            ++skipped_count;
+            discard(1);
+            continue;
+        }
+        const std::size_t values = static_cast<std::size_t>(leads) * samples_per_lead;
+        const std::size_t frame_size = ECG_FRAME_HEADER_SIZE + 2 * values + 2;
+        if (length < frame_size) return false;
+
+        const uint16_t crc = static_cast<uint16_t>(buffer[frame_size - 2] | (buffer[frame_size - 1] << 8));
+        if (ecg_frame_crc16(buffer + 2, frame_size - 4) != crc) {
+            // Corrupt frame or a false sync inside data: look for the next sync
+            ++crc_error_count;
+            ++skipped_count;
+            discard(1);
+            continue;
+        }
+
+        frame.sequence = static_cast<uint16_t>(buffer[2] | (buffer[3] << 8));
+        frame.leads = leads;
+        frame.samples_per_lead = samples_per_lead;
+        const uint8_t* payload = buffer + ECG_FRAME_HEADER_SIZE;
+        for (std::size_t i = 0; i < values; ++i) {
+            frame.samples[i] = static_cast<int16_t>(payload[2 * i] | (payload[2 * i + 1] << 8));
+        }
+        discard(frame_size);
+
+        if (have_sequence && frame.sequence != expected_sequence) {
+            dropped_count += static_cast<uint16_t>(frame.sequence - expected_sequence);
+        }
+        have_sequence = true;
+        expected_sequence = static_cast<uint16_t>(frame.sequence + 1);
+        ++frame_count;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#ifndef ECG_FRAME_DECODER_HPP
+#define ECG_FRAME_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary ECG frame, all fields little-endian:
+//   sync      2 bytes  0xA5 0x5A
+//   sequence  uint16   incremented by one per frame, wraps at 65536
+//   leads     uint8    1..ECG_FRAME_MAX_LEADS
+//   samples   uint8    samples per lead, 1..ECG_FRAME_MAX_SAMPLES
+//   payload   int16    leads * samples values, lead by lead
+//   crc       uint16   CRC-16/CCITT-FALSE over sequence..payload
+constexpr uint8_t ECG_FRAME_SYNC0 = 0xA5;
+constexpr uint8_t ECG_FRAME_SYNC1 = 0x5A;
+constexpr std::size_t ECG_FRAME_HEADER_SIZE = 6;
+constexpr std::size_t ECG_FRAME_MAX_LEADS = 8;
+constexpr std::size_t ECG_FRAME_MAX_SAMPLES = 32;
+constexpr std::size_t ECG_FRAME_MAX_SIZE = ECG_FRAME_HEADER_SIZE + 2 * ECG_FRAME_MAX_LEADS * ECG_FRAME_MAX_SAMPLES + 2;
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF)
+uint16_t ecg_frame_crc16(const uint8_t* data, std::size_t length);
+
+struct EcgFrame {
+    uint16_t sequence;
+    uint8_t leads;
+    uint8_t samples_per_lead;
+    int16_t samples[ECG_FRAME_MAX_LEADS * ECG_FRAME_MAX_SAMPLES];  // Lead-major
+
+    int16_t sample(std::size_t lead, std::size_t index) const {
+        return samples[lead * samples_per_lead + index];
+    }
+};
+
+// Incremental decoder for the binary ECG frame stream.
+// Bytes go in with append(), complete frames come out of next_frame(). A frame
+// with a bad header or CRC is skipped one byte at a time until the next sync
+// word, and gaps in the sequence number are counted as dropped frames.
+class EcgFrameDecoder {
+public:
+    EcgFrameDecoder();
+
+    // Buffer up to count bytes and return how many were taken. Call
+    // next_frame() until it returns false before appending the rest.
+    std::size_t append(const uint8_t* data, std::size_t count);
+    // Extract the next valid frame, if one is complete
+    bool next_frame(EcgFrame& frame);
+    void reset();
+
+    uint64_t frames() const { return frame_count; }
+    uint64_t dropped_frames() const { return dropped_count; }
+    uint64_t crc_errors() const { return crc_error_count; }
+    uint64_t skipped_bytes() const { return skipped_count; }
+
+private:
+    void discard(std::size_t count);
+
+    uint8_t buffer[2 * ECG_FRAME_MAX_SIZE];
+    std::size_t length;
+    bool have_sequence;
+    uint16_t expected_sequence;
+    uint64_t frame_count;
+    uint64_t dropped_count;
+    uint64_t crc_error_count;
+    uint64_t skipped_count;
+};
+
+#endif // ECG_FRAME_DECODER_HPP
@@ -1,106 +1,70 @@
 #include "ecg_processor.hpp"
+#include "ecg_recording.hpp"
 #include <iostream>
 #include <iomanip>
-#include <atomic>
-#include <mutex>
-#include <sstream>
 #include <string>
 #include <chrono>
 #include <thread>
+#include <csignal>
+#include <memory>
 
-// Global atomic variable to store the latest ECG value
-std::atomic<double> g_latest_ecg_value{0.0};
+namespace {
+volatile std::sig_atomic_t g_running = 1;
+volatile std::sig_atomic_t dump_latency = 0;
 
-// Custom stream buffer interceptor to process and extract ECG values
-class InterceptBuf : public std::streambuf {
-public:
-    // Take the original stream buffer to wrap
-    InterceptBuf(std::streambuf* orig) : orig_buf(orig) {}
-
-protected:
-    // Intercept single character output and processes lines
-    virtual int overflow(int c) override {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (c != EOF) {
-            char ch = static_cast<char>(c);
-            buffer.push_back(ch);
-            if (ch == '\n') {
-                processLine(buffer);
-                buffer.clear();
-            }
-            return orig_buf->sputc(c);
-        }
-        return c;
-    }
-
-    // Intercept multi-character output and processes complete lines
-    virtual std::streamsize xsputn(const char* s, std::streamsize count) override {
-        std::lock_guard<std::mutex> lock(mtx);
-        std::string str(s, count);
-        buffer.append(str);
-        size_t pos = 0;
-        
-        // Process each complete line
-        while ((pos = buffer.find('\n')) != std::string::npos) {
-            std::string line = buffer.substr(0, pos + 1);
-            processLine(line);
-            buffer.erase(0, pos + 1);
-        }
-        return orig_buf->sputn(s, count);
-    }
-
-    // Extract ECG value
-    void processLine(const std::string& line) {
-        if (line.find("Converted ECG Value:") != std::string::npos) {
-            size_t pos = line.find(":");
-            if (pos != std::string::npos) {
-                std::istringstream iss(line.substr(pos + 1));
-                double value;
-                if (iss >> value) {
-                    g_latest_ecg_value.store(value);
-                }
-            }
-        }
-    }
+void request_stop(int) {
+    g_running = 0;
+}
 
-private:
-    std::streambuf* orig_buf;  
-    std::string buffer;        
-    std::mutex mtx;           
-};
+void request_latency_dump(int) {
+    dump_latency = 1;
+}
+}
 
-int main() {
+// Usage: test_ecg [--record FILE]
+int main(int argc, char* argv[]) {
+    // kill -USR1 <pid> prints the latency histograms
+    std::signal(SIGUSR1, request_latency_dump);
+    // Ctrl+C or kill ends the loop so the recording gets its index and footer
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
     try {
-       
-        InterceptBuf interceptor(std::cerr.rdbuf());
-        std::streambuf* oldCerrBuf = std::cerr.rdbuf(&interceptor);
-
         // Create ECG processor and serial reader
         StableECGProcessor processor;
         ReliableSerialReader reader("/dev/ttyUSB0", processor);
+        // Optional Holter-style recording of the raw and filtered ECG
+        std::unique_ptr<EcgRecorder> recorder;
+        if (argc == 3 && std::string(argv[1]) == "--record") {
+            recorder.reset(new EcgRecorder(processor, argv[2]));
+        }
 
         processor.start();  // Start ECG data processing
         reader.start();  // Start reading ECG data from serial port
+        if (recorder) recorder->start();
 
         // Display the latest ECG value
         auto last_display = std::chrono::steady_clock::now();
-        while (true) {
+        while (g_running) {
             auto now = std::chrono::steady_clock::now();
             if (now - last_display >= std::chrono::seconds(2)) {
-                double ecg = g_latest_ecg_value.load();
+                const EcgStatus status = processor.latest();
                 std::cout << "\rConverted ECG Value: " << std::fixed << std::setprecision(1)
-                          << ecg << "    " << std::flush;
+                          << reader.latest().value << "  HR: " << status.heart_rate << " bpm    " << std::flush;
                 last_display = now;
             }
+            if (dump_latency) {
+                dump_latency = 0;
+                std::cout << std::endl;
+                processor.write_latency_report(std::cout);
+            }
             std::this_thread::sleep_for(std::chrono::milliseconds(50));
         }
+        std::cout << std::endl;
 
         // Stop processing and reader before exiting
         reader.stop();
         processor.stop();
-
-        // Restore original buffer
-        std::cerr.rdbuf(oldCerrBuf);
+        if (recorder) recorder->stop();
     } catch (const std::exception& e) {
         std::cerr << "\nFatal error: " << e.what() << std::endl;
         return EXIT_FAILURE;
@@ -1,6 +1,6 @@
 #include "ecg_processor.hpp"
 #include <iostream>
-#include <sstream>
+#include <iomanip>
 #include <string>
 #include <cstring>
 #include <algorithm>
@@ -15,245 +15,586 @@
 #include <termios.h>
 #include <unistd.h>
 #include <cctype>
-// EnhancedFilter class applies a digital filter to ECG data
-EnhancedFilter::EnhancedFilter(const std::vector<double>& b, const std::vector<double>& a)
-    : b_coeff(b), a_coeff(a), x(5, 0.0), y(5, 0.0) {}
-// Processes input ECG signal through the filter
-std::vector<double> EnhancedFilter::process(const std::vector<double>& input) {
-    std::vector<double> output;
-    output.reserve(input.size());
-    static double baseline = 0.0;
-
-    for (auto sample : input) {
-        // Baseline drift removal 
-        baseline = 0.995 * baseline + 0.005 * sample;
-        sample -= baseline;
-        // Apply digital filtering
-        x = {sample, x[0], x[1], x[2], x[3]};
-        y = {0.0, y[0], y[1], y[2], y[3]};
-
-        y[0] = b_coeff[0]*x[0] + b_coeff[1]*x[1] + b_coeff[2]*x[2] +
-               b_coeff[3]*x[3] + b_coeff[4]*x[4] -
-               a_coeff[1]*y[1] - a_coeff[2]*y[2] -
-               a_coeff[3]*y[3] - a_coeff[4]*y[4];
-
-        output.push_back(y[0]);
-    }
-    return output;
-}
-
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 // Calculate heart rate from ECG peaks
-AdvancedHRCalculator::AdvancedHRCalculator()
-    : last_valid_hr(0.0), qrs_window(200), min_interval(300), noise_count(0) {}
-// Detect R-peaks and update heart rate calculations
-void AdvancedHRCalculator::update_r_peak() {
-    const auto now = std::chrono::system_clock::now();
+AdvancedHRCalculator::AdvancedHRCalculator(int sample_rate, std::size_t median_beats)
+    : sample_rate(sample_rate), has_last_peak(false), last_peak_index(0), last_peak_ms(0.0),
+      hr_median(median_beats), last_valid_hr(0.0), noise_count(0), min_interval(300) {}
+// Update heart rate calculations from the RR interval ending at sample_index
+double AdvancedHRCalculator::update_r_peak(uint64_t sample_index) {
+    return update_r_peak(sample_index, sample_index * 1000.0 / sample_rate);
+}
+double AdvancedHRCalculator::update_r_peak(uint64_t sample_index, double time_ms) {
     std::lock_guard<std::mutex> lock(data_mutex);
 
-    if (!last_peak_time.time_since_epoch().count()) {
-        last_peak_time = now;
-        return;
+    if (!has_last_peak || sample_index <= last_peak_index) {
+        has_last_peak = true;
+        last_peak_index = sample_index;
+        last_peak_ms = time_ms;
+        return 0.0;
     }
 
-    auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_peak_time);
+    const double interval_ms = time_ms - last_peak_ms;
 
-    // std::cerr << "? Ignoring unrealistically fast beat (interval: " << interval.count() << " ms)" << std::endl;
-    if (interval.count() < 500) {  // Ignore unrealistic heart rates
-        return;
+    // std::cerr << "? Ignoring unrealistically fast beat (interval: " << interval_ms << " ms)" << std::endl;
+    if (interval_ms < min_interval) {  // Ignore unrealistic heart rates
+        return 0.0;
     }
 
-    double new_hr = 60000.0 / interval.count();
+    double new_hr = 60000.0 / interval_ms;
+    last_peak_index = sample_index;
+    last_peak_ms = time_ms;
 
     // std::cerr << "? Calculated BPM: " << new_hr << std::endl;
-    if (last_valid_hr > 0 && std::abs(new_hr - last_valid_hr) > 20) {  // Ignore sudden large heart rate jumps
-        // std::cerr << "?? Sudden HR jump detected (from " << last_valid_hr 
+    const double current_hr = last_valid_hr.load(std::memory_order_relaxed);
+    if (current_hr > 0 && std::abs(new_hr - current_hr) > 20) {  // Ignore sudden large heart rate jumps
+        // std::cerr << "?? Sudden HR jump detected (from " << current_hr 
         //           << " to " << new_hr << "), ignoring." << std::endl;
-        return;
+        if (++noise_count < 3) {
+            return 0.0;
+        }
+        // The rhythm really changed: restart smoothing from the new rate
+        hr_median.clear();
     }
-    // Update heart rate buffer
+    noise_count = 0;
+    // Update heart rate median
     if (new_hr >= 30.0 && new_hr <= 220.0) {
-        hr_buffer.push_back(new_hr);
-        if (hr_buffer.size() > 7) {
-            hr_buffer.pop_front();
-        }
-
-        auto temp = hr_buffer;
-        std::sort(temp.begin(), temp.end());
-        last_valid_hr = temp[temp.size() / 2];
+        hr_median.push(new_hr);
+        last_valid_hr.store(hr_median.median(), std::memory_order_relaxed);
+        return interval_ms;
     }
-
-    last_peak_time = now;
+    return 0.0;
 }
 // Return the most recent valid heart rate
 double AdvancedHRCalculator::get_heart_rate() const {
-    std::lock_guard<std::mutex> lock(data_mutex);
-    return last_valid_hr;
+    return last_valid_hr.load(std::memory_order_relaxed);
 }
 // Reset heart rate calculation state
 void AdvancedHRCalculator::reset_state() {
     std::lock_guard<std::mutex> lock(data_mutex);
-    hr_buffer.clear();
-    last_peak_time = std::chrono::system_clock::time_point{};
+    hr_median.clear();
+    last_valid_hr.store(0.0, std::memory_order_relaxed);
+    has_last_peak = false;
+    last_peak_index = 0;
+    last_peak_ms = 0.0;
     noise_count = 0;
 }
+// Look up the precomputed filter for a sample rate
+const EcgRateProfile& ecg_rate_profile(int sample_rate) {
+    for (const EcgRateProfile& profile : ECG_RATE_PROFILES) {
+        if (profile.sample_rate == sample_rate) return profile;
+    }
+    throw std::invalid_argument("Unsupported ECG sample rate: " + std::to_string(sample_rate) + " Hz");
+}
+namespace {
+uint64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+const char* latency_stage_name(LatencyStage stage) {
+    switch (stage) {
+        case LatencyStage::Read: return "read";
+        case LatencyStage::Parse: return "parse";
+        case LatencyStage::Enqueue: return "enqueue";
+        case LatencyStage::Fetch: return "fetch";
+        case LatencyStage::Filter: return "filter";
+        case LatencyStage::Detect: return "detect";
+        case LatencyStage::Total: return "total";
+        case LatencyStage::Beat: return "beat";
+    }
+    return "?";
+}
 // Manage ECG processing pipeline
-StableECGProcessor::StableECGProcessor()
-    : filter({{0.0034, 0.0, -0.0068, 0.0, 0.0034},
-              {1.0, -3.6789, 5.1797, -3.3058, 0.8060}}),
+StableECGProcessor::StableECGProcessor(std::size_t leads, int sample_rate)
+    : lead_count(leads),
+      rate_profile(ecg_rate_profile(sample_rate)),
+      filter(rate_profile.sections, rate_profile.baseline_alpha),
+      lead_filter(rate_profile.sections, std::max<std::size_t>(leads, 1), rate_profile.baseline_alpha),
+      lead_energy(std::max<std::size_t>(leads, 1)),
+      detector(sample_rate),
+      calculator(sample_rate),
+      classifier(sample_rate, rate_profile.filter_delay),
+      quality_index(sample_rate, std::max<std::size_t>(leads, 1)),
+      beat_ring(ECG_BEAT_HISTORY, 1),
+      raw_ring(static_cast<std::size_t>(sample_rate) * ECG_WAVEFORM_SECONDS, std::max<std::size_t>(leads, 1)),
+      clock(sample_rate),
       active(false),
-      threshold_low(0.0),
-      threshold_high(0.0),
-      noise_peak(0.0),
-      signal_peak(0.0),
-      last_peak_index(0)
-{}
+      block(PROCESS_BLOCK_SIZE * leads),
+      lead_block(leads > 1 ? PROCESS_BLOCK_SIZE * lead_filter.stride() : 0),
+      processed_count(0),
+      dropped_count(0),
+      profiling(false),
+      filter_ns(0),
+      detect_ns(0),
+      classify_ns(0),
+      quality_ns(0),
+      decimate_ns(0),
+      queued_count(0),
+      pending_mark{},
+      have_mark(false),
+      arrival_ns(SAMPLE_RING_CAPACITY, 0),
+      arrival_end(0),
+      finished_read_ns{},
+      finished_count(0)
+{
+    if (leads == 0 || leads > ECG_MAX_LEADS) {
+        throw std::invalid_argument("ECG processor supports 1 to " + std::to_string(ECG_MAX_LEADS) + " leads");
+    }
+    set_waveform_ratio(std::max(1, sample_rate / ECG_WAVEFORM_RATE_HZ));
+}
 // Destructor stops processing thread
 StableECGProcessor::~StableECGProcessor() {
     stop();
 }
 // Start ECG processing loop
 void StableECGProcessor::start() {
+    hrv.start();
     active.store(true);
     processor = std::thread(&StableECGProcessor::processing_loop, this);
 }
 // Stop ECG processing loop
 void StableECGProcessor::stop() {
     active.store(false);
-    data_ready.notify_all();
+    sample_ring.wake();
     if (processor.joinable())
         processor.join();
+    hrv.stop();
+}
+// Add ECG samples to processing buffer (one wakeup per batch)
+void StableECGProcessor::add_samples(const double* samples, std::size_t count, const BatchTiming* timing) {
+    const std::size_t queued = try_add_samples(samples, count, timing);
+    if (queued < count) {
+        dropped_count.store(dropped_count.load(std::memory_order_relaxed) + (count - queued),
+                            std::memory_order_relaxed);
+    }
 }
-// Add ECG samples to processing buffer
+
 void StableECGProcessor::add_samples(const std::vector<double>& samples) {
-    std::lock_guard<std::mutex> lock(buffer_mutex);
-    circular_buffer.insert(circular_buffer.end(), samples.begin(), samples.end());
-    data_ready.notify_one();
+    add_samples(samples.data(), samples.size() / lead_count);
+}
+// Frames are only ever queued whole, so the consumer never sees half a frame.
+// The batch mark goes in first so the processor finds it with the samples.
+std::size_t StableECGProcessor::try_add_samples(const double* samples, std::size_t count, const BatchTiming* timing) {
+    const std::size_t n = std::min(count, sample_ring.free_space() / lead_count);
+    if (n > 0) {
+        queued_count += n;
+        const BatchMark mark{timing ? *timing : BatchTiming{}, timing ? steady_ns() : 0, queued_count};
+        mark_ring.try_push(&mark, 1);  // A lost mark only blurs the timing of its batch
+        sample_ring.try_push(samples, n * lead_count);
+    }
+    sample_ring.notify();
+    return n;
+}
+
+std::size_t StableECGProcessor::leads() const {
+    return lead_count;
+}
+
+int StableECGProcessor::sample_rate() const {
+    return rate_profile.sample_rate;
 }
 // Return the current heart rate
 double StableECGProcessor::current_hr() const {
     return calculator.get_heart_rate();
 }
 
-void StableECGProcessor::processing_loop() {
-    std::vector<double> window;
-    int print_counter = 0;
+EcgStatus StableECGProcessor::latest() const {
+    return status.load();
+}
 
-    while (active.load()) {
-        auto data = fetch_data();
-        if (data.empty()) continue;
-
-        // if (print_counter % 20 == 0) {
-        //     std::cerr << "Raw data: ";
-        //     for (size_t i = 0; i < data.size() && i < 5; ++i) {
-        //         std::cerr << data[i] << " ";
-        //     }
-        //     std::cerr << std::endl;
-        // }
-
-        auto filtered = filter.process(data);
-
-        // if (print_counter % 20 == 0) {
-        //     std::cerr << "Filtered ECG Data: ";
-        //     for (size_t i = 0; i < filtered.size() && i < 5; ++i) {
-        //         std::cerr << filtered[i] << " ";
-        //     }
-        //     std::cerr << std::endl;
-        // }
-
-        ++print_counter;
-        // Maintain sliding window
-        window.insert(window.end(), filtered.begin(), filtered.end());
-        if (window.size() > SAMPLE_RATE * WINDOW_SECONDS) {
-            window.erase(window.begin(), window.begin() + (window.size() - SAMPLE_RATE * WINDOW_SECONDS));
-        }
+HrvMetrics StableECGProcessor::hrv_metrics() const {
+    return hrv.metrics();
+}
 
-        update_thresholds(window);  // Update detection thresholds
-        detect_r_peaks(filtered);  // Detect QRS
-    }
+RhythmStatus StableECGProcessor::rhythm() const {
+    return classifier.status();
+}
+
+SignalQuality StableECGProcessor::signal_quality() const {
+    return quality_status.load();
+}
+// Return the number of samples that have been filtered and analysed
+uint64_t StableECGProcessor::samples_processed() const {
+    return processed_count.load(std::memory_order_relaxed);
+}
+// Return the number of samples lost to ring overruns
+uint64_t StableECGProcessor::dropped_samples() const {
+    return dropped_count.load(std::memory_order_relaxed);
+}
+
+void StableECGProcessor::set_beat_callback(std::function<void(uint64_t)> callback) {
+    beat_callback = std::move(callback);
+}
+
+void StableECGProcessor::set_beat_class_callback(std::function<void(const BeatInfo&)> callback) {
+    classifier.set_callback(std::move(callback));
+}
+// Enable per-stage timing (a few clock reads per block)
+void StableECGProcessor::set_profiling(bool enabled) {
+    profiling.store(enabled);
 }
-// Fetch data from buffer for processing
-std::vector<double> StableECGProcessor::fetch_data() {
-    std::unique_lock<std::mutex> lock(buffer_mutex);
-    data_ready.wait(lock, [this]() { return !circular_buffer.empty() || !active.load(); });
-    std::vector<double> data;
-    if (!circular_buffer.empty()) {
-        data.swap(circular_buffer);
+
+EcgStageTimes StableECGProcessor::stage_times() const {
+    return {filter_ns.load(std::memory_order_relaxed), detect_ns.load(std::memory_order_relaxed),
+            classify_ns.load(std::memory_order_relaxed), quality_ns.load(std::memory_order_relaxed),
+            decimate_ns.load(std::memory_order_relaxed)};
+}
+
+const LatencyHistogram& StableECGProcessor::latency(LatencyStage stage) const {
+    return latency_histograms[static_cast<std::size_t>(stage)];
+}
+
+void StableECGProcessor::write_latency_report(std::ostream& out) const {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << "Latency (us)       count       p50       p90       p99     p99.9       max\n" << std::fixed
+        << std::setprecision(1);
+    for (std::size_t i = 0; i < LATENCY_STAGES; ++i) {
+        const LatencyHistogram& h = latency_histograms[i];
+        out << "  " << std::left << std::setw(9) << latency_stage_name(static_cast<LatencyStage>(i)) << std::right
+            << std::setw(10) << h.count();
+        for (double q : {0.5, 0.9, 0.99, 0.999}) out << std::setw(10) << h.percentile(q) / 1e3;
+        out << std::setw(10) << h.max() / 1e3 << "\n";
     }
-    return data;
+    const SampleClockStatus sc = clock.status();
+    out << "Sample clock: " << std::setprecision(3) << sc.rate_hz << " Hz (" << std::setprecision(0) << sc.ppm
+        << " ppm";
+    if (sc.locked) {
+        out << "), delay " << sc.delay_us << " us, ";
+    } else {
+        out << ", nominal), ";
+    }
+    out << sc.dropped << " dropped, " << sc.duplicated << " duplicated\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+SampleClockStatus StableECGProcessor::sample_clock() const {
+    return clock.status();
+}
+
+void StableECGProcessor::reset_latency() {
+    for (LatencyHistogram& h : latency_histograms) h.reset();
 }
-// Adaptive threshold algorithm
-void StableECGProcessor::update_thresholds(const std::vector<double>& window) {
-    double current_max = *std::max_element(window.begin(), window.end());
 
-    noise_peak = 0.95 * noise_peak + 0.05 * current_max;
-    signal_peak = 0.3 * signal_peak + 0.7 * current_max;
+void StableECGProcessor::set_waveform_ratio(std::size_t ratio) {
+    decimator = PolyphaseDecimator(ratio, lead_count);
+    const std::size_t frames = static_cast<std::size_t>(rate_profile.sample_rate) * ECG_WAVEFORM_SECONDS / ratio;
+    waveform_ring.reset(new WaveformRing(frames, lead_count));
+    waveform_block.resize(decimator.output_capacity(PROCESS_BLOCK_SIZE) * lead_count);
+}
+
+std::size_t StableECGProcessor::waveform_ratio() const {
+    return decimator.ratio();
+}
+
+double StableECGProcessor::waveform_rate() const {
+    return static_cast<double>(rate_profile.sample_rate) / decimator.ratio();
+}
 
-    threshold_low = noise_peak + 0.35 * (signal_peak - noise_peak);
-    threshold_high = 0.6 * signal_peak; 
+const WaveformRing& StableECGProcessor::waveform() const {
+    return *waveform_ring;
+}
+
+double StableECGProcessor::waveform_sample_index(uint64_t frame) const {
+    const double input = static_cast<double>((frame + 1) * decimator.ratio()) - 1.0 - decimator.delay();
+    return input - static_cast<double>(rate_profile.filter_delay);
+}
+
+uint64_t StableECGProcessor::waveform_frame(uint64_t sample_index) const {
+    const double frames = (static_cast<double>(sample_index + rate_profile.filter_delay) + 1.0 + decimator.delay()) /
+                          decimator.ratio() - 1.0;
+    return frames > 0.0 ? static_cast<uint64_t>(frames + 0.5) : 0;
+}
 
-    // std::cerr << "Thresholds - Low: " << threshold_low
-    //           << " | High: " << threshold_high
-    //           << " | Noise Peak: " << noise_peak
-    //           << " | Signal Peak: " << signal_peak
-    //           << std::endl;
+const BroadcastRing<uint64_t>& StableECGProcessor::beats() const {
+    return beat_ring;
 }
-// R-Peak detection logic
-void StableECGProcessor::detect_r_peaks(const std::vector<double>& data) {
-    static size_t last_peak_index = 0;
-    const size_t min_distance = 30;  
 
-    for (size_t i = 1; i < data.size() - 1; ++i) {
-        double slope = data[i] - data[i - 1];
+const WaveformRing& StableECGProcessor::raw() const {
+    return raw_ring;
+}
 
-        if (i > last_peak_index + min_distance &&
-            data[i] > threshold_high &&
-            slope > 0.3 * threshold_high)
-        {
-            // std::cerr << "?? R-Peak Detected! Index: " << i
-            //           << " | Value: " << data[i] << std::endl;
-            calculator.update_r_peak();
-            last_peak_index = i;
+void StableECGProcessor::processing_loop() {
+    while (active.load()) {
+        std::size_t count = fetch_data(block.data(), block.size());
+        if (count == 0) continue;
+        const uint64_t first_index = processed_count.load(std::memory_order_relaxed);
+        track_batches(first_index, count / lead_count, steady_ns());
+        process_block(block.data(), count / lead_count);
+        finish_batches(steady_ns());
+    }
+}
+// Match the fetched samples with the batch marks queued ahead of them: stamp
+// each sample with the time its bytes were read and time the batches whose
+// last sample is in this block
+void StableECGProcessor::track_batches(uint64_t first_index, std::size_t count, uint64_t fetched_ns) {
+    const uint64_t end = first_index + count;
+    const uint64_t mask = arrival_ns.size() - 1;
+    arrival_end = std::max(arrival_end, first_index);
+    finished_count = 0;
+    while (arrival_end < end) {
+        if (!have_mark) {
+            if (mark_ring.pop(&pending_mark, 1) == 0) break;
+            have_mark = true;
         }
+        const uint64_t stop = std::min(end, pending_mark.end_index);
+        for (uint64_t i = arrival_end; i < stop; ++i) arrival_ns[i & mask] = pending_mark.timing.read_ns;
+        arrival_end = std::max(arrival_end, stop);
+        if (pending_mark.end_index > end) break;
+
+        have_mark = false;
+        const BatchTiming& t = pending_mark.timing;
+        if (t.read_ns == 0) continue;  // Untimed producer
+        clock.add_batch(pending_mark.end_index, t.read_ns);
+        latency_histograms[static_cast<std::size_t>(LatencyStage::Read)].record(t.read_ns - t.wake_ns);
+        latency_histograms[static_cast<std::size_t>(LatencyStage::Parse)].record(t.parsed_ns - t.read_ns);
+        latency_histograms[static_cast<std::size_t>(LatencyStage::Enqueue)].record(pending_mark.queued_ns -
+                                                                                   t.parsed_ns);
+        latency_histograms[static_cast<std::size_t>(LatencyStage::Fetch)].record(fetched_ns - pending_mark.queued_ns);
+        if (finished_count < finished_read_ns.size()) finished_read_ns[finished_count++] = t.read_ns;
     }
-}// Read ECG data from a serial port
-ReliableSerialReader::ReliableSerialReader(const std::string& port, StableECGProcessor& proc)
-    : processor(proc), active(false)
+}
+// The batches completed by the block just processed are now visible in the status
+void StableECGProcessor::finish_batches(uint64_t published_ns) {
+    for (std::size_t i = 0; i < finished_count; ++i) {
+        latency_histograms[static_cast<std::size_t>(LatencyStage::Total)].record(published_ns - finished_read_ns[i]);
+    }
+    finished_count = 0;
+}
+// Process recorded samples synchronously, in blocks of PROCESS_BLOCK_SIZE
+void StableECGProcessor::process_samples(const double* samples, std::size_t count) {
+    while (count > 0) {
+        const std::size_t n = std::min(count, PROCESS_BLOCK_SIZE);
+        std::copy(samples, samples + n * lead_count, block.begin());
+        process_block(block.data(), n);
+        samples += n * lead_count;
+        count -= n;
+    }
+}
+// Filter one block in place and run QRS detection on it
+void StableECGProcessor::process_block(double* data, std::size_t count) {
+    // std::cerr << "Raw data: ";
+    // for (size_t i = 0; i < count && i < 5; ++i) {
+    //     std::cerr << data[i] << " ";
+    // }
+    // std::cerr << std::endl;
+    if (count == 0) return;
+    const double raw = data[(count - 1) * lead_count];  // Filtering is done in place
+    raw_ring.write(data, count);
+
+    const uint64_t first_index = processed_count.load(std::memory_order_relaxed);
+
+    using std::chrono::steady_clock;
+    const auto t0 = steady_clock::now();
+    const bool detecting = gate_detection(data, count, first_index);
+    const auto t1 = steady_clock::now();
+    filter_block(data, count);
+    const auto t2 = steady_clock::now();
+    decimate_block(data, count);
+    const auto t3 = steady_clock::now();
+    classify_block(data, count);
+    const auto t4 = steady_clock::now();
+    if (detecting) detect_r_peaks(data, count);  // Detect QRS
+    const auto t5 = steady_clock::now();
+    auto ns = [](steady_clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    };
+    latency_histograms[static_cast<std::size_t>(LatencyStage::Filter)].record(ns(t3 - t0));
+    latency_histograms[static_cast<std::size_t>(LatencyStage::Detect)].record(ns(t5 - t3));
+    if (profiling.load(std::memory_order_relaxed)) {
+        quality_ns.fetch_add(ns(t1 - t0), std::memory_order_relaxed);
+        filter_ns.fetch_add(ns(t2 - t1), std::memory_order_relaxed);
+        decimate_ns.fetch_add(ns(t3 - t2), std::memory_order_relaxed);
+        classify_ns.fetch_add(ns(t4 - t3), std::memory_order_relaxed);
+        detect_ns.fetch_add(ns(t5 - t4), std::memory_order_relaxed);
+    }
+    const double filtered = lead_count == 1 ? data[count - 1] : lead_block[(count - 1) * lead_filter.stride()];
+    const uint64_t processed = first_index + count;
+    processed_count.store(processed, std::memory_order_relaxed);
+    const SignalQuality& quality = quality_index.last();
+    quality_status.store(quality);
+    status.store({raw, filtered, calculator.get_heart_rate(), quality.score, processed,
+                  std::chrono::steady_clock::now()});
+}
+// Score the raw block and decide whether QRS detection runs on it. When the
+// signal turns bad the heart rate and the classifier's rhythm are dropped; when
+// it recovers the detector relearns its thresholds, keeping beat positions on
+// the stream's sample clock.
+bool StableECGProcessor::gate_detection(const double* data, std::size_t count, uint64_t first_index) {
+    const bool was_detecting = quality_index.last().detecting;
+    const bool detecting = quality_index.update(data, count).detecting;
+    if (detecting && !was_detecting) {
+        detector.reset(first_index);
+        lead_energy.reset();
+    } else if (!detecting && was_detecting) {
+        calculator.reset_state();
+        classifier.restart_rhythm(first_index);
+    }
+    return detecting;
+}
+// Single lead: filter in place. Several leads: spread the frames to the SIMD
+// stride and filter all leads together in lead_block.
+void StableECGProcessor::filter_block(double* data, std::size_t count) {
+    if (lead_count == 1) {
+        filter.process(data, count);
+        return;
+    }
+    const std::size_t stride = lead_filter.stride();
+    for (std::size_t n = 0; n < count; ++n) {
+        std::copy(data + n * lead_count, data + (n + 1) * lead_count, lead_block.begin() + n * stride);
+    }
+    lead_filter.process(lead_block.data(), count);
+}
+// Hand the filtered first lead to the beat classifier; beats whose window is
+// now complete are classified here
+void StableECGProcessor::classify_block(const double* data, std::size_t count) {
+    if (lead_count == 1)
+        classifier.add_samples(data, count);
+    else
+        classifier.add_samples(lead_block.data(), count, lead_filter.stride());
+}
+// Branch the filtered leads off to the low-rate waveform stream
+void StableECGProcessor::decimate_block(const double* data, std::size_t count) {
+    const std::size_t frames = lead_count == 1
+        ? decimator.process(data, count, 1, waveform_block.data())
+        : decimator.process(lead_block.data(), count, lead_filter.stride(), waveform_block.data());
+    if (frames > 0) waveform_ring->write(waveform_block.data(), frames);
+}
+// Fetch data from buffer for processing; sleeps until the reader signals a batch
+std::size_t StableECGProcessor::fetch_data(double* out, std::size_t max) {
+    return sample_ring.pop_wait(out, max, 100);
+}
+// R-Peak detection logic; beats are timed by their sample index
+void StableECGProcessor::detect_r_peaks(const double* data, std::size_t count) {
+    if (lead_count == 1) {
+        detector.process(data, count, [this](uint64_t sample_index) { on_beat(sample_index); });
+        return;
+    }
+    // All leads feed one detector through their summed slope energy
+    const std::size_t stride = lead_filter.stride();
+    uint64_t beats[PanTompkinsDetector::MAX_BEATS_PER_SAMPLE];
+    for (std::size_t n = 0; n < count; ++n) {
+        double amplitude;
+        const double energy = lead_energy.step(lead_block.data() + n * stride, amplitude);
+        const std::size_t found = detector.step_features(energy, amplitude, beats);
+        for (std::size_t b = 0; b < found; ++b) {
+            on_beat(beats[b]);
+        }
+    }
+}
+
+// The detector works on the filtered signal; beats are reported at their
+// position in the raw signal
+void StableECGProcessor::on_beat(uint64_t sample_index) {
+    // std::cerr << "?? R-Peak Detected! Index: " << sample_index << std::endl;
+    const uint64_t delay = rate_profile.filter_delay;
+    const uint64_t r_index = sample_index > delay ? sample_index - delay : 0;
+    // Acquisition time from the recovered clock, free of serial buffering jitter
+    const double r_ms = clock.time_of(r_index) / 1e6;
+    const double rr_ms = calculator.update_r_peak(r_index, r_ms);
+    if (rr_ms > 0.0) hrv.add_interval(rr_ms, r_ms / 1000.0);
+    classifier.add_beat(sample_index);
+    beat_ring.write(&r_index, 1);
+    if (beat_callback) beat_callback(r_index);
+
+    // The R-peak sample is still stamped unless it is older than the stamp ring
+    if (r_index < arrival_end && arrival_end - r_index <= arrival_ns.size()) {
+        const uint64_t read_ns = arrival_ns[r_index & (arrival_ns.size() - 1)];
+        if (read_ns != 0) {
+            latency_histograms[static_cast<std::size_t>(LatencyStage::Beat)].record(steady_ns() - read_ns);
+        }
+    }
+}
+// Read ECG data from a serial port
+ReliableSerialReader::ReliableSerialReader(const std::string& port, StableECGProcessor& proc, SerialFormat format)
+    : processor(proc), active(false), epoll_fd(-1), shutdown_fd(-1),
+      coalesce_delay(SERIAL_COALESCE_US), format(format), tokenizer(2, proc.leads()), batch_timing{},
+      lead_count(proc.leads()),
+      samples((BUFFER_SIZE + 1) * proc.leads()), at_eof(false), parsed_count(0), parse_ns(0),
+      malformed_count(0), dropped_frame_count(0), crc_error_count(0), byte_count(0), read_count(0),
+      wakeup_count(0), uart_overrun_count(0)
 {
-    fd = ::open(port.c_str(), O_RDWR | O_NOCTTY);
+    fd = ::open(port.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
     if (fd < 0) {
         throw std::runtime_error("Failed to open serial port: " + std::string(strerror(errno)));
     }
 
+    shutdown_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (shutdown_fd < 0 || epoll_fd < 0) {
+        const std::string error = strerror(errno);
+        close_fds();
+        throw std::runtime_error("Failed to create serial reader events: " + error);
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = shutdown_fd;
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shutdown_fd, &ev);
+    ev.data.fd = fd;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (errno != EPERM) {
+            const std::string error = strerror(errno);
+            close_fds();
+            throw std::runtime_error("Failed to watch serial port: " + error);
+        }
+        // Regular file: always readable, plain reads are enough
+        ::close(epoll_fd);
+        epoll_fd = -1;
+    }
+
+    // Recordings and pipes are replayed as they are, only terminals need configuring
+    is_tty = ::isatty(fd);
+    if (!is_tty) return;
+
     struct termios tty;
     memset(&tty, 0, sizeof(tty));
     if (tcgetattr(fd, &tty) != 0) {
-        ::close(fd);
-        throw std::runtime_error("Failed to get serial attributes: " + std::string(strerror(errno)));
+        const std::string error = strerror(errno);
+        close_fds();
+        throw std::runtime_error("Failed to get serial attributes: " + error);
     }
 
+    // Reads return whatever is buffered; epoll does the waiting
     cfmakeraw(&tty);
     tty.c_cflag |= (CLOCAL | CREAD);
-    tty.c_cc[VMIN] = 1;
-    tty.c_cc[VTIME] = 1;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
     cfsetspeed(&tty, B115200);
 
     if (tcsetattr(fd, TCSANOW, &tty) != 0) {
-        ::close(fd);
-        throw std::runtime_error("Failed to set serial attributes: " + std::string(strerror(errno)));
+        const std::string error = strerror(errno);
+        close_fds();
+        throw std::runtime_error("Failed to set serial attributes: " + error);
     }
 }
 // Destructor stops reading thread and closes the serial port
 ReliableSerialReader::~ReliableSerialReader() {
     stop();
+    close_fds();
+}
+
+void ReliableSerialReader::set_coalesce_delay(std::chrono::microseconds delay) {
+    coalesce_delay = delay;
 }
 // Start serial data reading thread
 void ReliableSerialReader::start() {
     active.store(true);
     reader = std::thread(&ReliableSerialReader::reading_loop, this);
 }
-// Stop serial data reading thread
+// Stop serial data reading thread; the eventfd wakes it even if the port is silent
 void ReliableSerialReader::stop() {
     active.store(false);
+    if (shutdown_fd != -1) {
+        const uint64_t one = 1;
+        ssize_t ret = ::write(shutdown_fd, &one, sizeof(one));
+        (void)ret;
+    }
     if (reader.joinable())
         reader.join();
     if (fd != -1) {
@@ -261,67 +602,188 @@ void ReliableSerialReader::stop() {
         fd = -1;
     }
 }
-// Serial data acquisition
-void ReliableSerialReader::reading_loop() {
-    char read_buffer[BUFFER_SIZE];
-    std::string line_buffer;
-    auto last_print_time = std::chrono::steady_clock::now();  
-
-    while (active.load()) {  // Read raw bytes from serial port
-        ssize_t n = ::read(fd, read_buffer, BUFFER_SIZE);
-        // Handle read errors
-        if (n < 0) {
-            if (errno == EAGAIN) continue;
-            
-            // std::cerr << "Read error: " << strerror(errno) << std::endl;
-            break;
-        }
-        if (n == 0) continue;
 
-        line_buffer.append(read_buffer, n);  // Append new data
+void ReliableSerialReader::close_fds() {
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (epoll_fd != -1) {
+        ::close(epoll_fd);
+        epoll_fd = -1;
+    }
+    if (shutdown_fd != -1) {
+        ::close(shutdown_fd);
+        shutdown_fd = -1;
+    }
+}
+bool ReliableSerialReader::finished() const {
+    return at_eof.load();
+}
+
+uint64_t ReliableSerialReader::samples_parsed() const {
+    return parsed_count.load(std::memory_order_relaxed);
+}
 
-        size_t pos;
-        while ((pos = line_buffer.find('\n')) != std::string::npos) {
-            std::string line = line_buffer.substr(0, pos);
-            line_buffer.erase(0, pos + 1);
+uint64_t ReliableSerialReader::parse_time_ns() const {
+    return parse_ns.load(std::memory_order_relaxed);
+}
+
+uint64_t ReliableSerialReader::malformed_lines() const {
+    return malformed_count.load(std::memory_order_relaxed);
+}
+
+uint64_t ReliableSerialReader::dropped_frames() const {
+    return dropped_frame_count.load(std::memory_order_relaxed);
+}
 
-            if (!line.empty() && line.back() == '\r') 
-                line.pop_back();
-            line.erase(0, line.find_first_not_of(" \t\r\n"));
+uint64_t ReliableSerialReader::crc_errors() const {
+    return crc_error_count.load(std::memory_order_relaxed);
+}
 
-            if (line.empty()) continue;
-            // Parse CSV formatted data
-            std::istringstream iss(line);
-            std::string token;
-            std::vector<std::string> tokens;
+SerialReadStats ReliableSerialReader::read_stats() const {
+    return {byte_count.load(std::memory_order_relaxed), read_count.load(std::memory_order_relaxed),
+            wakeup_count.load(std::memory_order_relaxed), uart_overrun_count.load(std::memory_order_relaxed)};
+}
 
-            while (std::getline(iss, token, ',')) {
-                if (!token.empty()) {  
-                    tokens.push_back(token);
+EcgReading ReliableSerialReader::latest() const {
+    return reading.load();
+}
+// Hand a batch to the processor. A live port must never stall, so overflow is
+// dropped; a recording waits for the processor instead of losing samples.
+void ReliableSerialReader::deliver(const double* frames, std::size_t count) {
+    if (count == 0) return;
+    batch_timing.parsed_ns = steady_ns();
+    const uint64_t parsed = parsed_count.fetch_add(count, std::memory_order_relaxed) + count;
+    reading.store({frames[(count - 1) * lead_count], parsed, std::chrono::steady_clock::now()});
+    if (is_tty) {
+        processor.add_samples(frames, count, &batch_timing);
+        return;
+    }
+    std::size_t sent = 0;
+    while (active.load()) {
+        sent += processor.try_add_samples(frames + sent * lead_count, count - sent, &batch_timing);
+        if (sent == count) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+// Decode binary frames into interleaved samples of the leads the processor
+// uses; leads missing from a frame read as 0. If a burst of frames fills the
+// batch it is handed over early.
+std::size_t ReliableSerialReader::decode_frames(const char* data, std::size_t count,
+                                                double* out, std::size_t max_samples) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    std::size_t sample_count = 0;
+    std::size_t offset = 0;
+    EcgFrame frame;
+    while (offset < count) {
+        offset += decoder.append(bytes + offset, count - offset);
+        while (decoder.next_frame(frame)) {
+            if (sample_count + frame.samples_per_lead > max_samples) {
+                deliver(out, sample_count);
+                sample_count = 0;
+            }
+            for (std::size_t i = 0; i < frame.samples_per_lead; ++i, ++sample_count) {
+                double* values = out + sample_count * lead_count;
+                for (std::size_t lead = 0; lead < lead_count; ++lead) {
+                    values[lead] = lead < frame.leads ? frame.sample(lead, i) * ECG_VALUE_SCALE : 0.0;
                 }
             }
-            // Process ECG values
-            if (tokens.size() >= 3) {
-                std::string ecgToken = tokens[2];
-
-                try {
-                    double value = std::stod(ecgToken);
-                    value *= 0.7;
-                    
-                    // Debug output
-                    auto now = std::chrono::steady_clock::now();
-                    if (now - last_print_time >= std::chrono::seconds(2)) {
-                        std::cerr << "Converted ECG Value: " << value << std::endl;
-                        last_print_time = now;
-                    }
-                    
-                    processor.add_samples({value});
-                } catch (const std::exception& e) {
-                    
-                    // std::cerr << "? Failed to convert token: [" << ecgToken 
-                    //           << "] - " << e.what() << std::endl;
+        }
+    }
+    return sample_count;
+}
+// Sleep until the port has data or stop() is called
+bool ReliableSerialReader::wait_for_input() {
+    struct epoll_event events[2];
+    int n;
+    do {
+        n = ::epoll_wait(epoll_fd, events, 2, -1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 || !active.load()) return false;
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.fd == shutdown_fd) return false;
+    }
+    wakeup_count.fetch_add(1, std::memory_order_relaxed);
+    batch_timing.wake_ns = steady_ns();
+    // Let more bytes arrive so they are read in one go
+    if (coalesce_delay.count() > 0) {
+        std::this_thread::sleep_for(coalesce_delay);
+    }
+    return active.load();
+}
+// Parse a chunk straight out of the read buffer and hand the samples over
+void ReliableSerialReader::handle_bytes(const char* data, std::size_t count) {
+    const auto parse_start = std::chrono::steady_clock::now();
+    std::size_t sample_count;
+    if (format == SerialFormat::BinaryFrame) {
+        sample_count = decode_frames(data, count, samples.data(), BUFFER_SIZE + 1);
+        dropped_frame_count.store(decoder.dropped_frames(), std::memory_order_relaxed);
+        crc_error_count.store(decoder.crc_errors(), std::memory_order_relaxed);
+    } else {
+        sample_count = tokenizer.feed(data, count, samples.data(), BUFFER_SIZE + 1);
+        for (std::size_t i = 0; i < sample_count * lead_count; ++i) {
+            samples[i] *= ECG_VALUE_SCALE;
+        }
+        malformed_count.store(tokenizer.malformed_lines(), std::memory_order_relaxed);
+    }
+    parse_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - parse_start).count(),
+                       std::memory_order_relaxed);
+    if (sample_count > 0)
+        deliver(samples.data(), sample_count);
+}
+// Refresh the driver's overrun counters (not every serial driver has them)
+void ReliableSerialReader::update_uart_overruns() {
+    struct serial_icounter_struct icount;
+    memset(&icount, 0, sizeof(icount));
+    if (::ioctl(fd, TIOCGICOUNT, &icount) == 0) {
+        uart_overrun_count.store(static_cast<uint64_t>(icount.overrun) + icount.buf_overrun,
+                                 std::memory_order_relaxed);
+    }
+}
+// Serial data acquisition
+void ReliableSerialReader::reading_loop() {
+    char read_buffer[BUFFER_SIZE];
+    auto last_icount = std::chrono::steady_clock::now();
+    bool end_of_input = false;
+
+    while (active.load() && !end_of_input) {
+        if (epoll_fd != -1 && !wait_for_input())
+            break;
+        if (epoll_fd == -1) batch_timing.wake_ns = steady_ns();
+
+        // Drain what is buffered; a short read means the port is empty
+        while (active.load()) {
+            ssize_t n = ::read(fd, read_buffer, BUFFER_SIZE);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) {
+                    // std::cerr << "Read error: " << strerror(errno) << std::endl;
+                    end_of_input = true;
                 }
+                break;
+            }
+            if (n == 0) {
+                if (!is_tty) end_of_input = true;  // End of a recording
+                break;
+            }
+            batch_timing.read_ns = steady_ns();
+            byte_count.fetch_add(n, std::memory_order_relaxed);
+            read_count.fetch_add(1, std::memory_order_relaxed);
+            handle_bytes(read_buffer, n);
+            batch_timing.wake_ns = steady_ns();  // The next read of this drain starts now
+            if (epoll_fd != -1 && static_cast<std::size_t>(n) < BUFFER_SIZE) break;
+        }
+
+        if (is_tty) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last_icount >= std::chrono::seconds(1)) {
+                update_uart_overruns();
+                last_icount = now;
             }
         }
     }
+    if (!is_tty)
+        at_eof.store(true);
 }
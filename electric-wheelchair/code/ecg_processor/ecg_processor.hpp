@@ -15,88 +15,385 @@
 #include <unistd.h>
 #include <cstring>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include "ecg_filter.hpp"
+#include "filter_design.hpp"
+#include "sample_ring.hpp"
+#include "sliding_window.hpp"
+#include "running_median.hpp"
+#include "seqlock.hpp"
+#include "qrs_detector.hpp"
+#include "ecg_csv_parser.hpp"
+#include "ecg_frame_decoder.hpp"
+#include "hrv_analyzer.hpp"
+#include "beat_classifier.hpp"
+#include "signal_quality.hpp"
+#include "decimator.hpp"
+#include "waveform_ring.hpp"
+#include "latency_histogram.hpp"
+#include "sample_clock.hpp"
 
 // Constants for ECG processing
-constexpr double BASELINE_ALPHA = 0.99;      
 constexpr int SAMPLE_RATE = 1000;            
-constexpr int WINDOW_SECONDS = 5;           
 constexpr int BUFFER_SIZE = 256;           
+constexpr std::size_t SAMPLE_RING_CAPACITY = 4096;  // Samples queued between reader and processor
+constexpr std::size_t PROCESS_BLOCK_SIZE = 256;     // Samples handled per processing pass
+constexpr double ECG_VALUE_SCALE = 0.7;             // Raw board units to converted ECG value
+constexpr int SERIAL_COALESCE_US = 2000;            // Wait after a wakeup so bytes arrive in bulk (~23 at 115200 baud)
 
-// Class for filtering ECG signals using given filter coefficients
-class EnhancedFilter {
-public:
-    EnhancedFilter(const std::vector<double>& b, const std::vector<double>& a);
-    std::vector<double> process(const std::vector<double>& input);
-private:
-    std::vector<double> b_coeff;
-    std::vector<double> a_coeff;
-    std::vector<double> x;
-    std::vector<double> y;
+constexpr int FILTER_ORDER = 6;                     // Band-pass (two sections) followed by the mains notch
+constexpr double ECG_BAND_LOW_HZ = 5.0;             // Band-pass keeping the QRS energy (Pan-Tompkins)
+constexpr double ECG_BAND_HIGH_HZ = 15.0;
+constexpr double ECG_MAINS_HZ = 50.0;               // Power line frequency removed by the notch
+constexpr double ECG_NOTCH_Q = 30.0;
+constexpr double ECG_BASELINE_TIME_S = 0.2;         // Time constant of the baseline tracker
+constexpr std::size_t ECG_MAX_LEADS = 8;            // Leads in multi-lead mode
+static_assert(ECG_MAX_LEADS <= MultiLeadFilter<FILTER_ORDER>::MAX_LEADS && ECG_MAX_LEADS <= ECG_FRAME_MAX_LEADS,
+              "Every lead must fit the filter and the frame format");
+constexpr std::size_t HR_MEDIAN_BEATS = 7;          // Beats in the heart rate median
+constexpr int ECG_WAVEFORM_RATE_HZ = 125;           // Default rate of the display/telemetry waveform
+constexpr int ECG_WAVEFORM_SECONDS = 8;             // Raw and waveform history held for slow readers
+constexpr std::size_t ECG_BEAT_HISTORY = 64;        // R peaks held for beat marker readers
+constexpr std::size_t BATCH_MARK_CAPACITY = 256;    // Serial batches in flight with their timestamps
+
+// Filter sections for one sample rate, designed at compile time
+constexpr std::array<Biquad, FILTER_ORDER / 2> design_ecg_filter(double sample_rate) {
+    return filter_design::cascade(
+        filter_design::butterworth_bandpass<FILTER_ORDER / 2 - 1>(sample_rate, ECG_BAND_LOW_HZ, ECG_BAND_HIGH_HZ),
+        std::array<Biquad, 1>{{filter_design::notch(sample_rate, ECG_MAINS_HZ, ECG_NOTCH_Q)}});
+}
+
+// Everything in the pipeline that depends on the sample rate
+struct EcgRateProfile {
+    int sample_rate;
+    double baseline_alpha;
+    std::array<Biquad, FILTER_ORDER / 2> sections;
+    uint64_t filter_delay;  // Group delay at the band centre in samples, taken off reported beat positions
+};
+
+constexpr EcgRateProfile make_ecg_rate_profile(int sample_rate) {
+    return {sample_rate, 1.0 - 1.0 / (ECG_BASELINE_TIME_S * sample_rate), design_ecg_filter(sample_rate),
+            static_cast<uint64_t>(filter_design::group_delay(design_ecg_filter(sample_rate), sample_rate,
+                                  filter_design::sqrt(ECG_BAND_LOW_HZ * ECG_BAND_HIGH_HZ)) + 0.5)};
+}
+
+// Supported sample rates: 250 and 500 Hz for battery-saving profiles, 1000 Hz
+// (the ECG board default) and 2000 Hz for diagnostics
+constexpr std::array<EcgRateProfile, 4> ECG_RATE_PROFILES = {{
+    make_ecg_rate_profile(250),
+    make_ecg_rate_profile(500),
+    make_ecg_rate_profile(1000),
+    make_ecg_rate_profile(2000),
+}};
+
+constexpr bool ecg_rate_profiles_stable() {
+    for (const EcgRateProfile& profile : ECG_RATE_PROFILES) {
+        if (!filter_design::is_stable(profile.sections)) return false;
+    }
+    return true;
+}
+static_assert(ecg_rate_profiles_stable(), "Every ECG filter must be stable");
+
+// Profile for a supported sample rate; throws std::invalid_argument otherwise
+const EcgRateProfile& ecg_rate_profile(int sample_rate);
+
+// Time spent in each processing stage, accumulated while profiling is enabled
+struct EcgStageTimes {
+    uint64_t filter_ns;
+    uint64_t detect_ns;  // QRS feature extraction, adaptive thresholds and HR update
+    uint64_t classify_ns;  // Beat window history and morphology matching
+    uint64_t quality_ns;   // Signal quality index
+    uint64_t decimate_ns;  // Low-rate waveform for display and telemetry
+};
+
+// Pipeline stages with a latency histogram. Serial batches are timed from
+// the reader's wakeup to the published status; beats from the read of their
+// R-peak sample to the heart rate update.
+enum class LatencyStage {
+    Read,     // Wakeup to read() returning, including the coalescing delay
+    Parse,    // Bytes to samples
+    Enqueue,  // Handing the batch to the processor
+    Fetch,    // Queued until the processing thread picks up the last sample
+    Filter,   // Per block: signal quality, filtering and decimation
+    Detect,   // Per block: beat classification and QRS detection
+    Total,    // Read to status published, per batch
+    Beat      // R-peak sample read to heart rate update
+};
+constexpr std::size_t LATENCY_STAGES = 8;
+const char* latency_stage_name(LatencyStage stage);
+
+// steady_clock timestamps of one serial read, handed over with its samples
+struct BatchTiming {
+    uint64_t wake_ns;    // Reader woke up for input
+    uint64_t read_ns;    // read() returned the bytes
+    uint64_t parsed_ns;  // Samples ready
+};
+
+// Latest state of the ECG pipeline, published once per processed block
+struct EcgStatus {
+    double value;         // Last converted ECG value received
+    double filtered;      // Same sample after filtering
+    double heart_rate;    // Smoothed heart rate in bpm, 0 until known or while the signal is unusable
+    double quality;       // Signal quality score of the last block, 0..1
+    uint64_t sample_index;  // Samples processed so far, 0 before the first block
+    std::chrono::steady_clock::time_point timestamp;  // When the snapshot was taken
+};
+
+// Last converted value seen by the serial reader
+struct EcgReading {
+    double value;
+    uint64_t sample_index;  // Samples parsed so far, 0 before the first one
+    std::chrono::steady_clock::time_point timestamp;
 };
 
 // Class for calculating heart rate based on detected R-peaks
 class AdvancedHRCalculator {
 public:
-    AdvancedHRCalculator();
-    void update_r_peak();
+    // median_beats: width of the running median smoothing the heart rate
+    explicit AdvancedHRCalculator(int sample_rate = SAMPLE_RATE, std::size_t median_beats = HR_MEDIAN_BEATS);
+    // Register an R peak found at the given sample index. Returns the RR
+    // interval in ms if it was accepted into the heart rate, otherwise 0.
+    double update_r_peak(uint64_t sample_index);
+    // As above with the peak's acquisition time in ms, so the interval comes
+    // from the recovered sample clock rather than the nominal rate
+    double update_r_peak(uint64_t sample_index, double time_ms);
+    // Lock-free; never blocks the detector
     double get_heart_rate() const;
     void reset_state();
 private:
-    mutable std::mutex data_mutex;
-    std::chrono::system_clock::time_point last_peak_time;
-    std::deque<double> hr_buffer;
-    double last_valid_hr;
-    int noise_count;
-    const int qrs_window;    // Window size for QRS detection (in ms)
+    std::mutex data_mutex;  // Serialises writers only
+    const int sample_rate;
+    bool has_last_peak;
+    uint64_t last_peak_index;  // Sample index of the previous accepted R peak
+    double last_peak_ms;       // and its acquisition time
+    RunningMedian<double> hr_median;
+    std::atomic<double> last_valid_hr;
+    int noise_count;         // Consecutive beats rejected as sudden HR jumps
     const int min_interval;  // Minimum interval between peaks (in ms)
 };
 
-// Class for processing ECG data in real-time
+// Class for processing ECG data in real-time.
+// The sample rate must be one of ECG_RATE_PROFILES; filters, detector timing
+// and heart rate all follow it. Each block is scored for signal quality first,
+// and QRS detection is suspended while the electrodes are off, the input is
+// clipped or the signal is swamped by noise.
+// With more than one lead, samples are frames of leads() interleaved values
+// (one per lead). All leads are filtered together with SIMD (MultiLeadFilter)
+// and share one QRS detector fed with their combined slope energy; the
+// published value and filtered sample are those of the first lead, which is
+// also the lead used for beat classification.
+// The filtered leads are also decimated (by default to ECG_WAVEFORM_RATE_HZ)
+// into waveform(), the stream for the dashboard, recordings and network
+// clients; only QRS detection and classification run at the full rate.
 class StableECGProcessor {
 public:
-    StableECGProcessor();
+    explicit StableECGProcessor(std::size_t leads = 1, int sample_rate = SAMPLE_RATE);
     ~StableECGProcessor();
     void start();
     void stop();
+    // Queue count samples (frames in multi-lead mode); what does not fit is
+    // dropped. timing, if given, feeds the latency histograms.
+    void add_samples(const double* samples, std::size_t count, const BatchTiming* timing = nullptr);
     void add_samples(const std::vector<double>& samples);
+    // Queue as many samples as fit without counting the rest as dropped;
+    // returns how many were queued (used for back-pressure on recorded input)
+    std::size_t try_add_samples(const double* samples, std::size_t count, const BatchTiming* timing = nullptr);
+    // Run samples through the pipeline on the calling thread. Use this instead
+    // of start()/add_samples() to process recorded data faster than real time.
+    void process_samples(const double* samples, std::size_t count);
+    std::size_t leads() const;
+    int sample_rate() const;
     double current_hr() const;
+    // Lock-free snapshot of the latest value and heart rate, safe from any thread
+    EcgStatus latest() const;
+    // Heart rate variability over the recent accepted beats
+    HrvMetrics hrv_metrics() const;
+    // Beat classification counts and rhythm irregularity
+    RhythmStatus rhythm() const;
+    // Quality of the last block and whether QRS detection is running
+    SignalQuality signal_quality() const;
+    // Number of samples that have gone through the pipeline
+    uint64_t samples_processed() const;
+    // Samples dropped because the processing thread fell behind
+    uint64_t dropped_samples() const;
+    // Called on the processing thread with the sample index of every R peak
+    // (corrected for the filter delay). Set before start().
+    void set_beat_callback(std::function<void(uint64_t)> callback);
+    // Called on the processing thread for every classified beat, shortly after
+    // its R peak (once the samples following it have been filtered). Set before start().
+    void set_beat_class_callback(std::function<void(const BeatInfo&)> callback);
+    // Decimation ratio of the waveform stream, 1 to DECIMATOR_MAX_RATIO;
+    // resets the stream. Set before start().
+    void set_waveform_ratio(std::size_t ratio);
+    std::size_t waveform_ratio() const;
+    double waveform_rate() const;
+    // Filtered leads at waveform_rate(), frames of leads() values
+    const WaveformRing& waveform() const;
+    // Input samples at the full rate as they enter the pipeline, frames of
+    // leads() values indexed by sample index (for recording)
+    const WaveformRing& raw() const;
+    // Raw sample index (fractional) at the centre of a waveform frame, after
+    // the delays of the ECG filter and the decimator
+    double waveform_sample_index(uint64_t frame) const;
+    // Waveform frame whose centre is nearest a raw sample index
+    uint64_t waveform_frame(uint64_t sample_index) const;
+    // Sample index of every R peak (as given to the beat callback), for
+    // readers marking beats on the waveform
+    const BroadcastRing<uint64_t>& beats() const;
+    void set_profiling(bool enabled);
+    EcgStageTimes stage_times() const;
+    // Latency histograms, always recorded; safe to read from any thread
+    const LatencyHistogram& latency(LatencyStage stage) const;
+    // Table of count, percentiles and maximum per stage, in microseconds
+    void write_latency_report(std::ostream& out) const;
+    void reset_latency();
+    // ADC clock recovered from the serial batch arrivals; R-R intervals use it
+    SampleClockStatus sample_clock() const;
 private:
+    // Serial batch timing travelling one step ahead of its samples
+    struct BatchMark {
+        BatchTiming timing;     // All zero when the producer gave none
+        uint64_t queued_ns;
+        uint64_t end_index;     // Samples queued up to the end of the batch
+    };
+
     void processing_loop();
-    std::vector<double> fetch_data();
-    void update_thresholds(const std::vector<double>& window);
-    void detect_r_peaks(const std::vector<double>& data);
+    std::size_t fetch_data(double* out, std::size_t max);
+    void process_block(double* data, std::size_t count);
+    void filter_block(double* data, std::size_t count);
+    void classify_block(const double* data, std::size_t count);
+    void decimate_block(const double* data, std::size_t count);
+    bool gate_detection(const double* data, std::size_t count, uint64_t first_index);
+    void detect_r_peaks(const double* data, std::size_t count);
+    void on_beat(uint64_t sample_index);
+    void track_batches(uint64_t first_index, std::size_t count, uint64_t fetched_ns);
+    void finish_batches(uint64_t published_ns);
     
-    EnhancedFilter filter;  // Filter for preprocessing ECG signals
+    const std::size_t lead_count;
+    const EcgRateProfile& rate_profile;
+    EnhancedFilter<FILTER_ORDER> filter;  // Filter for preprocessing ECG signals
+    MultiLeadFilter<FILTER_ORDER> lead_filter;  // Multi-lead mode: all leads at once
+    LeadSlopeEnergy lead_energy;      // Multi-lead mode: fused QRS detection input
+    PanTompkinsDetector detector;     // QRS detection on the filtered signal
     AdvancedHRCalculator calculator;  // Heart rate calculation module
+    HRVAnalyzer hrv;                  // HRV metrics; spectrum runs on its own thread
+    BeatClassifier classifier;        // Beat morphology and rhythm
+    SignalQualityIndex quality_index; // Suspends detection on lead-off, clipping or noise
+    PolyphaseDecimator decimator;     // Filtered leads down to the waveform rate
+    std::unique_ptr<WaveformRing> waveform_ring;
+    std::vector<double> waveform_block;  // Decimator output for one block
+    BroadcastRing<uint64_t> beat_ring;
+    WaveformRing raw_ring;
+    SampleClock clock;                // Acquisition time of each sample
     std::atomic<bool> active;
     std::thread processor;
-    std::mutex buffer_mutex;
-    std::condition_variable data_ready;
-    std::vector<double> circular_buffer;
-    
-    // Members for adaptive thresholding
-    double noise_peak;
-    double signal_peak;
-    // To prevent duplicate detection of the same R peak (refractory mechanism)
-    size_t last_peak_index;
-    
-    double threshold_low;
-    double threshold_high;
+    SpscRing<double, SAMPLE_RING_CAPACITY> sample_ring;  // Reader -> processor handoff
+    std::vector<double> block;  // Working buffer for one processing pass
+    std::vector<double> lead_block;  // Multi-lead mode: block padded to lead_filter.stride()
+    std::atomic<uint64_t> processed_count;
+    std::atomic<uint64_t> dropped_count;
+    std::function<void(uint64_t)> beat_callback;
+    std::atomic<bool> profiling;
+    std::atomic<uint64_t> filter_ns;
+    std::atomic<uint64_t> detect_ns;
+    std::atomic<uint64_t> classify_ns;
+    std::atomic<uint64_t> quality_ns;
+    std::atomic<uint64_t> decimate_ns;
+    SeqLock<EcgStatus> status;
+    SeqLock<SignalQuality> quality_status;
+    // Latency tracking
+    std::array<LatencyHistogram, LATENCY_STAGES> latency_histograms;
+    SpscRing<BatchMark, BATCH_MARK_CAPACITY> mark_ring;  // Producer -> processor, pushed before the samples
+    uint64_t queued_count;  // Producer side: samples queued so far
+    BatchMark pending_mark;
+    bool have_mark;
+    std::vector<uint64_t> arrival_ns;  // Read time of recent samples by index, 0 if unknown
+    uint64_t arrival_end;              // Samples stamped so far
+    std::array<uint64_t, BATCH_MARK_CAPACITY> finished_read_ns;  // Batches completed by the current block
+    std::size_t finished_count;
+};
+
+// Serial input counters
+struct SerialReadStats {
+    uint64_t bytes;          // Bytes read from the port
+    uint64_t reads;          // read() calls that returned data
+    uint64_t wakeups;        // Times the reading thread woke up for input
+    uint64_t uart_overruns;  // Driver-reported UART/buffer overruns (0 if not supported)
+};
+
+// Wire format spoken by the ECG board
+enum class SerialFormat {
+    AsciiCsv,     // "a,b,ecg" text lines
+    BinaryFrame   // Framed int16 samples with sequence number and CRC (see ecg_frame_decoder.hpp)
 };
 
-// Class for reading ECG data from a serial port
+// Class for reading ECG data from a serial port.
+// As many leads are extracted as the processor expects: consecutive CSV
+// columns starting at the third, or the first leads of each binary frame.
+// The port is read without blocking: the reading thread sleeps in epoll on the
+// port and a shutdown eventfd, so stop() returns promptly even when the device
+// is silent. After each wakeup it waits for the coalescing delay so that one
+// read picks up a batch of bytes instead of one wakeup per byte.
+// The port may also be a pty or a recorded file: files are read as fast as
+// the processor accepts them and reading stops at end of file.
 class ReliableSerialReader {
 public:
-    ReliableSerialReader(const std::string& port, StableECGProcessor& proc);
+    ReliableSerialReader(const std::string& port, StableECGProcessor& proc,
+                         SerialFormat format = SerialFormat::AsciiCsv);
     ~ReliableSerialReader();
+    // Delay between a wakeup and the read; 0 reads as soon as data arrives.
+    // Trades latency for fewer wakeups. Set before start().
+    void set_coalesce_delay(std::chrono::microseconds delay);
     void start();
     void stop();
+    // True once a recorded (non-terminal) source has been read to the end
+    bool finished() const;
+    uint64_t samples_parsed() const;
+    // Time spent turning received bytes into samples
+    uint64_t parse_time_ns() const;
+    // Lines that did not contain a readable ECG value
+    uint64_t malformed_lines() const;
+    // Binary mode: frames missing from the sequence, and frames failing CRC
+    uint64_t dropped_frames() const;
+    uint64_t crc_errors() const;
+    SerialReadStats read_stats() const;
+    // Lock-free snapshot of the most recently parsed value
+    EcgReading latest() const;
 private:
     void reading_loop();  // Reads data continuously from the serial port
+    bool wait_for_input();  // False on shutdown
+    void handle_bytes(const char* data, std::size_t count);
+    void update_uart_overruns();
+    void close_fds();
+    std::size_t decode_frames(const char* data, std::size_t count, double* out, std::size_t max_samples);
+    void deliver(const double* frames, std::size_t count);
     StableECGProcessor& processor;
     std::atomic<bool> active;
     int fd;
+    bool is_tty;
+    int epoll_fd;      // -1 for regular files, which epoll cannot watch
+    int shutdown_fd;   // eventfd written by stop()
+    std::chrono::microseconds coalesce_delay;
     std::thread reader;
+    SerialFormat format;
+    EcgCsvTokenizer tokenizer;  // Used only by the reading thread
+    EcgFrameDecoder decoder;    // Used only by the reading thread
+    BatchTiming batch_timing;   // Timestamps of the current read, used only by the reading thread
+    std::size_t lead_count;
+    std::vector<double> samples;  // Values parsed from one read, handed over as a single batch
+    std::atomic<bool> at_eof;
+    std::atomic<uint64_t> parsed_count;
+    std::atomic<uint64_t> parse_ns;
+    std::atomic<uint64_t> malformed_count;
+    std::atomic<uint64_t> dropped_frame_count;
+    std::atomic<uint64_t> crc_error_count;
+    std::atomic<uint64_t> byte_count;
+    std::atomic<uint64_t> read_count;
+    std::atomic<uint64_t> wakeup_count;
+    std::atomic<uint64_t> uart_overrun_count;
+    SeqLock<EcgReading> reading;
 };
 
 #endif 
@@ -0,0 +1,424 @@
+#include "ecg_recording.hpp"
+#include "delta_codec.hpp"
+#include "ecg_frame_decoder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Recording structures are written in host byte order");
+
+namespace {
+
+constexpr char FILE_MAGIC[8] = {'E', 'C', 'G', 'R', 'E', 'C', '0', '1'};
+constexpr uint32_t BLOCK_MAGIC = 0x4B4C4245;  // "EBLK"
+constexpr uint32_t INDEX_MAGIC = 0x58444945;  // "EIDX"
+
+struct FileHeader {
+    char magic[8];
+    uint32_t sample_rate;
+    uint16_t leads;
+    uint16_t waveform_ratio;
+    double step;
+    int64_t start_ns;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint8_t stream;
+    uint8_t reserved;
+    uint16_t crc;
+    uint32_t frames;
+    uint32_t payload_bytes;
+    uint64_t first_index;
+    int64_t timestamp_ns;
+};
+
+struct IndexRecord {
+    uint64_t offset;
+    uint64_t first_index;
+    int64_t timestamp_ns;
+    uint32_t stream;
+    uint32_t frames;
+};
+
+struct Footer {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t index_offset;
+};
+
+static_assert(sizeof(FileHeader) == 32 && sizeof(BlockHeader) == 32 && sizeof(IndexRecord) == 32 &&
+              sizeof(Footer) == 16, "Recording structures must have no padding");
+
+template <typename T>
+void append(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+int64_t unix_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::size_t stream_number(RecordingStream stream) {
+    return static_cast<std::size_t>(stream);
+}
+
+}  // namespace
+
+// Record from the processor's current position onwards
+EcgRecorder::EcgRecorder(const StableECGProcessor& proc, const std::string& path)
+    : processor(proc), lead_count(proc.leads()), file_offset(0), active(false), written(0)
+{
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create recording " + path + ": " + strerror(errno));
+    }
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.sample_rate = static_cast<uint32_t>(processor.sample_rate());
+    header.leads = static_cast<uint16_t>(lead_count);
+    header.waveform_ratio = static_cast<uint16_t>(processor.waveform_ratio());
+    header.step = RECORDING_STEP;
+    header.start_ns = unix_ns();
+    append(out, header);
+
+    pending[stream_number(RecordingStream::Raw)].cursor = processor.raw().end();
+    pending[stream_number(RecordingStream::Filtered)].cursor = processor.waveform().end();
+    for (std::size_t s = 0; s < RECORDING_STREAMS; ++s) {
+        recorded[s].store(0);
+        lost[s].store(0);
+    }
+    scratch.resize(RECORDING_BLOCK_FRAMES * lead_count);
+    write_out();
+}
+
+EcgRecorder::~EcgRecorder() {
+    stop();
+}
+
+void EcgRecorder::start() {
+    active.store(true);
+    recorder = std::thread(&EcgRecorder::recording_loop, this);
+}
+
+void EcgRecorder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        active.store(false);
+    }
+    wake.notify_all();
+    if (recorder.joinable())
+        recorder.join();
+    finish();
+}
+
+void EcgRecorder::poll() {
+    std::lock_guard<std::mutex> lock(poll_mutex);
+    collect();
+    if (out.size() >= RECORDING_WRITE_BYTES) write_out();
+}
+
+uint64_t EcgRecorder::frames_recorded(RecordingStream stream) const {
+    return recorded[stream_number(stream)].load(std::memory_order_relaxed);
+}
+
+uint64_t EcgRecorder::frames_lost(RecordingStream stream) const {
+    return lost[stream_number(stream)].load(std::memory_order_relaxed);
+}
+
+uint64_t EcgRecorder::bytes_written() const {
+    return written.load(std::memory_order_relaxed);
+}
+
+void EcgRecorder::recording_loop() {
+    while (active.load()) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait_for(lock, std::chrono::milliseconds(RECORDING_POLL_MS), [this] { return !active.load(); });
+        }
+        poll();
+    }
+}
+// Both streams; a filtered block covers the same time as a raw block
+void EcgRecorder::collect() {
+    if (fd < 0) return;
+    const std::size_t ratio = processor.waveform_ratio();
+    poll_stream(RecordingStream::Raw, processor.raw(), processor.sample_rate(), RECORDING_BLOCK_FRAMES);
+    poll_stream(RecordingStream::Filtered, processor.waveform(), processor.waveform_rate(),
+                std::max<std::size_t>(1, RECORDING_BLOCK_FRAMES / ratio));
+}
+// Move new frames into the stream's pending block. The wall-clock time of the
+// first frame after a gap (or of the recording) is estimated from how far it
+// is behind the live end; from there on blocks follow the sample clock.
+void EcgRecorder::poll_stream(RecordingStream stream, const WaveformRing& ring, double rate,
+                              std::size_t block_frames) {
+    Pending& p = pending[stream_number(stream)];
+    for (;;) {
+        const uint64_t end = ring.end();
+        uint64_t missed = 0;
+        const std::size_t n = ring.read(p.cursor, scratch.data(), scratch.size() / lead_count, &missed);
+        if (missed > 0) {
+            lost[stream_number(stream)].fetch_add(missed, std::memory_order_relaxed);
+            if (!p.frames.empty()) emit_block(stream, p.frames.size() / lead_count, rate);
+        }
+        if (n == 0) break;
+        const uint64_t first = p.cursor - n;
+        if (p.frames.empty() && (p.blocks == 0 || first != p.first_index)) {
+            p.first_index = first;
+            p.first_ns = unix_ns() - static_cast<int64_t>((end > first ? end - first : 0) * 1e9 / rate);
+        }
+        p.frames.insert(p.frames.end(), scratch.begin(), scratch.begin() + n * lead_count);
+        while (p.frames.size() >= block_frames * lead_count) emit_block(stream, block_frames, rate);
+    }
+}
+// Encode the first frames of the pending block; every
+// RECORDING_INDEX_STRIDE-th block of the stream gets an index entry
+void EcgRecorder::emit_block(RecordingStream stream, std::size_t frames, double rate) {
+    Pending& p = pending[stream_number(stream)];
+    std::string payload;
+    std::vector<int64_t> previous(lead_count, 0);
+    delta_codec::encode(payload, p.frames.data(), frames, lead_count, RECORDING_STEP, previous.data());
+
+    BlockHeader header{};
+    header.magic = BLOCK_MAGIC;
+    header.stream = static_cast<uint8_t>(stream);
+    header.crc = ecg_frame_crc16(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+    header.frames = static_cast<uint32_t>(frames);
+    header.payload_bytes = static_cast<uint32_t>(payload.size());
+    header.first_index = p.first_index;
+    header.timestamp_ns = p.first_ns;
+    if (p.blocks++ % RECORDING_INDEX_STRIDE == 0) {
+        append(index_records, IndexRecord{file_offset + out.size(), p.first_index, p.first_ns,
+                                          static_cast<uint32_t>(stream), header.frames});
+    }
+    append(out, header);
+    out += payload;
+
+    p.frames.erase(p.frames.begin(), p.frames.begin() + frames * lead_count);
+    p.first_index += frames;
+    p.first_ns += static_cast<int64_t>(frames * 1e9 / rate);
+    recorded[stream_number(stream)].fetch_add(frames, std::memory_order_relaxed);
+}
+// One write per batch, then make it durable; on a write error the recording
+// ends there (what is on the card stays readable without the index)
+void EcgRecorder::write_out() {
+    if (fd < 0 || out.empty()) return;
+    std::size_t done = 0;
+    while (done < out.size()) {
+        const ssize_t n = ::write(fd, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            std::cerr << "Recording stopped, write failed: " << strerror(errno) << std::endl;
+            ::close(fd);
+            fd = -1;
+            break;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    if (fd >= 0) ::fdatasync(fd);
+    file_offset += done;
+    written.fetch_add(done, std::memory_order_relaxed);
+    out.clear();
+}
+
+void EcgRecorder::finish() {
+    std::lock_guard<std::mutex> lock(poll_mutex);
+    if (fd < 0) return;
+    collect();
+    for (std::size_t s = 0; s < RECORDING_STREAMS; ++s) {
+        const RecordingStream stream = static_cast<RecordingStream>(s);
+        const double rate = stream == RecordingStream::Raw ? processor.sample_rate() : processor.waveform_rate();
+        if (!pending[s].frames.empty()) emit_block(stream, pending[s].frames.size() / lead_count, rate);
+    }
+    const uint64_t index_offset = file_offset + out.size();
+    out += index_records;
+    append(out, Footer{INDEX_MAGIC, static_cast<uint32_t>(index_records.size() / sizeof(IndexRecord)), index_offset});
+    write_out();
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+// Map the file and load its index, or rebuild one from the block headers
+EcgRecording::EcgRecording(const std::string& path)
+    : data(nullptr), size(0), corrupt_count(0)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open recording " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Not an ECG recording: " + path);
+    }
+    size = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Failed to map recording " + path + ": " + strerror(errno));
+    }
+    data = static_cast<const uint8_t*>(map);
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header.leads == 0 ||
+        header.sample_rate == 0 || header.waveform_ratio == 0 || !(header.step > 0.0)) {
+        ::munmap(map, size);
+        throw std::runtime_error("Not an ECG recording: " + path);
+    }
+    lead_count = header.leads;
+    sample_hz = static_cast<int>(header.sample_rate);
+    ratio = header.waveform_ratio;
+    step = header.step;
+    start_ns = header.start_ns;
+
+    Footer footer{};
+    if (size >= sizeof(FileHeader) + sizeof(Footer)) std::memcpy(&footer, data + size - sizeof(Footer), sizeof(footer));
+    has_footer = footer.magic == INDEX_MAGIC && footer.index_offset >= sizeof(FileHeader) &&
+                 footer.index_offset + uint64_t(footer.count) * sizeof(IndexRecord) + sizeof(Footer) == size;
+    data_end = has_footer ? static_cast<std::size_t>(footer.index_offset) : size;
+    Block block;
+    if (has_footer) {
+        for (uint32_t i = 0; i < footer.count; ++i) {
+            IndexRecord record;
+            std::memcpy(&record, data + footer.index_offset + i * sizeof(IndexRecord), sizeof(record));
+            if (record.stream < RECORDING_STREAMS && block_at(record.offset, block)) {
+                entries[record.stream].push_back(block);
+            }
+        }
+    } else {
+        // Walk every block header up to the first damaged or unfinished one
+        uint64_t offset = sizeof(FileHeader);
+        std::size_t blocks[RECORDING_STREAMS] = {};
+        while (block_at(offset, block)) {
+            const std::size_t s = stream_number(block.stream);
+            if (blocks[s]++ % RECORDING_INDEX_STRIDE == 0) entries[s].push_back(block);
+            offset += sizeof(BlockHeader) + block.payload_bytes;
+        }
+        data_end = static_cast<std::size_t>(offset);
+    }
+    for (std::size_t s = 0; s < RECORDING_STREAMS; ++s) {
+        if (entries[s].empty()) continue;
+        last[s] = entries[s].back();
+        while (next_block(static_cast<RecordingStream>(s), last[s].offset + sizeof(BlockHeader) + last[s].payload_bytes,
+                          block)) {
+            last[s] = block;
+        }
+    }
+}
+
+EcgRecording::~EcgRecording() {
+    if (data) ::munmap(const_cast<uint8_t*>(data), size);
+}
+
+double EcgRecording::rate(RecordingStream stream) const {
+    return stream == RecordingStream::Raw ? sample_hz : static_cast<double>(sample_hz) / ratio;
+}
+
+uint64_t EcgRecording::begin(RecordingStream stream) const {
+    const std::vector<Block>& index = entries[stream_number(stream)];
+    return index.empty() ? 0 : index.front().first_index;
+}
+
+uint64_t EcgRecording::end(RecordingStream stream) const {
+    const std::size_t s = stream_number(stream);
+    return entries[s].empty() ? 0 : last[s].first_index + last[s].frames;
+}
+
+uint64_t EcgRecording::index_at(RecordingStream stream, int64_t unix_ns) const {
+    const std::vector<Block>& index = entries[stream_number(stream)];
+    if (index.empty()) return 0;
+    auto after = std::upper_bound(index.begin(), index.end(), unix_ns,
+                                  [](int64_t t, const Block& b) { return t < b.timestamp_ns; });
+    Block block = after == index.begin() ? index.front() : *(after - 1);
+    Block next;
+    while (next_block(stream, block.offset + sizeof(BlockHeader) + block.payload_bytes, next) &&
+           next.timestamp_ns <= unix_ns) {
+        block = next;
+    }
+    const double offset = (unix_ns - block.timestamp_ns) * 1e-9 * rate(stream);
+    if (offset <= 0.0) return block.first_index;
+    return block.first_index + std::min<uint64_t>(static_cast<uint64_t>(offset + 0.5), block.frames);
+}
+
+uint64_t EcgRecording::replay(RecordingStream stream, uint64_t first, uint64_t last_index,
+                              const std::function<void(uint64_t, const double*, std::size_t)>& sink) const {
+    Block block;
+    if (first >= last_index || !seek(stream, first, block)) return 0;
+    std::vector<double> frames;
+    std::vector<int64_t> previous(lead_count);
+    uint64_t delivered = 0;
+    while (block.first_index < last_index) {
+        const uint8_t* payload = data + block.offset + sizeof(BlockHeader);
+        frames.clear();
+        std::fill(previous.begin(), previous.end(), 0);
+        if (ecg_frame_crc16(payload, block.payload_bytes) != block.crc ||
+            delta_codec::decode(payload, block.payload_bytes, lead_count, step, previous.data(), frames) != block.frames) {
+            corrupt_count.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            const uint64_t from = std::max(first, block.first_index);
+            const uint64_t to = std::min<uint64_t>(last_index, block.first_index + block.frames);
+            if (from < to) {
+                sink(from, frames.data() + (from - block.first_index) * lead_count, static_cast<std::size_t>(to - from));
+                delivered += to - from;
+            }
+        }
+        if (!next_block(stream, block.offset + sizeof(BlockHeader) + block.payload_bytes, block)) break;
+    }
+    return delivered;
+}
+
+uint64_t EcgRecording::replay_into(StableECGProcessor& processor, uint64_t first, uint64_t last_index) const {
+    if (processor.leads() != lead_count || processor.sample_rate() != sample_hz) {
+        throw std::invalid_argument("Processor does not match the recording's leads and sample rate");
+    }
+    return replay(RecordingStream::Raw, first, last_index, [&processor](uint64_t, const double* frames, std::size_t n) {
+        processor.process_samples(frames, n);
+    });
+}
+
+bool EcgRecording::block_at(uint64_t offset, Block& block) const {
+    if (offset + sizeof(BlockHeader) > data_end) return false;
+    BlockHeader header;
+    std::memcpy(&header, data + offset, sizeof(header));
+    if (header.magic != BLOCK_MAGIC || header.stream >= RECORDING_STREAMS || header.frames == 0 ||
+        offset + sizeof(BlockHeader) + header.payload_bytes > data_end) {
+        return false;
+    }
+    block = {offset, header.first_index, header.timestamp_ns, header.frames, header.payload_bytes, header.crc,
+             static_cast<RecordingStream>(header.stream)};
+    return true;
+}
+
+bool EcgRecording::next_block(RecordingStream stream, uint64_t offset, Block& block) const {
+    Block candidate;
+    while (block_at(offset, candidate)) {
+        if (candidate.stream == stream) {
+            block = candidate;
+            return true;
+        }
+        offset += sizeof(BlockHeader) + candidate.payload_bytes;
+    }
+    return false;
+}
+
+bool EcgRecording::seek(RecordingStream stream, uint64_t index, Block& block) const {
+    const std::vector<Block>& entries_for = entries[stream_number(stream)];
+    if (entries_for.empty()) return false;
+    auto after = std::upper_bound(entries_for.begin(), entries_for.end(), index,
+                                  [](uint64_t i, const Block& b) { return i < b.first_index; });
+    block = after == entries_for.begin() ? entries_for.front() : *(after - 1);
+    while (block.first_index + block.frames <= index) {
+        if (!next_block(stream, block.offset + sizeof(BlockHeader) + block.payload_bytes, block)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,165 @@
+#ifndef ECG_RECORDING_HPP
+#define ECG_RECORDING_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ecg_processor.hpp"
+
+constexpr double RECORDING_STEP = 0.01;                 // Quantization; exact for the board's 0.7 unit steps
+constexpr std::size_t RECORDING_BLOCK_FRAMES = 1024;    // Raw frames per block (filtered blocks span the same time)
+constexpr std::size_t RECORDING_INDEX_STRIDE = 16;      // Blocks per stream between index entries
+constexpr std::size_t RECORDING_WRITE_BYTES = 64 * 1024;  // Encoded data gathered before each write
+constexpr int RECORDING_POLL_MS = 500;                  // Well inside the processor's ECG_WAVEFORM_SECONDS history
+
+// ECG recording file, all fields little-endian:
+//   header   32 bytes  "ECGREC01", sample rate, leads, waveform ratio, step,
+//                      start time (Unix ns)
+//   blocks   32-byte header (stream, frame count, payload size, CRC-16 of the
+//            payload, index of the first frame, Unix time of the first frame
+//            in ns) and a payload of delta_codec frames, self-contained so
+//            any block decodes on its own
+//   index    one entry per RECORDING_INDEX_STRIDE blocks of each stream
+//            (file offset, first frame, time), then a 16-byte footer
+// Streams are the raw input at the sample rate and the filtered waveform at
+// the waveform rate, each indexed from the start of the processor. A frame
+// index that jumps between blocks marks samples the recorder missed. The
+// index and footer are written on stop(); a file without them (power lost
+// while recording) is read by walking the block headers instead.
+enum class RecordingStream : uint8_t { Raw = 0, Filtered = 1 };
+constexpr std::size_t RECORDING_STREAMS = 2;
+
+// Records the raw and filtered ECG of a StableECGProcessor to disk on its own
+// thread. It only reads the processor's broadcast rings, so the acquisition
+// and processing threads never wait on the SD card; if the recorder falls
+// more than ECG_WAVEFORM_SECONDS behind, the samples it missed are left out.
+// Encoded blocks are gathered into RECORDING_WRITE_BYTES writes to keep the
+// card's write amplification down.
+class EcgRecorder {
+public:
+    // Creates (or truncates) path and writes the file header
+    EcgRecorder(const StableECGProcessor& proc, const std::string& path);
+    ~EcgRecorder();
+    EcgRecorder(const EcgRecorder&) = delete;
+    EcgRecorder& operator=(const EcgRecorder&) = delete;
+
+    // Poll the processor every RECORDING_POLL_MS on a background thread
+    void start();
+    // Stops the thread, records what is left and writes the index; the file
+    // is complete afterwards
+    void stop();
+    // Collect new frames from the processor; start() calls this periodically,
+    // or call it directly after process_samples() when recording offline
+    void poll();
+
+    uint64_t frames_recorded(RecordingStream stream) const;
+    uint64_t frames_lost(RecordingStream stream) const;
+    uint64_t bytes_written() const;
+
+private:
+    // One stream's frames waiting to fill a block
+    struct Pending {
+        uint64_t cursor = 0;
+        std::vector<double> frames;
+        uint64_t first_index = 0;
+        int64_t first_ns = 0;
+        uint64_t blocks = 0;
+    };
+
+    void recording_loop();
+    void poll_stream(RecordingStream stream, const WaveformRing& ring, double rate, std::size_t block_frames);
+    void emit_block(RecordingStream stream, std::size_t frames, double rate);
+    void collect();
+    void write_out();
+    void finish();
+
+    const StableECGProcessor& processor;
+    const std::size_t lead_count;
+    int fd;
+    std::vector<double> scratch;
+    Pending pending[RECORDING_STREAMS];
+    std::string out;            // Encoded blocks not yet written
+    uint64_t file_offset;       // Bytes written to the file so far
+    std::string index_records;  // Written after the blocks on stop()
+    std::mutex poll_mutex;      // poll() from the thread or the owner, one at a time
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> active;
+    std::thread recorder;
+    std::atomic<uint64_t> recorded[RECORDING_STREAMS];
+    std::atomic<uint64_t> lost[RECORDING_STREAMS];
+    std::atomic<uint64_t> written;
+};
+
+// Read-only view of a recording through a memory map. Seeks use the sparse
+// index (binary search, then a walk of at most RECORDING_INDEX_STRIDE blocks),
+// and only the blocks that are read are paged in, so any time range of a
+// 24 hour recording is reached in microseconds.
+class EcgRecording {
+public:
+    // Throws std::runtime_error if the file cannot be mapped or is not a recording
+    explicit EcgRecording(const std::string& path);
+    ~EcgRecording();
+    EcgRecording(const EcgRecording&) = delete;
+    EcgRecording& operator=(const EcgRecording&) = delete;
+
+    std::size_t leads() const { return lead_count; }
+    int sample_rate() const { return sample_hz; }
+    std::size_t waveform_ratio() const { return ratio; }
+    double rate(RecordingStream stream) const;
+    int64_t start_time_ns() const { return start_ns; }
+    // False if the index was rebuilt from the block headers
+    bool complete() const { return has_footer; }
+    // Frame indices held: [begin, end), possibly with gaps
+    uint64_t begin(RecordingStream stream) const;
+    uint64_t end(RecordingStream stream) const;
+    // Frame recorded nearest a wall-clock time (Unix ns)
+    uint64_t index_at(RecordingStream stream, int64_t unix_ns) const;
+    // Deliver the frames in [first, last) in order, in runs of consecutive
+    // frames of at most one block (sink gets the index of the run's first
+    // frame). Missing and corrupt blocks are skipped. Returns the frames delivered.
+    uint64_t replay(RecordingStream stream, uint64_t first, uint64_t last,
+                    const std::function<void(uint64_t index, const double* frames, std::size_t count)>& sink) const;
+    // Replay the raw input over [first, last) through a processor, as if
+    // the samples were arriving again
+    uint64_t replay_into(StableECGProcessor& processor, uint64_t first, uint64_t last) const;
+    uint64_t corrupt_blocks() const { return corrupt_count.load(std::memory_order_relaxed); }
+
+private:
+    struct Block {
+        uint64_t offset;
+        uint64_t first_index;
+        int64_t timestamp_ns;
+        uint32_t frames;
+        uint32_t payload_bytes;
+        uint16_t crc;
+        RecordingStream stream;
+    };
+
+    bool block_at(uint64_t offset, Block& block) const;
+    // Next block of stream at or after offset
+    bool next_block(RecordingStream stream, uint64_t offset, Block& block) const;
+    // First block of stream that ends after index (or the first block at all)
+    bool seek(RecordingStream stream, uint64_t index, Block& block) const;
+
+    const uint8_t* data;
+    std::size_t size;
+    std::size_t data_end;  // Blocks end here
+    std::size_t lead_count;
+    int sample_hz;
+    std::size_t ratio;
+    double step;
+    int64_t start_ns;
+    bool has_footer;
+    std::vector<Block> entries[RECORDING_STREAMS];  // Sparse index per stream
+    Block last[RECORDING_STREAMS];                  // Valid if entries is not empty
+    mutable std::atomic<uint64_t> corrupt_count;
+};
+
+#endif // ECG_RECORDING_HPP
@@ -0,0 +1,71 @@
+#include "ecg_stream.hpp"
+#include "delta_codec.hpp"
+#include <algorithm>
+#include <sstream>
+
+// Start a little before the live end so a new client has a trace to draw;
+// R peaks already inside that backlog go out with the first event
+EcgStream::EcgStream(const StableECGProcessor& processor, int backlog_ms)
+    : skipped(0)
+{
+    const WaveformRing& ring = processor.waveform();
+    const uint64_t backlog = static_cast<uint64_t>(std::max(0, backlog_ms) * processor.waveform_rate() / 1000.0);
+    const uint64_t end = ring.end();
+    frame_cursor = end > backlog ? end - backlog : 0;
+
+    const BroadcastRing<uint64_t>& beat_ring = processor.beats();
+    const uint64_t held = std::min<uint64_t>(beat_ring.end(), beat_ring.capacity());
+    beat_cursor = beat_ring.end() - held;
+    std::vector<uint64_t> recent(held);
+    recent.resize(beat_ring.read(beat_cursor, recent.data(), recent.size()));
+    for (uint64_t r_index : recent) {
+        const uint64_t frame = processor.waveform_frame(r_index);
+        if (frame >= frame_cursor) beats.push_back(frame);
+    }
+    frames.resize(ECG_STREAM_MAX_FRAMES * ring.leads());
+}
+
+std::string EcgStream::next_event(const StableECGProcessor& processor) {
+    const WaveformRing& ring = processor.waveform();
+    const std::size_t n = ring.read(frame_cursor, frames.data(), ECG_STREAM_MAX_FRAMES, &skipped);
+    const uint64_t first = frame_cursor - n;
+
+    const BroadcastRing<uint64_t>& beat_ring = processor.beats();
+    uint64_t r_index;
+    while (beat_ring.read(beat_cursor, &r_index, 1) == 1) beats.push_back(processor.waveform_frame(r_index));
+    if (n == 0 && beats.empty()) return std::string();
+
+    std::string payload;
+    std::vector<int64_t> previous(ring.leads(), 0);
+    delta_codec::encode(payload, frames.data(), n, ring.leads(), ECG_STREAM_STEP, previous.data());
+
+    std::ostringstream event;
+    event << "event: ecg\ndata: {\"seq\":" << first << ",\"rate\":" << processor.waveform_rate()
+          << ",\"leads\":" << ring.leads() << ",\"step\":" << ECG_STREAM_STEP << ",\"d\":\""
+          << base64_encode(payload) << "\",\"r\":[";
+    for (std::size_t i = 0; i < beats.size(); ++i) event << (i ? "," : "") << beats[i];
+    event << "]}\n\n";
+    beats.clear();
+    return event.str();
+}
+
+uint64_t EcgStream::skipped_frames() const {
+    return skipped;
+}
+
+std::string base64_encode(const std::string& bytes) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((bytes.size() + 2) / 3 * 4);
+    for (std::size_t i = 0; i < bytes.size(); i += 3) {
+        const std::size_t n = std::min<std::size_t>(3, bytes.size() - i);
+        uint32_t group = static_cast<uint8_t>(bytes[i]) << 16;
+        if (n > 1) group |= static_cast<uint8_t>(bytes[i + 1]) << 8;
+        if (n > 2) group |= static_cast<uint8_t>(bytes[i + 2]);
+        out.push_back(ALPHABET[(group >> 18) & 0x3F]);
+        out.push_back(ALPHABET[(group >> 12) & 0x3F]);
+        out.push_back(n > 1 ? ALPHABET[(group >> 6) & 0x3F] : '=');
+        out.push_back(n > 2 ? ALPHABET[group & 0x3F] : '=');
+    }
+    return out;
+}
@@ -0,0 +1,44 @@
+#ifndef ECG_STREAM_HPP
+#define ECG_STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ecg_processor.hpp"
+
+constexpr double ECG_STREAM_STEP = 0.1;             // ECG units per transmitted count
+constexpr std::size_t ECG_STREAM_MAX_FRAMES = 512;  // Frames per event
+constexpr int ECG_STREAM_BACKLOG_MS = 2000;         // History sent when a client connects
+
+// One network client's view of the live waveform, as Server-Sent Events.
+// Each event carries the frames and R peaks that arrived since the previous
+// one:
+//   event: ecg
+//   data: {"seq":F,"rate":125,"leads":1,"step":0.1,"d":"<base64>","r":[...]}
+// seq is the index of the first frame, d the frames delta-coded with
+// delta_codec (self-contained: the first frame is coded against zero) and r
+// the waveform frames of R peaks, which trail the trace by the detector's
+// decision delay. A client that is not keeping up skips ahead in the ring,
+// which shows as a jump in seq; the processor never waits for it.
+// Only cursors are kept, so the processor is passed to every call.
+class EcgStream {
+public:
+    explicit EcgStream(const StableECGProcessor& processor, int backlog_ms = ECG_STREAM_BACKLOG_MS);
+    // Next event, or an empty string if nothing new has arrived
+    std::string next_event(const StableECGProcessor& processor);
+    // Frames the client missed by falling behind
+    uint64_t skipped_frames() const;
+
+private:
+    uint64_t frame_cursor;
+    uint64_t beat_cursor;
+    uint64_t skipped;
+    std::vector<double> frames;
+    std::vector<uint64_t> beats;
+};
+
+// Standard base64 with padding, for binary payloads in text protocols
+std::string base64_encode(const std::string& bytes);
+
+#endif // ECG_STREAM_HPP
@@ -0,0 +1,211 @@
+#ifndef FILTER_DESIGN_HPP
+#define FILTER_DESIGN_HPP
+
+#include <array>
+#include <cstddef>
+#include "ecg_filter.hpp"
+
+// Compile-time IIR design: Butterworth band-pass and second-order notch
+// filters, digitised with the bilinear transform (with pre-warping) and
+// returned as second-order sections for EnhancedFilter / MultiLeadFilter.
+// Everything is constexpr, so coefficients for a fixed sample rate are
+// computed by the compiler:
+//
+//   constexpr auto sos = filter_design::butterworth_bandpass<2>(1000.0, 5.0, 15.0);
+//
+// <cmath> is not constexpr in C++17, so the few functions needed are
+// implemented here; they are accurate to a few ulp over the ranges used.
+namespace filter_design {
+
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double abs(double x) { return x < 0.0 ? -x : x; }
+
+constexpr double sqrt(double x) {
+    if (x <= 0.0) return 0.0;
+    double r = x < 1.0 ? 1.0 : x;
+    for (int i = 0; i < 200; ++i) {
+        const double next = 0.5 * (r + x / r);
+        if (next == r) break;
+        r = next;
+    }
+    return r;
+}
+
+// Taylor series after reducing the argument to [-pi, pi]
+constexpr double sin(double x) {
+    while (x > PI) x -= 2.0 * PI;
+    while (x < -PI) x += 2.0 * PI;
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 30; ++n) {
+        term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos(double x) { return sin(x + 0.5 * PI); }
+constexpr double tan(double x) { return sin(x) / cos(x); }
+
+// Halve the argument with atan(x) = 2 atan(x / (1 + sqrt(1 + x^2))) until the
+// Taylor series converges quickly
+constexpr double atan(double x) {
+    double scale = 1.0;
+    while (abs(x) > 0.1) {
+        x = x / (1.0 + sqrt(1.0 + x * x));
+        scale *= 2.0;
+    }
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 20; ++n) {
+        term *= -x * x;
+        sum += term / (2.0 * n + 1.0);
+    }
+    return scale * sum;
+}
+
+struct Complex {
+    double re, im;
+};
+
+constexpr Complex operator+(Complex a, Complex b) { return {a.re + b.re, a.im + b.im}; }
+constexpr Complex operator-(Complex a, Complex b) { return {a.re - b.re, a.im - b.im}; }
+constexpr Complex operator*(Complex a, Complex b) { return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re}; }
+constexpr Complex operator*(double k, Complex a) { return {k * a.re, k * a.im}; }
+constexpr Complex operator/(Complex a, Complex b) {
+    const double d = b.re * b.re + b.im * b.im;
+    return {(a.re * b.re + a.im * b.im) / d, (a.im * b.re - a.re * b.im) / d};
+}
+constexpr double norm(Complex a) { return a.re * a.re + a.im * a.im; }
+
+// Principal square root
+constexpr Complex sqrt(Complex a) {
+    const double m = sqrt(norm(a));
+    const double re = sqrt(0.5 * (m + a.re));
+    const double im = sqrt(0.5 * (m - a.re));
+    return {re, a.im < 0.0 ? -im : im};
+}
+
+// Magnitude response of a cascade at frequency f
+template <std::size_t N>
+constexpr double magnitude(const std::array<Biquad, N>& sections, double sample_rate, double f) {
+    const double w = 2.0 * PI * f / sample_rate;
+    const Complex z1{cos(w), -sin(w)};  // z^-1
+    const Complex z2 = z1 * z1;
+    Complex h{1.0, 0.0};
+    for (std::size_t s = 0; s < N; ++s) {
+        const Biquad& q = sections[s];
+        const Complex num = Complex{q.b0, 0.0} + q.b1 * z1 + q.b2 * z2;
+        const Complex den = Complex{1.0, 0.0} + q.a1 * z1 + q.a2 * z2;
+        h = h * (num / den);
+    }
+    return sqrt(norm(h));
+}
+
+// Group delay of a cascade at frequency f, in samples. For each polynomial
+// P(z^-1) = sum p_k z^-k the delay contribution is Re(sum k p_k z^-k / P).
+template <std::size_t N>
+constexpr double group_delay(const std::array<Biquad, N>& sections, double sample_rate, double f) {
+    const double w = 2.0 * PI * f / sample_rate;
+    const Complex z1{cos(w), -sin(w)};
+    const Complex z2 = z1 * z1;
+    double delay = 0.0;
+    for (std::size_t s = 0; s < N; ++s) {
+        const Biquad& q = sections[s];
+        const Complex num = Complex{q.b0, 0.0} + q.b1 * z1 + q.b2 * z2;
+        const Complex num_k = q.b1 * z1 + (2.0 * q.b2) * z2;
+        const Complex den = Complex{1.0, 0.0} + q.a1 * z1 + q.a2 * z2;
+        const Complex den_k = q.a1 * z1 + (2.0 * q.a2) * z2;
+        delay += (num_k / num).re - (den_k / den).re;
+    }
+    return delay;
+}
+
+// Butterworth band-pass from an Order-pole analogue low-pass prototype, giving
+// a filter of order 2 * Order as Order sections. Each section has one zero at
+// DC and one at Nyquist; the gain is 1 at the geometric centre frequency and
+// is carried by the first section. Requires 0 < low < high < sample_rate / 2.
+template <std::size_t Order>
+constexpr std::array<Biquad, Order> butterworth_bandpass(double sample_rate, double low, double high) {
+    static_assert(Order > 0, "Band-pass needs at least one prototype pole");
+    // Pre-warped analogue band edges
+    const double k = 2.0 * sample_rate;
+    const double w_low = k * tan(PI * low / sample_rate);
+    const double w_high = k * tan(PI * high / sample_rate);
+    const double w0_squared = w_low * w_high;
+    const double bandwidth = w_high - w_low;
+
+    // Low-pass prototype poles lie on the left unit half circle. The low-pass to
+    // band-pass mapping turns each into two poles; the set is conjugate
+    // symmetric, so every pole above the real axis and its conjugate make one
+    // section. A real prototype pole may map to two real poles, paired together.
+    std::array<Complex, 2 * Order> poles{};
+    for (std::size_t i = 0; i < Order; ++i) {
+        const double angle = PI * (2.0 * i + Order + 1.0) / (2.0 * Order);
+        const Complex p = 0.5 * bandwidth * Complex{cos(angle), sin(angle)};
+        const Complex root = sqrt(p * p - Complex{w0_squared, 0.0});
+        poles[2 * i] = p + root;
+        poles[2 * i + 1] = p - root;
+    }
+
+    std::array<Biquad, Order> sections{};
+    std::size_t count = 0;
+    Complex pending_real{0.0, 0.0};
+    bool have_real = false;
+    for (std::size_t i = 0; i < 2 * Order; ++i) {
+        // Bilinear transform s -> z = (k + s) / (k - s)
+        const Complex z = (Complex{k, 0.0} + poles[i]) / (Complex{k, 0.0} - poles[i]);
+        const double scale = 1e-9 * (1.0 + abs(z.re));
+        if (z.im > scale) {
+            sections[count++] = Biquad{1.0, 0.0, -1.0, -2.0 * z.re, norm(z)};
+        } else if (abs(z.im) <= scale) {
+            if (have_real) {
+                sections[count++] = Biquad{1.0, 0.0, -1.0, -(z.re + pending_real.re), z.re * pending_real.re};
+                have_real = false;
+            } else {
+                pending_real = z;
+                have_real = true;
+            }
+        }
+    }
+
+    // Digital frequency the analogue centre frequency maps to
+    const double f0 = sample_rate / PI * atan(sqrt(w0_squared) / k);
+    const double gain = magnitude(sections, sample_rate, f0);
+    sections[0].b0 /= gain;
+    sections[0].b2 /= gain;
+    return sections;
+}
+
+// Second-order notch at f0 (band-stop from a one-pole prototype, bilinear
+// transform); quality is f0 over the -3 dB stop bandwidth. Unity gain at DC.
+constexpr Biquad notch(double sample_rate, double f0, double quality) {
+    const double w = 2.0 * PI * f0 / sample_rate;
+    const double alpha = sin(w) / (2.0 * quality);
+    const double a0 = 1.0 + alpha;
+    return Biquad{1.0 / a0, -2.0 * cos(w) / a0, 1.0 / a0, -2.0 * cos(w) / a0, (1.0 - alpha) / a0};
+}
+
+// Sections of a followed by those of b
+template <std::size_t A, std::size_t B>
+constexpr std::array<Biquad, A + B> cascade(const std::array<Biquad, A>& a, const std::array<Biquad, B>& b) {
+    std::array<Biquad, A + B> out{};
+    for (std::size_t i = 0; i < A; ++i) out[i] = a[i];
+    for (std::size_t i = 0; i < B; ++i) out[A + i] = b[i];
+    return out;
+}
+
+// Every pole strictly inside the unit circle (|a2| < 1 and |a1| < 1 + a2)
+template <std::size_t N>
+constexpr bool is_stable(const std::array<Biquad, N>& sections) {
+    for (std::size_t s = 0; s < N; ++s) {
+        const Biquad& q = sections[s];
+        if (!(abs(q.a2) < 1.0 && abs(q.a1) < 1.0 + q.a2)) return false;
+    }
+    return true;
+}
+
+}  // namespace filter_design
+
+#endif // FILTER_DESIGN_HPP
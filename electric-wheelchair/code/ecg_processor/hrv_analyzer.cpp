@@ -0,0 +1,243 @@
+#include "hrv_analyzer.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr double LF_LOW_HZ = 0.04;
+constexpr double LF_HIGH_HZ = 0.15;
+constexpr double HF_HIGH_HZ = 0.40;
+constexpr std::size_t SPECTRUM_BATCH = 64;
+
+// In-place iterative radix-2 FFT; size must be a power of two
+void fft(std::vector<std::complex<double>>& data) {
+    const std::size_t n = data.size();
+    for (std::size_t i = 1, j = 0; i < n; ++i) {
+        std::size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    for (std::size_t len = 2; len <= n; len <<= 1) {
+        const double angle = -2.0 * PI / static_cast<double>(len);
+        const std::complex<double> step(std::cos(angle), std::sin(angle));
+        for (std::size_t i = 0; i < n; i += len) {
+            std::complex<double> w(1.0, 0.0);
+            for (std::size_t k = 0; k < len / 2; ++k) {
+                const std::complex<double> even = data[i + k];
+                const std::complex<double> odd = data[i + k + len / 2] * w;
+                data[i + k] = even + odd;
+                data[i + k + len / 2] = even - odd;
+                w *= step;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+HRVAnalyzer::HRVAnalyzer(std::size_t window_beats)
+    : intervals(std::max<std::size_t>(window_beats, 2)),
+      window(HRV_SPECTRUM_POINTS),
+      fft_buffer(HRV_SPECTRUM_POINTS),
+      active(false)
+{
+    for (std::size_t i = 0; i < HRV_SPECTRUM_POINTS; ++i) {
+        window[i] = 0.5 - 0.5 * std::cos(2.0 * PI * i / (HRV_SPECTRUM_POINTS - 1));
+    }
+    reset();
+}
+
+HRVAnalyzer::~HRVAnalyzer() {
+    stop();
+}
+
+void HRVAnalyzer::start() {
+    active.store(true);
+    worker = std::thread(&HRVAnalyzer::spectrum_loop, this);
+}
+
+void HRVAnalyzer::stop() {
+    active.store(false);
+    queue.wake();
+    if (worker.joinable())
+        worker.join();
+}
+
+void HRVAnalyzer::reset() {
+    oldest = 0;
+    count = 0;
+    evictions = 0;
+    sum = 0.0;
+    sum_squares = 0.0;
+    diff_sum_squares = 0.0;
+    diff_over_50 = 0;
+    RrInterval discard[SPECTRUM_BATCH];
+    while (queue.pop(discard, SPECTRUM_BATCH) > 0) {}
+    series.clear();
+    time_domain.store({});
+    spectrum.store({});
+}
+
+void HRVAnalyzer::add_interval(double rr_ms, double beat_time) {
+    const std::size_t capacity = intervals.size();
+    if (count == capacity) {
+        // Slide the window: drop the oldest interval and its successive difference
+        const double old = intervals[oldest];
+        const double next = intervals[(oldest + 1) % capacity];
+        sum -= old;
+        sum_squares -= old * old;
+        const double d = next - old;
+        diff_sum_squares -= d * d;
+        if (std::abs(d) > 50.0) --diff_over_50;
+        oldest = (oldest + 1) % capacity;
+        --count;
+        ++evictions;
+    }
+    if (count > 0) {
+        const double d = rr_ms - intervals[(oldest + count - 1) % capacity];
+        diff_sum_squares += d * d;
+        if (std::abs(d) > 50.0) ++diff_over_50;
+    }
+    intervals[(oldest + count) % capacity] = rr_ms;
+    ++count;
+    sum += rr_ms;
+    sum_squares += rr_ms * rr_ms;
+
+    // Rebuild the sums once per window length so rounding errors cannot pile up
+    if (evictions >= capacity) {
+        recompute_sums();
+    }
+    publish_time_domain();
+
+    const RrInterval interval = {rr_ms, beat_time};
+    queue.push(&interval, 1);
+    queue.notify();
+}
+
+void HRVAnalyzer::recompute_sums() {
+    const std::size_t capacity = intervals.size();
+    sum = 0.0;
+    sum_squares = 0.0;
+    diff_sum_squares = 0.0;
+    diff_over_50 = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const double rr = intervals[(oldest + i) % capacity];
+        sum += rr;
+        sum_squares += rr * rr;
+        if (i > 0) {
+            const double d = rr - intervals[(oldest + i - 1) % capacity];
+            diff_sum_squares += d * d;
+            if (std::abs(d) > 50.0) ++diff_over_50;
+        }
+    }
+    evictions = 0;
+}
+
+void HRVAnalyzer::publish_time_domain() {
+    TimeDomain td = {};
+    td.beats = count;
+    if (count > 0) {
+        td.mean_rr = sum / count;
+    }
+    if (count > 1) {
+        const double variance = (sum_squares - sum * sum / count) / (count - 1);
+        td.sdnn = std::sqrt(std::max(variance, 0.0));
+        td.rmssd = std::sqrt(std::max(diff_sum_squares, 0.0) / (count - 1));
+        td.pnn50 = 100.0 * diff_over_50 / (count - 1);
+    }
+    time_domain.store(td);
+}
+
+HrvMetrics HRVAnalyzer::metrics() const {
+    const TimeDomain td = time_domain.load();
+    const Spectrum sp = spectrum.load();
+    return {td.beats, td.mean_rr, td.sdnn, td.rmssd, td.pnn50, sp.lf_power, sp.hf_power, sp.lf_hf};
+}
+
+void HRVAnalyzer::update_spectrum() {
+    RrInterval batch[SPECTRUM_BATCH];
+    std::size_t n;
+    while ((n = queue.pop(batch, SPECTRUM_BATCH)) > 0) {
+        append_series(batch, n);
+    }
+    compute_spectrum();
+}
+
+void HRVAnalyzer::spectrum_loop() {
+    RrInterval batch[SPECTRUM_BATCH];
+    auto next_update = std::chrono::steady_clock::now() + std::chrono::milliseconds(HRV_SPECTRUM_PERIOD_MS);
+    while (active.load()) {
+        const auto now = std::chrono::steady_clock::now();
+        const int timeout_ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(next_update - now).count());
+        const std::size_t n = queue.pop_wait(batch, SPECTRUM_BATCH, std::max(timeout_ms, 0));
+        append_series(batch, n);
+        if (std::chrono::steady_clock::now() >= next_update) {
+            compute_spectrum();
+            next_update += std::chrono::milliseconds(HRV_SPECTRUM_PERIOD_MS);
+        }
+    }
+}
+
+void HRVAnalyzer::append_series(const RrInterval* items, std::size_t n) {
+    if (n == 0) return;
+    series.insert(series.end(), items, items + n);
+    // Keep one interval before the start of the spectrum window for interpolation
+    const double start = series.back().beat_time - HRV_SPECTRUM_POINTS / HRV_RESAMPLE_HZ;
+    std::size_t first = 0;
+    while (first + 1 < series.size() && series[first + 1].beat_time <= start) ++first;
+    series.erase(series.begin(), series.begin() + first);
+}
+
+void HRVAnalyzer::compute_spectrum() {
+    constexpr double duration = HRV_SPECTRUM_POINTS / HRV_RESAMPLE_HZ;
+    if (series.size() < 2 || series.back().beat_time - series.front().beat_time < duration / 2) {
+        return;  // Not enough history yet
+    }
+
+    // Resample the RR tachogram on an even grid by linear interpolation,
+    // holding the first value before the recorded history starts
+    const double start = series.back().beat_time - duration;
+    std::size_t segment = 0;
+    double mean = 0.0;
+    for (std::size_t k = 0; k < HRV_SPECTRUM_POINTS; ++k) {
+        const double t = start + k / HRV_RESAMPLE_HZ;
+        while (segment + 1 < series.size() && series[segment + 1].beat_time < t) ++segment;
+        double rr;
+        if (t <= series[segment].beat_time || segment + 1 == series.size()) {
+            rr = series[segment].rr_ms;
+        } else {
+            const RrInterval& a = series[segment];
+            const RrInterval& b = series[segment + 1];
+            rr = a.rr_ms + (b.rr_ms - a.rr_ms) * (t - a.beat_time) / (b.beat_time - a.beat_time);
+        }
+        fft_buffer[k] = rr;
+        mean += rr;
+    }
+    mean /= HRV_SPECTRUM_POINTS;
+
+    double window_power = 0.0;
+    for (std::size_t k = 0; k < HRV_SPECTRUM_POINTS; ++k) {
+        fft_buffer[k] = (fft_buffer[k].real() - mean) * window[k];
+        window_power += window[k] * window[k];
+    }
+    fft(fft_buffer);
+
+    // One-sided power spectral density integrated over each band
+    const double bin_hz = HRV_RESAMPLE_HZ / HRV_SPECTRUM_POINTS;
+    const double scale = 2.0 / (HRV_RESAMPLE_HZ * window_power) * bin_hz;
+    Spectrum sp = {};
+    for (std::size_t k = 1; k < HRV_SPECTRUM_POINTS / 2; ++k) {
+        const double f = k * bin_hz;
+        const double power = std::norm(fft_buffer[k]) * scale;
+        if (f >= LF_LOW_HZ && f < LF_HIGH_HZ) {
+            sp.lf_power += power;
+        } else if (f >= LF_HIGH_HZ && f < HF_HIGH_HZ) {
+            sp.hf_power += power;
+        }
+    }
+    sp.lf_hf = sp.hf_power > 0.0 ? sp.lf_power / sp.hf_power : 0.0;
+    spectrum.store(sp);
+}
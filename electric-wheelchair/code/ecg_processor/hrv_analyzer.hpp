@@ -0,0 +1,109 @@
+#ifndef HRV_ANALYZER_HPP
+#define HRV_ANALYZER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "sample_ring.hpp"
+#include "seqlock.hpp"
+
+constexpr std::size_t HRV_WINDOW_BEATS = 300;       // RR intervals used for the time-domain metrics
+constexpr double HRV_RESAMPLE_HZ = 4.0;             // Rate of the evenly resampled RR series
+constexpr std::size_t HRV_SPECTRUM_POINTS = 512;    // FFT length (128 s at 4 Hz), power of two
+constexpr int HRV_SPECTRUM_PERIOD_MS = 5000;        // How often LF/HF is recomputed
+constexpr std::size_t HRV_RR_QUEUE_CAPACITY = 256;  // Beats queued for the spectrum thread
+
+// Heart rate variability over the recent RR intervals. Time-domain values are
+// in milliseconds, spectral powers in ms^2.
+struct HrvMetrics {
+    std::size_t beats;  // RR intervals in the time-domain window
+    double mean_rr;
+    double sdnn;        // Standard deviation of the intervals
+    double rmssd;       // Root mean square of successive differences
+    double pnn50;       // Percentage of successive differences above 50 ms
+    double lf_power;    // 0.04-0.15 Hz
+    double hf_power;    // 0.15-0.40 Hz
+    double lf_hf;       // 0 until the spectrum is available
+};
+
+// Streaming HRV analysis.
+// add_interval() is called on the beat detection thread and updates running
+// sums in O(1), so the time-domain metrics never cost more than a few
+// additions per beat. The intervals are also queued for a worker thread that
+// periodically resamples the RR series at HRV_RESAMPLE_HZ and computes LF/HF
+// power with an FFT, away from the real-time path.
+class HRVAnalyzer {
+public:
+    explicit HRVAnalyzer(std::size_t window_beats = HRV_WINDOW_BEATS);
+    ~HRVAnalyzer();
+
+    HRVAnalyzer(const HRVAnalyzer&) = delete;
+    HRVAnalyzer& operator=(const HRVAnalyzer&) = delete;
+
+    // Start/stop the spectrum thread
+    void start();
+    void stop();
+
+    // Register an accepted RR interval ending at beat_time (seconds on the
+    // sample clock). Single producer.
+    void add_interval(double rr_ms, double beat_time);
+    // Forget the interval history; call only while the spectrum thread is stopped
+    void reset();
+    // Recompute LF/HF from the queued intervals on the calling thread. The
+    // spectrum thread does this periodically; offline users can call it directly.
+    void update_spectrum();
+
+    // Lock-free snapshot of the latest metrics, safe from any thread
+    HrvMetrics metrics() const;
+
+private:
+    struct RrInterval {
+        double rr_ms;
+        double beat_time;
+    };
+    struct TimeDomain {
+        std::size_t beats;
+        double mean_rr;
+        double sdnn;
+        double rmssd;
+        double pnn50;
+    };
+    struct Spectrum {
+        double lf_power;
+        double hf_power;
+        double lf_hf;
+    };
+
+    void spectrum_loop();
+    void append_series(const RrInterval* items, std::size_t n);
+    void compute_spectrum();
+    void recompute_sums();
+    void publish_time_domain();
+
+    // Time-domain state, owned by the add_interval() thread
+    std::vector<double> intervals;  // Ring of the last window_beats intervals
+    std::size_t oldest;
+    std::size_t count;
+    std::size_t evictions;  // Since the sums were last rebuilt exactly
+    double sum;
+    double sum_squares;
+    double diff_sum_squares;
+    std::size_t diff_over_50;
+    SeqLock<TimeDomain> time_domain;
+
+    // Spectrum state, owned by the worker thread
+    SpscRing<RrInterval, HRV_RR_QUEUE_CAPACITY> queue;
+    std::vector<RrInterval> series;  // Intervals covering the spectrum window
+    std::vector<double> window;      // Hann window
+    std::vector<std::complex<double>> fft_buffer;
+    SeqLock<Spectrum> spectrum;
+
+    std::atomic<bool> active;
+    std::thread worker;
+};
+
+#endif // HRV_ANALYZER_HPP
@@ -0,0 +1,91 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free log-linear histogram of durations in nanoseconds, in the style of
+// HdrHistogram: every power of two is split into SUB_BUCKETS linear buckets,
+// so any value is kept to within 1/SUB_BUCKETS (about 6%) over the whole
+// 64-bit range with a fixed, small table. record() is a few relaxed atomic
+// increments and may be called from any thread; readers see a slightly stale
+// but never torn view.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 4;
+    static constexpr std::size_t SUB_BUCKETS = std::size_t(1) << SUB_BITS;
+    static constexpr std::size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram() { reset(); }
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t ns) {
+        counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t seen = peak.load(std::memory_order_relaxed);
+        while (ns > seen && !peak.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return peak.load(std::memory_order_relaxed); }
+    double mean() const {
+        const uint64_t n = count();
+        return n ? static_cast<double>(sum.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // Smallest recorded value v such that a fraction q of all values are <= v
+    // (to bucket precision, reported as the bucket's upper bound)
+    uint64_t percentile(double q) const {
+        std::array<uint64_t, BUCKETS> snapshot;
+        uint64_t n = 0;
+        for (std::size_t i = 0; i < BUCKETS; ++i) {
+            snapshot[i] = counts[i].load(std::memory_order_relaxed);
+            n += snapshot[i];
+        }
+        if (n == 0) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * n + 0.5));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKETS; ++i) {
+            seen += snapshot[i];
+            if (seen >= rank) return std::min(upper_bound(i), max());
+        }
+        return max();
+    }
+
+    void reset() {
+        for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        peak.store(0, std::memory_order_relaxed);
+    }
+
+    // Values below SUB_BUCKETS map to themselves; above, the leading bit picks
+    // the power of two and the next SUB_BITS bits the linear bucket within it
+    static std::size_t bucket(uint64_t v) {
+        if (v < SUB_BUCKETS) return static_cast<std::size_t>(v);
+        const unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        const unsigned shift = msb - SUB_BITS;
+        return SUB_BUCKETS * (shift + 1) + static_cast<std::size_t>((v >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value that falls in bucket i
+    static uint64_t upper_bound(std::size_t i) {
+        if (i < SUB_BUCKETS) return i;
+        const unsigned shift = static_cast<unsigned>(i / SUB_BUCKETS - 1);
+        const uint64_t low = (SUB_BUCKETS + i % SUB_BUCKETS) << shift;
+        return low + ((uint64_t(1) << shift) - 1);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> peak;
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,225 @@
+#include "qrs_detector.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+std::size_t next_power_of_two(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+}
+
+PanTompkinsDetector::PanTompkinsDetector(int sample_rate)
+    : sample_rate(sample_rate),
+      integration_width(std::max<std::size_t>(1, static_cast<std::size_t>(sample_rate * 0.150))),
+      refractory(static_cast<uint64_t>(sample_rate * 0.200)),
+      t_wave_window(static_cast<uint64_t>(sample_rate * 0.360)),
+      learning_samples(static_cast<uint64_t>(sample_rate) * 2),
+      squared_history(integration_width),
+      filtered_history(next_power_of_two(integration_width + sample_rate / 10 + 8)),
+      filtered_mask(filtered_history.size() - 1),
+      slope_window(integration_width),
+      learning_window(learning_samples)
+{
+    reset();
+}
+
+void PanTompkinsDetector::reset(uint64_t next_index) {
+    sample_index = next_index;
+    learning_end = next_index + learning_samples;
+    x_history.fill(0.0);
+    std::fill(squared_history.begin(), squared_history.end(), 0.0);
+    std::fill(filtered_history.begin(), filtered_history.end(), 0.0);
+    integral_sum = 0.0;
+    slope_window.clear();
+    learning_window.clear();
+    learning_sum = 0.0;
+    prev_integral = 0.0;
+    prev_prev_integral = 0.0;
+    signal_peak = 0.0;
+    noise_peak = 0.0;
+    threshold1 = 0.0;
+    threshold2 = 0.0;
+    have_qrs = false;
+    last_qrs_index = 0;
+    last_qrs_slope = 0.0;
+    have_candidate = false;
+    candidate = Peak{0, 0.0, 0.0};
+    candidate_index = 0;
+    rr_recent.fill(0);
+    rr_regular.fill(0);
+    rr_recent_count = rr_regular_count = 0;
+    rr_recent_pos = rr_regular_pos = 0;
+    rr_recent_sum = rr_regular_sum = 0;
+}
+
+std::size_t PanTompkinsDetector::step(double sample, uint64_t beats[MAX_BEATS_PER_SAMPLE]) {
+    // Five-point derivative, then squaring
+    const double slope = (2.0 * sample + x_history[0] - x_history[2] - 2.0 * x_history[3]) * 0.125;
+    x_history[3] = x_history[2];
+    x_history[2] = x_history[1];
+    x_history[1] = x_history[0];
+    x_history[0] = sample;
+    return step_features(slope * slope, sample, beats);
+}
+
+std::size_t PanTompkinsDetector::step_features(double squared, double amplitude,
+                                               uint64_t beats[MAX_BEATS_PER_SAMPLE]) {
+    const uint64_t index = sample_index++;
+    std::size_t count = 0;
+
+    filtered_history[index & filtered_mask] = amplitude;
+    slope_window.push(squared);
+
+    // Moving-window integration
+    const std::size_t slot = index % integration_width;
+    integral_sum += squared - squared_history[slot];
+    squared_history[slot] = squared;
+    const double integral = std::max(integral_sum, 0.0) / integration_width;
+
+    // Search-back: no QRS for 166% of the average RR, take the best rejected peak
+    if (have_qrs && have_candidate && rr_recent_count > 0 && index - last_qrs_index > rr_limit()) {
+        accept_qrs(candidate, candidate_index, true);
+        beats[count++] = candidate.r_index;
+        have_candidate = false;
+    }
+
+    // Learning phase: initial thresholds from the first two seconds
+    if (index < learning_end) {
+        learning_window.push(integral);
+        learning_sum += integral;
+        if (index + 1 == learning_end) {
+            signal_peak = learning_window.max() / 3.0;
+            noise_peak = learning_sum / learning_samples / 2.0;
+            update_thresholds();
+        }
+        prev_prev_integral = prev_integral;
+        prev_integral = integral;
+        return count;
+    }
+
+    // The previous sample is a peak of the integrated signal if it ended a rise
+    const bool is_peak = prev_integral > prev_prev_integral && prev_integral >= integral;
+    const double peak_value = prev_integral;
+    prev_prev_integral = prev_integral;
+    prev_integral = integral;
+    if (!is_peak) return count;
+
+    const uint64_t peak_index = index - 1;
+    if (have_qrs && peak_index - last_qrs_index < refractory) return count;
+
+    const Peak peak{locate_r_peak(peak_index), peak_value, slope_window.max()};
+    if (peak.value > threshold1 && !is_t_wave(peak, peak_index)) {
+        accept_qrs(peak, peak_index, false);
+        beats[count++] = peak.r_index;
+        have_candidate = false;
+    } else {
+        noise_peak = 0.125 * peak.value + 0.875 * noise_peak;
+        update_thresholds();
+        if (peak.value > threshold2 && (!have_candidate || peak.value > candidate.value)) {
+            candidate = peak;
+            candidate_index = peak_index;
+            have_candidate = true;
+        }
+    }
+    return count;
+}
+
+// A peak shortly after a QRS with less than half its slope is a T wave
+bool PanTompkinsDetector::is_t_wave(const Peak& peak, uint64_t index) const {
+    return have_qrs && index - last_qrs_index < t_wave_window && peak.slope < 0.5 * last_qrs_slope;
+}
+
+void PanTompkinsDetector::accept_qrs(const Peak& peak, uint64_t index, bool from_search_back) {
+    if (from_search_back)
+        signal_peak = 0.25 * peak.value + 0.75 * signal_peak;
+    else
+        signal_peak = 0.125 * peak.value + 0.875 * signal_peak;
+
+    if (have_qrs) {
+        const uint64_t rr = index - last_qrs_index;
+        rr_recent_sum += rr - rr_recent[rr_recent_pos];
+        rr_recent[rr_recent_pos] = rr;
+        rr_recent_pos = (rr_recent_pos + 1) % rr_recent.size();
+        rr_recent_count = std::min(rr_recent_count + 1, rr_recent.size());
+
+        // Only intervals within 92%..116% of the regular average update it
+        bool regular = rr_regular_count == 0;
+        if (!regular) {
+            const double average = static_cast<double>(rr_regular_sum) / rr_regular_count;
+            regular = rr >= 0.92 * average && rr <= 1.16 * average;
+        }
+        if (regular) {
+            rr_regular_sum += rr - rr_regular[rr_regular_pos];
+            rr_regular[rr_regular_pos] = rr;
+            rr_regular_pos = (rr_regular_pos + 1) % rr_regular.size();
+            rr_regular_count = std::min(rr_regular_count + 1, rr_regular.size());
+        }
+    }
+
+    have_qrs = true;
+    last_qrs_index = index;
+    last_qrs_slope = peak.slope;
+    update_thresholds();
+}
+
+void PanTompkinsDetector::update_thresholds() {
+    threshold1 = noise_peak + 0.25 * (signal_peak - noise_peak);
+    threshold2 = 0.5 * threshold1;
+}
+
+// The R wave is the largest deflection of the filtered signal (or of the
+// combined amplitude of all leads) inside the integration window that
+// produced the peak
+uint64_t PanTompkinsDetector::locate_r_peak(uint64_t index) const {
+    const uint64_t span = std::min<uint64_t>(integration_width + 2, filtered_history.size() - 1);
+    const uint64_t first = index > span ? index - span : 0;
+    uint64_t best = index;
+    double best_value = -1.0;
+    for (uint64_t i = first; i <= index; ++i) {
+        const double value = std::fabs(filtered_history[i & filtered_mask]);
+        if (value > best_value) {
+            best_value = value;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Search-back limit: 166% of the regular RR average, or of all recent intervals
+uint64_t PanTompkinsDetector::rr_limit() const {
+    const double average = rr_regular_count > 0
+        ? static_cast<double>(rr_regular_sum) / rr_regular_count
+        : static_cast<double>(rr_recent_sum) / rr_recent_count;
+    return static_cast<uint64_t>(1.66 * average);
+}
+
+LeadSlopeEnergy::LeadSlopeEnergy(std::size_t leads) : lead_count(leads) {
+    if (leads == 0 || leads > MAX_LEADS) {
+        throw std::invalid_argument("LeadSlopeEnergy supports 1 to 8 leads");
+    }
+    reset();
+}
+
+void LeadSlopeEnergy::reset() {
+    for (auto& h : history) h.fill(0.0);
+}
+
+double LeadSlopeEnergy::step(const double* frame, double& amplitude) {
+    double energy = 0.0;
+    double power = 0.0;
+    for (std::size_t l = 0; l < lead_count; ++l) {
+        const double x = frame[l];
+        const double slope = (2.0 * x + history[0][l] - history[2][l] - 2.0 * history[3][l]) * 0.125;
+        history[3][l] = history[2][l];
+        history[2][l] = history[1][l];
+        history[1][l] = history[0][l];
+        history[0][l] = x;
+        energy += slope * slope;
+        power += x * x;
+    }
+    amplitude = power;
+    return energy;
+}
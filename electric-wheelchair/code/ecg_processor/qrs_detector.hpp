@@ -0,0 +1,136 @@
+#ifndef QRS_DETECTOR_HPP
+#define QRS_DETECTOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "sliding_window.hpp"
+
+// Pan-Tompkins QRS detector.
+// Works on the band-passed ECG: five-point derivative, squaring, moving-window
+// integration, then dual adaptive thresholds with search-back for missed beats.
+// All timing is derived from the index of each sample in the stream, so the
+// result does not depend on when or in which batches samples are delivered and
+// recorded data can be processed as fast as the CPU allows.
+class PanTompkinsDetector {
+public:
+    static constexpr std::size_t MAX_BEATS_PER_SAMPLE = 2;  // Search-back beat plus a new one
+
+    explicit PanTompkinsDetector(int sample_rate);
+
+    // Feed one filtered sample. Writes the sample index of every R peak
+    // confirmed by this sample into beats and returns how many were written.
+    std::size_t step(double sample, uint64_t beats[MAX_BEATS_PER_SAMPLE]);
+
+    // Feed the squared slope of one sample and the amplitude used to place the
+    // R wave, computed by the caller. This lets several leads share one
+    // detector (see LeadSlopeEnergy); step() is the single-lead case.
+    std::size_t step_features(double squared_slope, double amplitude, uint64_t beats[MAX_BEATS_PER_SAMPLE]);
+
+    // Feed a block of filtered samples, calling on_beat(sample_index) per R peak
+    template <typename OnBeat>
+    void process(const double* samples, std::size_t count, OnBeat&& on_beat) {
+        uint64_t beats[MAX_BEATS_PER_SAMPLE];
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::size_t n = step(samples[i], beats);
+            for (std::size_t b = 0; b < n; ++b) {
+                on_beat(beats[b]);
+            }
+        }
+    }
+
+    // Forget thresholds, RR history and signal history (restarts learning).
+    // The next sample fed is numbered next_index, so beat positions stay on
+    // the stream's sample clock after a gap in the input.
+    void reset(uint64_t next_index = 0);
+
+    // Number of samples consumed so far
+    uint64_t samples_seen() const { return sample_index; }
+    // Current primary detection threshold on the integrated signal
+    double threshold() const { return threshold1; }
+
+private:
+    // Candidate peak of the integrated signal
+    struct Peak {
+        uint64_t r_index;  // Location of the R wave in the filtered signal
+        double value;      // Height of the integrated peak
+        double slope;      // Largest squared slope within the integration window
+    };
+
+    bool is_t_wave(const Peak& peak, uint64_t index) const;
+    void accept_qrs(const Peak& peak, uint64_t index, bool from_search_back);
+    void update_thresholds();
+    uint64_t locate_r_peak(uint64_t index) const;
+    uint64_t rr_limit() const;
+
+    const int sample_rate;
+    const std::size_t integration_width;  // 150 ms moving window
+    const uint64_t refractory;            // 200 ms, no QRS can follow sooner
+    const uint64_t t_wave_window;         // 360 ms, peaks this close are checked for T waves
+    const uint64_t learning_samples;      // 2 s of initial threshold learning
+
+    uint64_t sample_index;
+    uint64_t learning_end;  // Index of the first sample after learning
+
+    // Derivative and integration history
+    std::array<double, 4> x_history;
+    std::vector<double> squared_history;  // Ring of integration_width squared slopes
+    double integral_sum;
+    std::vector<double> filtered_history; // Ring used to locate the R wave
+    std::size_t filtered_mask;
+
+    SlidingWindow<double> slope_window;   // Squared slope over the integration window
+    SlidingWindow<double> learning_window;// Integrated signal during learning
+    double learning_sum;
+
+    // Local maximum tracking on the integrated signal
+    double prev_integral;
+    double prev_prev_integral;
+
+    // Running estimates (SPKI, NPKI, THRESHOLD I1/I2 in Pan & Tompkins)
+    double signal_peak;
+    double noise_peak;
+    double threshold1;
+    double threshold2;
+
+    // Last detected QRS
+    bool have_qrs;
+    uint64_t last_qrs_index;   // Index of the integrated peak
+    double last_qrs_slope;
+
+    // Best rejected peak since the last QRS, revisited by search-back
+    bool have_candidate;
+    Peak candidate;
+    uint64_t candidate_index;
+
+    // RR averages over the last eight intervals: all, and those in the regular range
+    std::array<uint64_t, 8> rr_recent;
+    std::array<uint64_t, 8> rr_regular;
+    std::size_t rr_recent_count, rr_regular_count;
+    std::size_t rr_recent_pos, rr_regular_pos;
+    uint64_t rr_recent_sum, rr_regular_sum;
+};
+
+// Fused front end for multi-lead detection: the five-point derivative of every
+// lead, squared and summed into one slope energy, so a single
+// PanTompkinsDetector (one set of thresholds and RR averages) serves all leads.
+// A beat that is weak on one lead still counts through the others, and the
+// cost of detection grows only by the derivative per extra lead.
+class LeadSlopeEnergy {
+public:
+    static constexpr std::size_t MAX_LEADS = 8;
+
+    explicit LeadSlopeEnergy(std::size_t leads);
+
+    // Consume one frame of filtered samples; returns the summed squared slope
+    // and stores the summed squared amplitude (R wave locator) in amplitude
+    double step(const double* frame, double& amplitude);
+    void reset();
+
+private:
+    std::size_t lead_count;
+    std::array<std::array<double, MAX_LEADS>, 4> history;  // Last four samples of every lead
+};
+
+#endif // QRS_DETECTOR_HPP
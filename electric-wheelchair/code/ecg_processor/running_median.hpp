@@ -0,0 +1,59 @@
+#ifndef RUNNING_MEDIAN_HPP
+#define RUNNING_MEDIAN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+// Median of the last `width` values.
+// Values are kept twice: in arrival order (a ring, to know which one leaves
+// the window) and in a sorted array updated by binary search and a shift, so
+// each push costs O(log n + n) moves of a small contiguous array and the
+// median is read directly. No allocation happens after construction.
+template <typename T>
+class RunningMedian {
+public:
+    explicit RunningMedian(std::size_t width)
+        : ring(width), sorted(), oldest(0), count(0) {
+        if (width == 0) {
+            throw std::invalid_argument("RunningMedian width must be positive");
+        }
+        sorted.reserve(width);
+    }
+
+    void push(const T& value) {
+        if (count == ring.size()) {
+            // Remove the value leaving the window from the sorted view
+            const T& leaving = ring[oldest];
+            sorted.erase(std::lower_bound(sorted.begin(), sorted.end(), leaving));
+            ring[oldest] = value;
+            oldest = (oldest + 1) % ring.size();
+        } else {
+            ring[(oldest + count) % ring.size()] = value;
+            ++count;
+        }
+        sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), value), value);
+    }
+
+    // Middle value; the upper one of the two middle values for an even count
+    T median() const { return sorted[count / 2]; }
+
+    void clear() {
+        sorted.clear();
+        oldest = 0;
+        count = 0;
+    }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    std::size_t width() const { return ring.size(); }
+
+private:
+    std::vector<T> ring;    // Arrival order
+    std::vector<T> sorted;  // Same values, ascending
+    std::size_t oldest;
+    std::size_t count;
+};
+
+#endif // RUNNING_MEDIAN_HPP
@@ -0,0 +1,189 @@
+#include "sample_clock.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+SampleClock::SampleClock(double nominal_rate)
+    : nominal_rate(nominal_rate),
+      nominal_period(1e9 / nominal_rate),
+      bin_samples(nominal_rate * SAMPLE_CLOCK_BIN_MS / 1000.0)
+{
+    if (!(nominal_rate > 0.0)) {
+        throw std::invalid_argument("Sample clock needs a positive nominal rate");
+    }
+    reset();
+}
+// Forget all arrivals, e.g. when the board restarts its sample count
+void SampleClock::reset() {
+    have_base = false;
+    base_ns = 0;
+    last_end = 0;
+    offset = 0;
+    slips.clear();
+    envelope.clear();
+    locked = false;
+    intercept = 0.0;
+    slope = nominal_period;
+    bin_open = false;
+    bin_start = 0.0;
+    bin_lowered = false;
+    bin_lowered_from = 0;
+    bin_min = {0.0, 0.0};
+    bin_min_residual = 0.0;
+    bin_delay_sum = 0.0;
+    bin_batches = 0;
+    have_raised = false;
+    raised = {0.0, 0.0};
+    raised_residual = 0.0;
+    raised_from = 0;
+    bin_first_index = 0;
+    delay_us = 0.0;
+    dropped = 0;
+    duplicated = 0;
+    publish();
+}
+double SampleClock::predict(double x) const {
+    return intercept + slope * x;
+}
+// Offset in force for a stream index: the last correction at or before it
+int64_t SampleClock::offset_for(uint64_t index) const {
+    const auto after = std::upper_bound(slips.begin(), slips.end(), index,
+                                        [](uint64_t i, const std::pair<uint64_t, int64_t>& s) { return i < s.first; });
+    return after == slips.begin() ? 0 : std::prev(after)->second;
+}
+void SampleClock::add_batch(uint64_t end_index, uint64_t arrival_ns) {
+    if (end_index <= last_end) return;
+    const bool first_batch = !have_base;
+    if (first_batch) {
+        have_base = true;
+        base_ns = arrival_ns;
+    }
+    const uint64_t first_index = last_end;
+    last_end = end_index;
+
+    const double x = static_cast<double>(end_index - 1) + offset;
+    const double y = static_cast<double>(static_cast<int64_t>(arrival_ns - base_ns));
+    if (first_batch) {
+        // Until the clock locks, the line runs at the nominal rate from the
+        // first arrival. Moving it under samples already timed would put new
+        // samples before them when a file is replayed faster than real time.
+        intercept = y - slope * x;
+    }
+    const double r = y - predict(x);
+
+    if (!bin_open) {
+        bin_open = true;
+        bin_start = x;
+        bin_first_index = first_index;
+        bin_lowered = false;
+        bin_min = {x, y};
+        bin_min_residual = r;
+        bin_delay_sum = 0.0;
+        bin_batches = 0;
+    } else if (r < bin_min_residual) {
+        bin_min = {x, y};
+        bin_min_residual = r;
+    }
+    if (locked && !bin_lowered && r < -SAMPLE_CLOCK_SLIP_PERIODS * slope) {
+        bin_lowered = true;
+        bin_lowered_from = first_index;
+    }
+    bin_delay_sum += r;
+    ++bin_batches;
+    if (x - bin_start >= bin_samples) close_bin();
+}
+void SampleClock::close_bin() {
+    bin_open = false;
+    delay_us = bin_delay_sum / bin_batches / 1000.0;
+
+    if (bin_lowered && bin_min_residual < -SAMPLE_CLOCK_SLIP_PERIODS * slope) {
+        // Arrived before its samples could have been taken: counted twice.
+        // The bin's earliest arrival sits on the envelope, so it gives the count.
+        const int64_t k = std::llround(-bin_min_residual / slope);
+        slip(-k, bin_lowered_from);
+        duplicated += k;
+        bin_min.x -= k;
+        bin_min_residual += k * slope;
+    }
+    if (locked && bin_min_residual > SAMPLE_CLOCK_SLIP_PERIODS * slope) {
+        if (have_raised && std::abs(bin_min_residual - raised_residual) < slope) {
+            // Raised by the same whole periods twice running: samples were lost
+            const int64_t k = std::llround(std::min(raised_residual, bin_min_residual) / slope);
+            slip(k, raised_from);
+            dropped += k;
+            raised.x += k;
+            bin_min.x += k;
+            have_raised = false;
+            envelope.push_back(raised);
+            envelope.push_back(bin_min);
+            while (envelope.size() > SAMPLE_CLOCK_BINS) envelope.pop_front();
+            fit();
+        } else {
+            have_raised = true;
+            raised = bin_min;
+            raised_residual = bin_min_residual;
+            raised_from = bin_first_index;
+        }
+        publish();
+        return;
+    }
+    // A single raised bin was a slow patch of the link and is left out
+    have_raised = false;
+    envelope.push_back(bin_min);
+    while (envelope.size() > SAMPLE_CLOCK_BINS) envelope.pop_front();
+    fit();
+    publish();
+}
+void SampleClock::slip(int64_t samples, uint64_t from_index) {
+    offset += samples;
+    if (!slips.empty() && slips.back().first == from_index) {
+        slips.back().second = offset;
+    } else {
+        slips.emplace_back(from_index, offset);
+    }
+    if (slips.size() > SAMPLE_CLOCK_MAX_SLIPS) slips.erase(slips.begin());
+}
+// Least-squares line through the envelope, centred for precision
+void SampleClock::fit() {
+    const std::size_t n = envelope.size();
+    if (n < 2) return;
+    double mean_x = 0.0, mean_y = 0.0;
+    for (const Point& p : envelope) {
+        mean_x += p.x;
+        mean_y += p.y;
+    }
+    mean_x /= n;
+    mean_y /= n;
+    double sxx = 0.0, sxy = 0.0;
+    for (const Point& p : envelope) {
+        sxx += (p.x - mean_x) * (p.x - mean_x);
+        sxy += (p.x - mean_x) * (p.y - mean_y);
+    }
+    const double b = sxx > 0.0 ? sxy / sxx : 0.0;
+    if (n >= SAMPLE_CLOCK_MIN_BINS && std::abs(b / nominal_period - 1.0) <= SAMPLE_CLOCK_MAX_DEVIATION) {
+        locked = true;
+        slope = b;
+        intercept = mean_y - b * mean_x;
+        return;
+    }
+    // Not a live ADC (a file replayed faster than real time, or too few
+    // points yet): go on at the nominal rate from where the line was at the
+    // newest sample, so times already handed out stay in order
+    if (locked) {
+        const double x = static_cast<double>(last_end - 1) + offset;
+        intercept = predict(x) - nominal_period * x;
+        locked = false;
+        slope = nominal_period;
+    }
+}
+void SampleClock::publish() {
+    const double rate_hz = 1e9 / slope;
+    // Unlocked, the delay is taken against the nominal line and means nothing
+    published.store({locked, rate_hz, (rate_hz / nominal_rate - 1.0) * 1e6, locked ? delay_us : 0.0, dropped,
+                     duplicated});
+}
+double SampleClock::time_of(uint64_t index) const {
+    const double x = static_cast<double>(index) + offset_for(index);
+    if (!have_base) return x * nominal_period;
+    return static_cast<double>(base_ns) + predict(x);
+}
@@ -0,0 +1,97 @@
+#ifndef SAMPLE_CLOCK_HPP
+#define SAMPLE_CLOCK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "seqlock.hpp"
+
+constexpr int SAMPLE_CLOCK_BIN_MS = 1000;            // Samples per lower-envelope point, in nominal time
+constexpr std::size_t SAMPLE_CLOCK_BINS = 60;        // Points in the regression (about a minute)
+constexpr std::size_t SAMPLE_CLOCK_MIN_BINS = 5;     // Points before the clock locks
+constexpr double SAMPLE_CLOCK_MAX_DEVIATION = 0.02;  // Largest believable ADC rate error
+constexpr double SAMPLE_CLOCK_SLIP_PERIODS = 1.5;    // Envelope step taken as dropped or duplicated samples
+constexpr std::size_t SAMPLE_CLOCK_MAX_SLIPS = 1024; // Index corrections remembered
+
+struct SampleClockStatus {
+    bool locked;          // Rate and phase come from the arrivals, not the nominal rate
+    double rate_hz;       // Recovered ADC rate (nominal until locked)
+    double ppm;           // Deviation of the recovered rate from nominal
+    double delay_us;      // Mean arrival delay above the envelope (serial buffering jitter), 0 until locked
+    uint64_t dropped;     // Samples the envelope shows were lost before the host
+    uint64_t duplicated;  // Samples the envelope shows arrived twice
+};
+
+// Recovers the ADC sample clock from bursty serial arrivals. Samples reach
+// the host in batches whose arrival times carry the USB/termios buffering
+// delay, which is never negative and is close to its minimum for some batch
+// every second or so. Each SAMPLE_CLOCK_BIN_MS of samples keeps the batch
+// with the smallest delay, and a least-squares line through the last
+// SAMPLE_CLOCK_BINS of these lower-envelope points gives the ADC rate and
+// phase: time_of() then places every sample at its acquisition time instead
+// of its arrival time.
+// Batches arriving before the line can place them mean samples were counted
+// twice; an envelope that stays raised by whole sample periods for two bins
+// means samples were lost. Both shift the index mapping so the line stays
+// locked, and are counted. Single-thread use (the processing thread), except
+// status(), which may be read from any thread.
+class SampleClock {
+public:
+    explicit SampleClock(double nominal_rate);
+    // Samples [0, end_index) had all been received by arrival_ns (steady clock)
+    void add_batch(uint64_t end_index, uint64_t arrival_ns);
+    // Acquisition time of a sample in steady-clock ns. Until the clock locks
+    // the nominal period is used (from sample 0 at time 0 with no arrivals).
+    double time_of(uint64_t index) const;
+    SampleClockStatus status() const { return published.load(); }
+    void reset();
+
+private:
+    struct Point {
+        double x;  // ADC index of the batch's last sample
+        double y;  // Arrival time in ns after base_ns
+    };
+
+    double predict(double x) const;
+    int64_t offset_for(uint64_t index) const;
+    void close_bin();
+    void slip(int64_t samples, uint64_t from_index);
+    void fit();
+    void publish();
+
+    const double nominal_rate;
+    const double nominal_period;  // ns
+    const double bin_samples;
+    bool have_base;
+    uint64_t base_ns;
+    uint64_t last_end;
+    int64_t offset;  // ADC index minus stream index for new samples
+    std::vector<std::pair<uint64_t, int64_t>> slips;  // (first stream index, offset from there)
+    std::deque<Point> envelope;
+    bool locked;
+    double intercept;  // ns after base_ns at ADC index 0
+    double slope;      // ns per sample
+    // Bin being filled
+    bool bin_open;
+    double bin_start;
+    Point bin_min;
+    double bin_min_residual;
+    double bin_delay_sum;
+    std::size_t bin_batches;
+    bool bin_lowered;           // Some batch came in under the line
+    uint64_t bin_lowered_from;  // Stream index of the first such batch
+    // A raised bin waits for the next to tell lost samples from a slow patch
+    bool have_raised;
+    Point raised;
+    double raised_residual;
+    uint64_t raised_from;
+    uint64_t bin_first_index;
+    double delay_us;
+    uint64_t dropped;
+    uint64_t duplicated;
+    SeqLock<SampleClockStatus> published;
+};
+
+#endif // SAMPLE_CLOCK_HPP
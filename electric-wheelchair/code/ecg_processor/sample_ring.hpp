@@ -0,0 +1,154 @@
+#ifndef SAMPLE_RING_HPP
+#define SAMPLE_RING_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+// Bounded single-producer/single-consumer ring buffer.
+// The producer pushes a batch of items and then calls notify(), which writes an
+// eventfd only if the consumer is actually asleep, so a burst of samples costs
+// at most one wakeup. Items that do not fit are dropped and counted as overruns
+// instead of blocking the producer.
+template <typename T, std::size_t Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+public:
+    SpscRing() : efd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (efd < 0) {
+            throw std::runtime_error("Failed to create eventfd: " + std::string(strerror(errno)));
+        }
+    }
+
+    ~SpscRing() {
+        ::close(efd);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side: append up to count items, counting the rest as overruns
+    std::size_t push(const T* items, std::size_t count) {
+        const std::size_t n = try_push(items, count);
+        if (n < count) {
+            overrun_count.store(overrun_count.load(std::memory_order_relaxed) + (count - n),
+                                std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    // Producer side: append as many of count items as fit, returns how many were stored
+    std::size_t try_push(const T* items, std::size_t count) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        std::size_t free_slots = Capacity - (h - cached_tail);
+        if (free_slots < count) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            free_slots = Capacity - (h - cached_tail);
+        }
+        const std::size_t n = count < free_slots ? count : free_slots;
+        for (std::size_t i = 0; i < n; ++i) {
+            slots[(h + i) & (Capacity - 1)] = items[i];
+        }
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Producer side: number of items that can be pushed right now
+    std::size_t free_space() {
+        cached_tail = tail.load(std::memory_order_acquire);
+        return Capacity - (head.load(std::memory_order_relaxed) - cached_tail);
+    }
+
+    // Producer side: wake the consumer if it is blocked in pop_wait()
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false)) {
+            signal();
+            wakeup_count.store(wakeup_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    // Consumer side: take up to max items without blocking
+    std::size_t pop(T* out, std::size_t max) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t available = cached_head - t;
+        if (available < max) {
+            cached_head = head.load(std::memory_order_acquire);
+            available = cached_head - t;
+        }
+        const std::size_t n = max < available ? max : available;
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = slots[(t + i) & (Capacity - 1)];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side: take up to max items, sleeping until data arrives,
+    // wake() is called or timeout_ms elapses
+    std::size_t pop_wait(T* out, std::size_t max, int timeout_ms) {
+        std::size_t n = pop(out, max);
+        if (n > 0) return n;
+
+        waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        n = pop(out, max);  // Re-check so a push racing with the flag is not missed
+        if (n > 0) {
+            waiting.store(false, std::memory_order_relaxed);
+            return n;
+        }
+
+        struct pollfd pfd = {efd, POLLIN, 0};
+        ::poll(&pfd, 1, timeout_ms);
+        uint64_t counter;
+        while (::read(efd, &counter, sizeof(counter)) > 0) {}
+        waiting.store(false, std::memory_order_relaxed);
+        return pop(out, max);
+    }
+
+    // Wake the consumer unconditionally (used on shutdown)
+    void wake() {
+        signal();
+    }
+
+    std::size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    static constexpr std::size_t capacity() { return Capacity; }
+    // Items dropped because the ring was full
+    uint64_t overruns() const { return overrun_count.load(std::memory_order_relaxed); }
+    // Number of eventfd wakeups issued by notify()
+    uint64_t wakeups() const { return wakeup_count.load(std::memory_order_relaxed); }
+
+private:
+    void signal() {
+        const uint64_t one = 1;
+        ssize_t ret = ::write(efd, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // Producer-owned line
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head{0};
+    std::size_t cached_tail = 0;
+    std::atomic<uint64_t> overrun_count{0};
+    std::atomic<uint64_t> wakeup_count{0};
+    // Consumer-owned line
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail{0};
+    std::size_t cached_head = 0;
+    // Shared sleep flag
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> waiting{false};
+    int efd;
+    alignas(CACHE_LINE_SIZE) std::array<T, Capacity> slots;
+};
+
+#endif // SAMPLE_RING_HPP
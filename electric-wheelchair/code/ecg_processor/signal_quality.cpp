@@ -0,0 +1,144 @@
+#include "signal_quality.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+// 1 when value is 0, falling linearly to 0 at limit
+double penalty(double value, double limit) {
+    return std::max(0.0, 1.0 - value / limit);
+}
+}
+
+SignalQualityIndex::SignalQualityIndex(int sample_rate, std::size_t leads)
+    : lead_count(leads),
+      segment_length(static_cast<std::size_t>(sample_rate) * SQI_SEGMENT_MS / 1000),
+      clip_run(std::max<std::size_t>(2, static_cast<std::size_t>(sample_rate) * SQI_CLIP_RUN_MS / 1000)),
+      recovery_samples(static_cast<uint64_t>(sample_rate) * SQI_RECOVERY_MS / 1000)
+{
+    if (leads == 0 || leads > SQI_MAX_LEADS) {
+        throw std::invalid_argument("SignalQualityIndex supports 1 to 8 leads");
+    }
+    if (sample_rate <= 0) {
+        throw std::invalid_argument("Sample rate must be positive");
+    }
+    reset();
+}
+
+void SignalQualityIndex::reset() {
+    state.fill(LeadState{});
+    position = 0;
+    segment_index = 0;
+    segment_count = 0;
+    samples_seen = 0;
+    good_samples = 0;
+    quality = SignalQuality{1.0, false, 0.0, 0.0, 0.0, true};
+}
+
+const SignalQuality& SignalQualityIndex::update(const double* frames, std::size_t count) {
+    for (std::size_t n = 0; n < count; ++n) {
+        const double* frame = frames + n * lead_count;
+        for (std::size_t lead = 0; lead < lead_count; ++lead) {
+            LeadState& s = state[lead];
+            const double v = frame[lead];
+            if (samples_seen == 0) {
+                s.x1 = s.x2 = v;
+                s.run = 0;
+            }
+            if (position == 0) {
+                s.low = s.high = v;
+            }
+            s.sum += v;
+            s.sum_squares += v * v;
+            s.low = std::min(s.low, v);
+            s.high = std::max(s.high, v);
+            // The second difference of white noise has 6 times its variance;
+            // smooth ECG waves contribute little to it
+            const double d2 = v - 2.0 * s.x1 + s.x2;
+            s.curvature += d2 * d2;
+
+            // A run counts as clipped from the sample it reaches clip_run, as
+            // long as it sits at an extreme of this or the previous segment
+            s.run = v == s.x1 ? s.run + 1 : 1;
+            if (s.run >= clip_run) {
+                const Segment& previous = s.segments[(segment_index + SQI_SEGMENTS - 1) % SQI_SEGMENTS];
+                const bool have_previous = segment_count > 0;
+                const double high = have_previous ? std::max(s.high, previous.high) : s.high;
+                const double low = have_previous ? std::min(s.low, previous.low) : s.low;
+                if (v >= high || v <= low) s.clipped += s.run == clip_run ? clip_run : 1;
+            }
+            s.x2 = s.x1;
+            s.x1 = v;
+        }
+        ++samples_seen;
+        if (++position == segment_length) close_segment();
+    }
+    return quality;
+}
+
+void SignalQualityIndex::close_segment() {
+    SignalQuality best{-1.0, true, 0.0, 0.0, 0.0, false};
+    for (std::size_t lead = 0; lead < lead_count; ++lead) {
+        LeadState& s = state[lead];
+        const double n = static_cast<double>(position);
+        Segment& segment = s.segments[segment_index];
+        segment.mean = s.sum / n;
+        segment.variance = std::max(0.0, s.sum_squares / n - segment.mean * segment.mean);
+        segment.noise_power = s.curvature / n / 6.0;
+        segment.clipped = s.clipped;
+        segment.low = s.low;
+        segment.high = s.high;
+        s.sum = s.sum_squares = s.curvature = 0.0;
+        s.clipped = 0;
+    }
+    segment_count = std::min(segment_count + 1, SQI_SEGMENTS);
+    for (std::size_t lead = 0; lead < lead_count; ++lead) {
+        const SignalQuality q = score_lead(state[lead]);
+        if (q.score > best.score) best = q;
+    }
+    segment_index = (segment_index + 1) % SQI_SEGMENTS;
+    position = 0;
+
+    // Suspend at once, resume only after a stretch of good signal. A window
+    // shorter than a beat interval can hold just noise, so the first window
+    // must fill before it can suspend
+    bool detecting = quality.detecting;
+    if (best.score < SQI_MIN_SCORE && segment_count == SQI_SEGMENTS) {
+        detecting = false;
+        good_samples = 0;
+    } else if (!detecting) {
+        good_samples += segment_length;
+        detecting = good_samples >= recovery_samples;
+    }
+    best.detecting = detecting;
+    quality = best;
+}
+
+SignalQuality SignalQualityIndex::score_lead(const LeadState& lead) const {
+    double variance = 0.0, noise = 0.0, max_stddev = 0.0;
+    uint64_t clipped = 0;
+    for (std::size_t k = 0; k < segment_count; ++k) {
+        const Segment& segment = lead.segments[k];
+        variance += segment.variance;
+        noise += segment.noise_power;
+        clipped += segment.clipped;
+        max_stddev = std::max(max_stddev, std::sqrt(segment.variance));
+    }
+    variance /= segment_count;
+    noise /= segment_count;
+
+    SignalQuality q{};
+    // Any activity in the window means the electrode is connected
+    q.flat = max_stddev < SQI_FLAT_STDDEV;
+    q.clipping = static_cast<double>(clipped) / (segment_count * segment_length);
+    q.noise_ratio = variance > 0.0 ? std::min(1.0, noise / variance) : 1.0;
+    if (segment_count > 1 && variance > 0.0) {
+        const Segment& latest = lead.segments[segment_index];
+        const Segment& previous = lead.segments[(segment_index + SQI_SEGMENTS - 1) % SQI_SEGMENTS];
+        q.wander = std::abs(latest.mean - previous.mean) / std::sqrt(variance);
+    }
+    q.score = q.flat ? 0.0
+                     : penalty(q.clipping, SQI_CLIPPING_LIMIT) * penalty(q.noise_ratio, SQI_NOISE_LIMIT) *
+                           penalty(q.wander, SQI_WANDER_LIMIT);
+    return q;
+}
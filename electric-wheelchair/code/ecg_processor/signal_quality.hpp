@@ -0,0 +1,89 @@
+#ifndef SIGNAL_QUALITY_HPP
+#define SIGNAL_QUALITY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Each defect lowers the score linearly and zeroes it at its limit, so with
+// the other defects absent detection stops at half the limit
+constexpr double SQI_FLAT_STDDEV = 2.0;       // Below this (in ECG units) a lead is flat: electrode off
+constexpr int SQI_CLIP_RUN_MS = 8;            // Identical samples at a running extreme for this long are clipping
+constexpr double SQI_CLIPPING_LIMIT = 0.1;    // Fraction of clipped samples
+constexpr double SQI_NOISE_LIMIT = 0.6;       // White-noise share of the signal power
+constexpr double SQI_WANDER_LIMIT = 3.0;      // Segment-to-segment mean step, in standard deviations
+constexpr double SQI_MIN_SCORE = 0.5;         // Detection is suspended below this score
+constexpr int SQI_SEGMENT_MS = 250;           // Statistics are gathered per segment
+constexpr std::size_t SQI_SEGMENTS = 8;       // and scored over the last 2 s
+constexpr int SQI_RECOVERY_MS = 1000;         // Good signal needed before detection resumes
+constexpr std::size_t SQI_MAX_LEADS = 8;
+
+// Signal quality over the last SQI_SEGMENTS segments. The score is 1 for a
+// clean signal and falls towards 0 as each defect approaches its limit.
+struct SignalQuality {
+    double score;
+    bool flat;            // No signal: electrode off or amplifier idle
+    double clipping;      // Fraction of samples stuck at the signal extremes
+    double noise_ratio;   // Estimated white-noise power over total AC power
+    double wander;        // Last segment-to-segment mean step, in standard deviations
+    bool detecting;       // QRS detection is running
+};
+
+// Cheap signal quality index on the raw (unfiltered) samples.
+// Each sample updates a few running sums per lead: sum, sum of squares,
+// second-difference energy (white noise) and runs of identical values at the
+// running extremes (clipping). Every SQI_SEGMENT_MS the segment is closed and
+// the lead scored over the recent segments, which always span at least one
+// beat; the best lead sets the score, since detection works as long as one
+// lead is usable. Below SQI_MIN_SCORE detection is suspended until the signal
+// has been good for SQI_RECOVERY_MS. Results do not depend on how samples are
+// split into blocks.
+class SignalQualityIndex {
+public:
+    SignalQualityIndex(int sample_rate, std::size_t leads);
+
+    // Feed count frames of leads() interleaved raw values
+    const SignalQuality& update(const double* frames, std::size_t count);
+    const SignalQuality& last() const { return quality; }
+    // Forget history and resume detection
+    void reset();
+
+    std::size_t leads() const { return lead_count; }
+
+private:
+    struct Segment {
+        double mean;
+        double variance;
+        double noise_power;  // Second-difference energy / 6 per sample
+        double low, high;
+        uint64_t clipped;
+    };
+    struct LeadState {
+        // Open segment
+        double sum, sum_squares, curvature;
+        double low, high;
+        uint64_t clipped;
+        // Sample history
+        double x1, x2;
+        std::size_t run;
+        // Closed segments
+        std::array<Segment, SQI_SEGMENTS> segments;
+    };
+
+    void close_segment();
+    SignalQuality score_lead(const LeadState& lead) const;
+
+    const std::size_t lead_count;
+    const std::size_t segment_length;  // Samples
+    const std::size_t clip_run;        // Samples
+    const uint64_t recovery_samples;
+    std::array<LeadState, SQI_MAX_LEADS> state;
+    std::size_t position;         // Samples in the open segment
+    std::size_t segment_index;    // Next slot in the segment rings
+    std::size_t segment_count;    // Closed segments, up to SQI_SEGMENTS
+    uint64_t samples_seen;
+    uint64_t good_samples;        // Since quality last dropped
+    SignalQuality quality;
+};
+
+#endif // SIGNAL_QUALITY_HPP
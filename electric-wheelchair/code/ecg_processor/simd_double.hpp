@@ -0,0 +1,99 @@
+#ifndef SIMD_DOUBLE_HPP
+#define SIMD_DOUBLE_HPP
+
+#include <cstddef>
+
+// Minimal vector-of-doubles abstraction used to run the same arithmetic on
+// several ECG leads at once. The widest instruction set enabled at compile
+// time is used: AVX (build with -mavx2 or -march=native), SSE2 (every x86-64
+// build), NEON on 64-bit ARM (Raspberry Pi OS 64-bit), otherwise plain scalar
+// code. All loads and stores are unaligned.
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace simd {
+
+#if defined(__AVX__)
+
+using vdouble = __m256d;
+constexpr std::size_t LANES = 4;
+constexpr const char* NAME = "AVX";
+inline vdouble load(const double* p) { return _mm256_loadu_pd(p); }
+inline void store(double* p, vdouble v) { _mm256_storeu_pd(p, v); }
+inline vdouble broadcast(double x) { return _mm256_set1_pd(x); }
+inline vdouble add(vdouble a, vdouble b) { return _mm256_add_pd(a, b); }
+inline vdouble sub(vdouble a, vdouble b) { return _mm256_sub_pd(a, b); }
+inline vdouble mul(vdouble a, vdouble b) { return _mm256_mul_pd(a, b); }
+inline double sum(vdouble v) {
+    const __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+#elif defined(__SSE2__)
+
+using vdouble = __m128d;
+constexpr std::size_t LANES = 2;
+constexpr const char* NAME = "SSE2";
+inline vdouble load(const double* p) { return _mm_loadu_pd(p); }
+inline void store(double* p, vdouble v) { _mm_storeu_pd(p, v); }
+inline vdouble broadcast(double x) { return _mm_set1_pd(x); }
+inline vdouble add(vdouble a, vdouble b) { return _mm_add_pd(a, b); }
+inline vdouble sub(vdouble a, vdouble b) { return _mm_sub_pd(a, b); }
+inline vdouble mul(vdouble a, vdouble b) { return _mm_mul_pd(a, b); }
+inline double sum(vdouble v) { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+using vdouble = float64x2_t;
+constexpr std::size_t LANES = 2;
+constexpr const char* NAME = "NEON";
+inline vdouble load(const double* p) { return vld1q_f64(p); }
+inline void store(double* p, vdouble v) { vst1q_f64(p, v); }
+inline vdouble broadcast(double x) { return vdupq_n_f64(x); }
+inline vdouble add(vdouble a, vdouble b) { return vaddq_f64(a, b); }
+inline vdouble sub(vdouble a, vdouble b) { return vsubq_f64(a, b); }
+inline vdouble mul(vdouble a, vdouble b) { return vmulq_f64(a, b); }
+inline double sum(vdouble v) { return vaddvq_f64(v); }
+
+#else
+
+using vdouble = double;
+constexpr std::size_t LANES = 1;
+constexpr const char* NAME = "scalar";
+inline vdouble load(const double* p) { return *p; }
+inline void store(double* p, vdouble v) { *p = v; }
+inline vdouble broadcast(double x) { return x; }
+inline vdouble add(vdouble a, vdouble b) { return a + b; }
+inline vdouble sub(vdouble a, vdouble b) { return a - b; }
+inline vdouble mul(vdouble a, vdouble b) { return a * b; }
+inline double sum(vdouble v) { return v; }
+
+#endif
+
+// Dot product of two arrays of n values
+inline double dot(const double* a, const double* b, std::size_t n) {
+    vdouble acc = broadcast(0.0);
+    std::size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        acc = add(acc, mul(load(a + i), load(b + i)));
+    }
+    double result = sum(acc);
+    for (; i < n; ++i) {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+// Number of doubles needed to hold n values in whole vectors
+constexpr std::size_t padded(std::size_t n) {
+    return (n + LANES - 1) / LANES * LANES;
+}
+
+}  // namespace simd
+
+#endif // SIMD_DOUBLE_HPP
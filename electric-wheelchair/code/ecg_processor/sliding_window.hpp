@@ -0,0 +1,85 @@
+#ifndef SLIDING_WINDOW_HPP
+#define SLIDING_WINDOW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Fixed-length window over the most recent samples of a stream.
+// Samples live in a ring buffer allocated once at construction. Running max and
+// min are kept in monotonic queues of sample sequence numbers, so push(), max()
+// and min() are O(1) amortized regardless of the window length.
+template <typename T>
+class SlidingWindow {
+public:
+    explicit SlidingWindow(std::size_t capacity)
+        : values(capacity), max_queue(capacity), min_queue(capacity), window_capacity(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("SlidingWindow capacity must be positive");
+        }
+        clear();
+    }
+
+    // Append a sample, evicting the oldest one once the window is full
+    void push(T value) {
+        const uint64_t seq = next_seq++;
+        values[seq % window_capacity] = value;
+        const uint64_t oldest = seq + 1 > window_capacity ? seq + 1 - window_capacity : 0;
+        push_monotonic(max_queue, max_front, max_count, seq, oldest, [&](T held) { return held <= value; });
+        push_monotonic(min_queue, min_front, min_count, seq, oldest, [&](T held) { return held >= value; });
+    }
+
+    void push(const T* samples, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            push(samples[i]);
+        }
+    }
+
+    // Largest sample in the window (window must not be empty)
+    T max() const { return values[max_queue[max_front] % window_capacity]; }
+    // Smallest sample in the window (window must not be empty)
+    T min() const { return values[min_queue[min_front] % window_capacity]; }
+
+    void clear() {
+        next_seq = 0;
+        max_front = max_count = 0;
+        min_front = min_count = 0;
+    }
+
+    std::size_t size() const { return next_seq < window_capacity ? next_seq : window_capacity; }
+    bool empty() const { return next_seq == 0; }
+    bool full() const { return next_seq >= window_capacity; }
+    std::size_t capacity() const { return window_capacity; }
+    // Total number of samples pushed since construction or clear()
+    uint64_t total() const { return next_seq; }
+
+private:
+    // Drop expired entries from the front and dominated entries from the back,
+    // then append seq. The queue is a ring of window_capacity sequence numbers.
+    template <typename Dominated>
+    void push_monotonic(std::vector<uint64_t>& queue, std::size_t& front, std::size_t& count,
+                        uint64_t seq, uint64_t oldest, Dominated dominated) {
+        while (count > 0 && queue[front] < oldest) {
+            front = (front + 1) % window_capacity;
+            --count;
+        }
+        while (count > 0) {
+            const std::size_t back = (front + count - 1) % window_capacity;
+            if (!dominated(values[queue[back] % window_capacity])) break;
+            --count;
+        }
+        queue[(front + count) % window_capacity] = seq;
+        ++count;
+    }
+
+    std::vector<T> values;           // Ring of the last window_capacity samples
+    std::vector<uint64_t> max_queue; // Decreasing values, oldest first
+    std::vector<uint64_t> min_queue; // Increasing values, oldest first
+    std::size_t window_capacity;
+    uint64_t next_seq;
+    std::size_t max_front, max_count;
+    std::size_t min_front, min_count;
+};
+
+#endif // SLIDING_WINDOW_HPP
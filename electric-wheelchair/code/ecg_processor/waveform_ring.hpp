@@ -0,0 +1,100 @@
+#ifndef WAVEFORM_RING_HPP
+#define WAVEFORM_RING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+// Single-writer broadcast ring of frames (leads values each) for any number
+// of readers. Every reader keeps its own cursor, the absolute index of the
+// next frame it wants, so consumers at different paces (dashboard, recorder,
+// network) share one copy of the stream. The writer never waits:
+// a reader that falls more than capacity() frames behind skips to the oldest
+// frame still held. As with SeqLock, the writer announces the frames it is
+// about to overwrite before touching them, and a reader drops whatever may
+// have been overwritten while it was copying. T must be lock-free as an atomic.
+template <typename T>
+class BroadcastRing {
+    static_assert(std::atomic<T>::is_always_lock_free, "BroadcastRing values must be lock-free atomics");
+public:
+    // capacity_frames is rounded up to a power of two
+    BroadcastRing(std::size_t capacity_frames, std::size_t leads)
+        : lead_count(leads), frames(1), claimed(0), written(0)
+    {
+        if (leads == 0) throw std::invalid_argument("BroadcastRing needs at least one lead");
+        while (frames < capacity_frames) frames <<= 1;
+        values.reset(new std::atomic<T>[frames * leads]);
+        for (std::size_t i = 0; i < frames * leads; ++i) values[i].store(T{}, std::memory_order_relaxed);
+    }
+
+    BroadcastRing(const BroadcastRing&) = delete;
+    BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+    // Writer side: append count frames of leads() packed values
+    void write(const T* data, std::size_t count) {
+        const uint64_t end = written.load(std::memory_order_relaxed);
+        claimed.store(end + count, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::atomic<T>* slot = &values[((end + i) & (frames - 1)) * lead_count];
+            for (std::size_t lead = 0; lead < lead_count; ++lead) {
+                slot[lead].store(data[i * lead_count + lead], std::memory_order_relaxed);
+            }
+        }
+        written.store(end + count, std::memory_order_release);
+    }
+
+    // Reader side: copy up to max frames starting at cursor into out and
+    // advance cursor past them. If the frames at cursor are gone, cursor first
+    // jumps to the oldest frame held; the jump is added to lost if given.
+    std::size_t read(uint64_t& cursor, T* out, std::size_t max, uint64_t* lost = nullptr) const {
+        const uint64_t end = written.load(std::memory_order_acquire);
+        if (cursor > end) cursor = end;
+        skip_to(cursor, end > frames ? end - frames : 0, lost);
+        std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(max, end - cursor));
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::atomic<T>* slot = &values[((cursor + i) & (frames - 1)) * lead_count];
+            for (std::size_t lead = 0; lead < lead_count; ++lead) {
+                out[i * lead_count + lead] = slot[lead].load(std::memory_order_relaxed);
+            }
+        }
+        // Frames the writer has claimed since may hold a mix of old and new values
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t busy = claimed.load(std::memory_order_relaxed);
+        const uint64_t oldest = busy > frames ? busy - frames : 0;
+        if (oldest > cursor) {
+            const std::size_t stale = static_cast<std::size_t>(std::min<uint64_t>(n, oldest - cursor));
+            std::copy(out + stale * lead_count, out + n * lead_count, out);
+            n -= stale;
+            skip_to(cursor, oldest, lost);
+        }
+        cursor += n;
+        return n;
+    }
+
+    // Frames written so far; a new reader starts here for live data only
+    uint64_t end() const { return written.load(std::memory_order_acquire); }
+    std::size_t capacity() const { return frames; }
+    std::size_t leads() const { return lead_count; }
+
+private:
+    static void skip_to(uint64_t& cursor, uint64_t oldest, uint64_t* lost) {
+        if (cursor >= oldest) return;
+        if (lost) *lost += oldest - cursor;
+        cursor = oldest;
+    }
+
+    const std::size_t lead_count;
+    std::size_t frames;
+    std::unique_ptr<std::atomic<T>[]> values;
+    std::atomic<uint64_t> claimed;  // Frames the writer has started on
+    std::atomic<uint64_t> written;  // Frames complete
+};
+
+// Filtered ECG frames
+using WaveformRing = BroadcastRing<double>;
+
+#endif // WAVEFORM_RING_HPP
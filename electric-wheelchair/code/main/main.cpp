@@ -4,6 +4,7 @@
 #include "UltrasonicSensor.hpp"
 #include "pir_sensor.hpp"
 #include "ecg_processor.hpp"
+#include "ecg_stream.hpp"
 #include "syn6288_controller.hpp"  // TTS module header
 #include "mjpeg_server.hpp"
 #include "LEDController.hpp"       // LED module header
@@ -19,19 +20,27 @@
 #include <boost/asio.hpp>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <signal.h>
 
 using namespace std::chrono;
 
 // Global termination flag
 volatile std::sig_atomic_t g_running = 1;
+// Set by SIGUSR1: print the ECG latency histograms
+volatile std::sig_atomic_t g_dump_latency = 0;
 
 // Global sensor state variables
 std::atomic<bool> g_lightState{false};       // true = Dark, false = Light
 std::atomic<bool> g_motionDetected{false};   // true = Motion detected, false = No motion
 
-// Global variable to store the latest converted ECG value
-std::atomic<double> g_latest_ecg_value{0.0};
+// ECG processor published to the HTTP server once it is running (nullptr otherwise)
+std::atomic<const StableECGProcessor*> g_ecg_processor{nullptr};
+
+// Live ECG waveform clients (/ecg/stream), each on its own thread
+constexpr int ECG_STREAM_MAX_CLIENTS = 4;
+constexpr int ECG_STREAM_INTERVAL_MS = 100;
+std::atomic<int> g_stream_clients{0};
 
 // Global ultrasonic sensor data for webpage display and associated mutex
 std::mutex g_sensor_mutex;
@@ -45,58 +54,42 @@ void signalHandler(int signum) {
     g_running = 0;
 }
 
-// InterceptBuf class to intercept std::cerr output and update g_latest_ecg_value
-class InterceptBuf : public std::streambuf {
-public:
-    InterceptBuf(std::streambuf* orig) : orig_buf(orig) {}
-protected:
-    virtual int overflow(int c) override {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (c != EOF) {
-            char ch = static_cast<char>(c);
-            buffer.push_back(ch);
-            if (ch == '\n') {
-                processLine(buffer);
-                buffer.clear();
-            }
-            return orig_buf->sputc(c);
-        }
-        return c;
-    }
-    virtual std::streamsize xsputn(const char* s, std::streamsize count) override {
-        std::lock_guard<std::mutex> lock(mtx);
-        std::string str(s, count);
-        buffer.append(str);
-        size_t pos = 0;
-        while ((pos = buffer.find('\n')) != std::string::npos) {
-            std::string line = buffer.substr(0, pos + 1);
-            processLine(line);
-            buffer.erase(0, pos + 1);
-        }
-        return orig_buf->sputn(s, count);
-    }
-    void processLine(const std::string& line) {
-        // Process lines containing "Converted ECG Value:" to update g_latest_ecg_value
-        if (line.find("Converted ECG Value:") != std::string::npos) {
-            size_t pos = line.find(":");
-            if (pos != std::string::npos) {
-                std::istringstream iss(line.substr(pos + 1));
-                double value;
-                if (iss >> value) {
-                    g_latest_ecg_value.store(value);
-                }
-            }
+void latencyDumpHandler(int signum) {
+    g_dump_latency = 1;
+}
+
+// Push the live ECG waveform to one client as Server-Sent Events (see
+// EcgStream) until it disconnects or the program stops. Sends never block:
+// a client whose socket buffer is full is dropped, and the browser's
+// EventSource reconnects from the live end. fd is the connection, closed here.
+void stream_ecg(int fd) {
+    auto send_all = [fd](const std::string& data) {
+        return ::send(fd, data.data(), data.size(), MSG_DONTWAIT | MSG_NOSIGNAL) == static_cast<ssize_t>(data.size());
+    };
+    const std::string header = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/event-stream\r\n"
+                               "Cache-Control: no-cache\r\n"
+                               "\r\n"
+                               "retry: 1000\n\n";
+    const StableECGProcessor* processor = g_ecg_processor.load(std::memory_order_acquire);
+    if (processor && send_all(header)) {
+        EcgStream stream(*processor);
+        while (g_running) {
+            processor = g_ecg_processor.load(std::memory_order_acquire);
+            if (!processor) break;
+            const std::string event = stream.next_event(*processor);
+            if (!event.empty() && !send_all(event)) break;
+            std::this_thread::sleep_for(milliseconds(ECG_STREAM_INTERVAL_MS));
         }
     }
-private:
-    std::streambuf* orig_buf;
-    std::string buffer;
-    std::mutex mtx;
-};
+    ::close(fd);
+    g_stream_clients.fetch_sub(1);
+}
 
-// HTTP server function using Boost.Asio that serves two endpoints:
+// HTTP server function using Boost.Asio that serves three endpoints:
 // "/" returns an HTML page with JavaScript for auto-refresh
 // "/data" returns JSON sensor data
+// "/ecg/stream" streams the live ECG waveform (stream_ecg)
 
 void run_http_server() {
     try {
@@ -130,7 +123,19 @@ void run_http_server() {
             }
             
             std::string response;
-            if (request_line.find("GET /data") != std::string::npos) {
+            if (request_line.find("GET /ecg/stream") != std::string::npos) {
+                // The stream thread keeps its own descriptor for the connection
+                if (g_ecg_processor.load(std::memory_order_acquire) &&
+                    g_stream_clients.load() < ECG_STREAM_MAX_CLIENTS) {
+                    const int fd = ::dup(socket.native_handle());
+                    if (fd >= 0) {
+                        g_stream_clients.fetch_add(1);
+                        std::thread(stream_ecg, fd).detach();
+                        continue;
+                    }
+                }
+                response = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 5\r\nContent-Length: 0\r\n\r\n";
+            } else if (request_line.find("GET /data") != std::string::npos) {
                 std::stringstream json;
                 json << "{";
                 json << "\"light\":\"" << (g_lightState.load() ? "Dark" : "Light") << "\",";
@@ -139,8 +144,38 @@ void run_http_server() {
                     json << "\"ultrasonic\":\"" << g_ultrasonic_str << "\",";
                 }
                 json << "\"pir\":\"" << (g_motionDetected.load() ? "Motion detected" : "No motion") << "\",";
-                double ecg_val = g_latest_ecg_value.load();
-                json << "\"ecg\":" << std::fixed << std::setprecision(1) << ecg_val;
+                EcgStatus ecg{};
+                HrvMetrics hrv{};
+                RhythmStatus rhythm{};
+                SignalQuality quality{};
+                std::vector<double> wave;  // Last second of the filtered first lead at the waveform rate
+                if (const StableECGProcessor* processor = g_ecg_processor.load(std::memory_order_acquire)) {
+                    ecg = processor->latest();
+                    hrv = processor->hrv_metrics();
+                    rhythm = processor->rhythm();
+                    quality = processor->signal_quality();
+                    const WaveformRing& ring = processor->waveform();
+                    const std::size_t frames = static_cast<std::size_t>(processor->waveform_rate());
+                    uint64_t cursor = ring.end() > frames ? ring.end() - frames : 0;
+                    std::vector<double> recent(frames * ring.leads());
+                    const std::size_t n = ring.read(cursor, recent.data(), frames);
+                    for (std::size_t i = 0; i < n; ++i) wave.push_back(recent[i * ring.leads()]);
+                }
+                json << "\"ecg\":" << std::fixed << std::setprecision(1) << ecg.value << ",";
+                json << "\"hr\":" << std::fixed << std::setprecision(0) << ecg.heart_rate << ",";
+                json << "\"sdnn\":" << std::setprecision(1) << hrv.sdnn << ",";
+                json << "\"rmssd\":" << hrv.rmssd << ",";
+                json << "\"pnn50\":" << hrv.pnn50 << ",";
+                json << "\"lf_hf\":" << std::setprecision(2) << hrv.lf_hf << ",";
+                json << "\"premature\":" << rhythm.premature << ",";
+                json << "\"ectopic\":" << rhythm.ectopic << ",";
+                json << "\"af_like\":" << (rhythm.af_like ? "true" : "false") << ",";
+                json << "\"quality\":" << std::setprecision(2) << ecg.quality << ",";
+                json << "\"lead_off\":" << (quality.flat ? "true" : "false") << ",";
+                json << "\"detecting\":" << (quality.detecting ? "true" : "false") << ",";
+                json << "\"wave\":[" << std::setprecision(1);
+                for (std::size_t i = 0; i < wave.size(); ++i) json << (i ? "," : "") << wave[i];
+                json << "]";
                 json << "}";
                 
                 std::stringstream response_stream;
@@ -151,7 +186,7 @@ void run_http_server() {
                 response_stream << json.str();
                 response = response_stream.str();
             } else {
-                std::string html = R"(
+                std::string html = R"HTML(
 <!DOCTYPE html>
 <html>
 <head>
@@ -166,11 +201,77 @@ void run_http_server() {
          document.getElementById("ultrasonic").innerText = data.ultrasonic;
          document.getElementById("pir").innerText = data.pir;
          document.getElementById("ecg").innerText = data.ecg.toFixed(1);
+         document.getElementById("hr").innerText = data.hr > 0 ? data.hr.toFixed(0) + " bpm" : "--";
+         document.getElementById("hrv").innerText = data.sdnn > 0
+           ? "SDNN " + data.sdnn.toFixed(1) + " ms, RMSSD " + data.rmssd.toFixed(1) + " ms, pNN50 "
+             + data.pnn50.toFixed(1) + "%, LF/HF " + (data.lf_hf > 0 ? data.lf_hf.toFixed(2) : "--")
+           : "--";
+         document.getElementById("rhythm").innerText = data.premature + " premature, " + data.ectopic
+           + " ectopic beats" + (data.af_like ? ", irregular rhythm (AF-like)" : "");
+         document.getElementById("quality").innerText = (data.quality * 100).toFixed(0) + "%"
+           + (data.lead_off ? ", electrode off" : data.detecting ? "" : ", signal too poor for detection");
       })
       .catch(err => console.error(err));
     }
+    // Live trace from /ecg/stream: the last few seconds of the first lead
+    // with R-peak markers, all indexed by waveform frame
+    const trace = {seq: 0, values: [], beats: []};
+    function addChunk(chunk) {
+      if (chunk.seq !== trace.seq + trace.values.length) {
+        trace.seq = chunk.seq;  // Skipped ahead or reconnected: start over
+        trace.values = [];
+        trace.beats = [];
+      }
+      const bytes = atob(chunk.d);
+      const frame = new Array(chunk.leads).fill(0);
+      let lead = 0, v = 0, scale = 1;
+      for (let i = 0; i < bytes.length; ++i) {
+        const b = bytes.charCodeAt(i);
+        v += (b & 0x7f) * scale;
+        scale *= 128;
+        if (b & 0x80) continue;
+        frame[lead] += v % 2 ? -(v + 1) / 2 : v / 2;  // Zig-zag delta
+        if (lead === 0) trace.values.push(frame[0] * chunk.step);
+        lead = (lead + 1) % chunk.leads;
+        v = 0;
+        scale = 1;
+      }
+      trace.beats.push(...chunk.r);
+      const excess = trace.values.length - Math.round(4 * chunk.rate);
+      if (excess > 0) {
+        trace.values.splice(0, excess);
+        trace.seq += excess;
+      }
+      trace.beats = trace.beats.filter(b => b >= trace.seq);
+      drawWave(trace.values, trace.beats.map(b => b - trace.seq));
+    }
+    function drawWave(wave, marks) {
+      const canvas = document.getElementById("wave");
+      const ctx = canvas.getContext("2d");
+      ctx.clearRect(0, 0, canvas.width, canvas.height);
+      if (!wave || wave.length < 2) return;
+      const range = Math.max(1, ...wave.map(Math.abs));
+      const step = canvas.width / (wave.length - 1);
+      ctx.strokeStyle = "red";
+      marks.forEach(m => {
+        ctx.beginPath();
+        ctx.moveTo(m * step, 0);
+        ctx.lineTo(m * step, canvas.height);
+        ctx.stroke();
+      });
+      ctx.strokeStyle = "black";
+      ctx.beginPath();
+      wave.forEach((v, i) => {
+        const y = canvas.height / 2 - v / range * canvas.height / 2;
+        if (i === 0) ctx.moveTo(0, y); else ctx.lineTo(i * step, y);
+      });
+      ctx.stroke();
+    }
     setInterval(updateData, 1000);
-    window.onload = updateData;
+    window.onload = () => {
+      updateData();
+      new EventSource('/ecg/stream').addEventListener('ecg', e => addChunk(JSON.parse(e.data)));
+    };
   </script>
 </head>
 <body>
@@ -179,9 +280,14 @@ void run_http_server() {
   <p>Ultrasonic: <span id="ultrasonic"></span></p>
   <p>PIR: <span id="pir"></span></p>
   <p>ECG: <span id="ecg"></span></p>
+  <canvas id="wave" width="500" height="120"></canvas>
+  <p>Heart rate: <span id="hr"></span></p>
+  <p>HRV: <span id="hrv"></span></p>
+  <p>Rhythm: <span id="rhythm"></span></p>
+  <p>Signal quality: <span id="quality"></span></p>
 </body>
 </html>
-)";
+)HTML";
                 std::stringstream response_stream;
                 response_stream << "HTTP/1.1 200 OK\r\n";
                 response_stream << "Content-Type: text/html\r\n";
@@ -196,17 +302,41 @@ void run_http_server() {
     } catch (std::exception& e) {
         std::cerr << "HTTP server exception: " << e.what() << std::endl;
     }
+    // Stream clients see g_running (or the processor going away) within one interval
+    while (g_stream_clients.load() > 0) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
 }
 
+// Stops the HTTP server when it goes out of scope, whichever way the scope is
+// left: the ECG processor is withdrawn, g_running is cleared and the thread is
+// joined, which waits for the stream clients. Nothing the server reads is
+// destroyed while it still runs, and the thread is never left joinable.
+class HttpServerStop {
+public:
+    explicit HttpServerStop(std::thread& thread) : thread_(thread) {}
+    ~HttpServerStop() { stop(); }
+    HttpServerStop(const HttpServerStop&) = delete;
+    HttpServerStop& operator=(const HttpServerStop&) = delete;
+
+    void stop() {
+        g_ecg_processor.store(nullptr, std::memory_order_release);
+        g_running = 0;
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+private:
+    std::thread& thread_;
+};
+
 int main() {
     std::signal(SIGINT, signalHandler);
-    
-    // Install custom intercept buffer into std::cerr
-    InterceptBuf interceptor(std::cerr.rdbuf());
-    std::streambuf* oldCerrBuf = std::cerr.rdbuf(&interceptor);
+    std::signal(SIGUSR1, latencyDumpHandler);
     
     // Start HTTP server thread
     std::thread http_thread(run_http_server);
+    HttpServerStop httpStop(http_thread);
     
     try {
         // Initialize TTS controller (using "/dev/serial0", for GPIO14/15, baud rate 9600)
@@ -318,6 +448,8 @@ int main() {
         // Initialize ECG processor and serial reader (/dev/ttyUSB0)
         StableECGProcessor ecgProcessor;
         ReliableSerialReader ecgReader("/dev/ttyUSB0", ecgProcessor);
+        // Declared after the processor, so the server is stopped before it is destroyed
+        HttpServerStop ecgHttpStop(http_thread);
         ecgProcessor.start();
         ecgReader.start();
         
@@ -327,6 +459,8 @@ int main() {
             std::cerr << "Failed to start camera server" << std::endl;
             return 1;
         }
+        // Everything that can fail has started: publish the processor to the HTTP server
+        g_ecg_processor.store(&ecgProcessor, std::memory_order_release);
           std::cout << "All modules started:" << std::endl;
         std::cout << "  - Motor control via button on GPIO5 (FORWARD/BACKWARD)" << std::endl;
         std::cout << "  - Second motor control via button on GPIO6 (RISE/FALL)" << std::endl;
@@ -380,11 +514,15 @@ int main() {
             
                // ECG sensor: update every 3 seconds
             if (duration_cast<seconds>(now - last_ecg_disp).count() >= 3) {
-                double ecg_val = g_latest_ecg_value.load();
+                EcgStatus ecg = ecgProcessor.latest();
                 std::cout << "Latest Converted ECG Value: " << std::fixed << std::setprecision(1)
-                          << ecg_val << " (converted value)" << std::endl;
+                          << ecg.value << " (converted value), HR: " << ecg.heart_rate << " bpm" << std::endl;
                 last_ecg_disp = now;
             }
+            if (g_dump_latency) {
+                g_dump_latency = 0;
+                ecgProcessor.write_latency_report(std::cout);
+            }
             
             // LED control logic:
             // If the motor is active, blink LEDs regardless of the light sensor.
@@ -417,22 +555,20 @@ int main() {
         
         
         std::cout << std::endl;
+        // The HTTP server reads the ECG processor, so let it finish first
+        ecgHttpStop.stop();
         button5.stop();
         button6.stop();
         lightSensor.stop();
         pirSensor.stop();
         ecgReader.stop();
         ecgProcessor.stop();
-        
-        // Restore std::cerr buffer
-        std::cerr.rdbuf(oldCerrBuf);
     } catch (const std::exception& e) {
         std::cerr << "\nFatal error: " << e.what() << std::endl;
         return EXIT_FAILURE;
     }
     
-    if (http_thread.joinable())
-        http_thread.join();
+    httpStop.stop();
     
     return EXIT_SUCCESS;
 }
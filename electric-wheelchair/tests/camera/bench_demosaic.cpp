@@ -0,0 +1,175 @@
+#include "bayer_demosaic.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Times the banded demosaic on a synthetic SGBRG frame: the cost of every
+// band run alone, then whole frames on pools of 1 .. --threads threads with
+// the speedup over one thread. Banded frames are checked against the
+// single-threaded output. --ycbcr times the YCbCr 4:2:0 output the JPEG
+// encoder uses instead of RGB.
+//
+// --threads defaults to the cores this process may use; --min-speedup X fails
+// the run if the largest pool is less than X times faster than one thread.
+//
+// Usage: bench_demosaic [--width W] [--height H] [--frames N] [--threads N] [--shift] [--ycbcr]
+//                       [--kernel scalar|sse4.1|avx2|neon] [--min-speedup X]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::vector<uint16_t> noise_frame(int width, int height, int shift) {
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> level(0, 1023);
+    std::vector<uint16_t> raw(static_cast<size_t>(width) * height);
+    for (uint16_t& v : raw) v = static_cast<uint16_t>(level(rng) << shift);
+    return raw;
+}
+
+bool parse_kernel(const std::string& name, DemosaicKernel& kernel) {
+    for (DemosaicKernel k : {DemosaicKernel::Scalar, DemosaicKernel::SSE41, DemosaicKernel::AVX2, DemosaicKernel::NEON}) {
+        std::string lower = demosaic_kernel_name(k);
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char ch) { return std::tolower(ch); });
+        if (name == lower) {
+            kernel = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+void usage() {
+    std::cerr << "Usage: bench_demosaic [--width W] [--height H] [--frames N] [--threads N] [--shift] [--ycbcr]\n"
+              << "                      [--kernel scalar|sse4.1|avx2|neon] [--min-speedup X]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int width = 640;
+    int height = 480;
+    int frames = 50;
+    int threads = WorkerPool::available_cores();
+    int shift = 0;
+    bool ycbcr = false;
+    double minSpeedup = 0.0;
+    DemosaicKernel kernel = best_demosaic_kernel();
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--width" && i + 1 < argc) {
+            width = std::atoi(argv[++i]);
+        } else if (arg == "--height" && i + 1 < argc) {
+            height = std::atoi(argv[++i]);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--shift") {
+            shift = 6;
+        } else if (arg == "--ycbcr") {
+            ycbcr = true;
+        } else if (arg == "--kernel" && i + 1 < argc && parse_kernel(argv[i + 1], kernel)) {
+            ++i;
+        } else if (arg == "--min-speedup" && i + 1 < argc) {
+            minSpeedup = std::atof(argv[++i]);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (width <= 0 || height <= 0 || frames <= 0 || threads <= 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    const BayerDemosaic demosaic(BAYER_GAIN_R, BAYER_GAIN_G, BAYER_GAIN_B, kernel);
+    const std::vector<uint16_t> raw = noise_frame(width, height, shift);
+    // RGB, or the Y plane followed by the Cb and Cr planes
+    const size_t chromaSize = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+    std::vector<uint8_t> expected(ycbcr ? static_cast<size_t>(width) * height + 2 * chromaSize
+                                        : static_cast<size_t>(width) * height * 3);
+    std::vector<uint8_t> out(expected.size());
+    auto planes_of = [&](std::vector<uint8_t>& buffer) {
+        uint8_t* cb = buffer.data() + static_cast<size_t>(width) * height;
+        return YCbCrPlanes{buffer.data(), cb, cb + chromaSize, width, (width + 1) / 2};
+    };
+    if (ycbcr) {
+        demosaic.process_ycbcr(raw.data(), width, height, width, shift, planes_of(expected));
+    } else {
+        demosaic.process(raw.data(), width, height, width, shift, expected.data());
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Frame:    " << width << "x" << height << (shift ? " SGBRG16" : " SGBRG10") << " to "
+              << (ycbcr ? "YCbCr 4:2:0" : "RGB") << ", " << demosaic_kernel_name(demosaic.kernel()) << " kernel, "
+              << WorkerPool::available_cores()
+              << " cores available\n";
+
+    // Each band alone on this thread, best of frames
+    std::cout << "Bands of a " << threads << "-thread frame (best ms):\n";
+    for (int band = 0; band < threads; band++) {
+        const int rowBegin = BayerDemosaic::band_start(height, threads, band);
+        const int rowEnd = BayerDemosaic::band_start(height, threads, band + 1);
+        double best = 1e9;
+        for (int i = 0; i < frames; i++) {
+            const auto start = Clock::now();
+            if (ycbcr) {
+                demosaic.process_ycbcr_rows(raw.data(), width, height, width, shift, rowBegin, rowEnd, planes_of(out));
+            } else {
+                demosaic.process_rows(raw.data(), width, height, width, shift, rowBegin, rowEnd, out.data());
+            }
+            best = std::min(best, elapsed_ms(start));
+        }
+        std::cout << "  rows " << std::setw(4) << rowBegin << " .. " << std::setw(4) << rowEnd - 1 << "  " << best
+                  << "  (" << (rowEnd > rowBegin ? best * 1000.0 / (rowEnd - rowBegin) : 0.0) << " us/row)\n";
+    }
+
+    // Whole frames on pools of increasing size
+    std::cout << "Threads   best ms   mean ms   frames/s   speedup\n";
+    double single = 0.0;
+    double speedup = 1.0;
+    for (int n = 1; n <= threads; n++) {
+        WorkerPool pool(n);
+        double best = 1e9;
+        double total = 0.0;
+        for (int i = 0; i < frames; i++) {
+            std::fill(out.begin(), out.end(), 0);
+            const auto start = Clock::now();
+            if (ycbcr) {
+                demosaic.process_ycbcr(raw.data(), width, height, width, shift, planes_of(out), pool);
+            } else {
+                demosaic.process(raw.data(), width, height, width, shift, out.data(), pool);
+            }
+            const double ms = elapsed_ms(start);
+            best = std::min(best, ms);
+            total += ms;
+        }
+        if (out != expected) {
+            std::cerr << n << " threads: banded output differs from the single-threaded frame" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (n == 1) single = best;
+        speedup = single / best;
+        std::cout << std::setw(7) << n << std::setw(10) << best << std::setw(10) << total / frames << std::setw(11)
+                  << 1000.0 / best << std::setw(10) << speedup << "\n";
+    }
+    std::cout << std::flush;
+    if (speedup < minSpeedup) {
+        std::cerr << "Speedup " << speedup << " below " << minSpeedup << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+#include "bayer_demosaic.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks the fixed-point demosaic against the original floating-point Malvar
+// code on synthetic SGBRG frames (noise, saturated edges, smooth gradients,
+// odd sizes, padded strides, 16-bit samples), for the scalar kernel and every
+// SIMD kernel this CPU runs, split into bands on a worker pool as well as
+// whole. The YCbCr 4:2:0 output is checked against libjpeg's conversion of
+// that RGB. Reports the time per frame at 640x480 and 1280x720.
+
+namespace {
+
+// The demosaic MJPEGServer used before the fixed-point kernels
+uint16_t reference_pixel(const uint16_t* bayer, int r, int c, int width, int height, int rawStride, int shift) {
+    r = std::min(std::max(r, 0), height - 1);
+    c = std::min(std::max(c, 0), width - 1);
+    return bayer[r * rawStride + c] >> shift;
+}
+
+std::vector<uint8_t> reference_demosaic(const uint16_t* bayer, int width, int height, int rawStride, int shift,
+                                        double rGain, double gGain, double bGain) {
+    auto px = [&](int r, int c) -> double { return reference_pixel(bayer, r, c, width, height, rawStride, shift); };
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+            const double x = px(r, c);
+            const double cross = px(r, c - 1) + px(r, c + 1) + px(r - 1, c) + px(r + 1, c);
+            const double far = px(r, c - 2) + px(r, c + 2) + px(r - 2, c) + px(r + 2, c);
+            const double diag = px(r - 1, c - 1) + px(r - 1, c + 1) + px(r + 1, c - 1) + px(r + 1, c + 1);
+            const double vert = x + 0.125 * (2 * (px(r - 1, c) + px(r + 1, c)) - (px(r - 2, c) + px(r + 2, c)));
+            const double horz = x + 0.125 * (2 * (px(r, c - 1) + px(r, c + 1)) - (px(r, c - 2) + px(r, c + 2)));
+            double R, G, B;
+            if (r % 2 == 1 && c % 2 == 0) {
+                R = x;
+                G = x + 0.125 * (2 * cross - far);
+                B = x + 0.125 * (2 * diag - far);
+            } else if (r % 2 == 0 && c % 2 == 1) {
+                R = x + 0.125 * (2 * diag - far);
+                G = x + 0.125 * (2 * cross - far);
+                B = x;
+            } else if (r % 2 == 0) {
+                R = vert;
+                G = x;
+                B = horz;
+            } else {
+                R = horz;
+                G = x;
+                B = vert;
+            }
+            auto clamp_scale = [](double val) -> uint8_t {
+                if (val < 0) val = 0;
+                if (val > 1023) val = 1023;
+                return static_cast<uint8_t>((val * 255 + 511) / 1023);
+            };
+            uint8_t* out = &rgb[(r * width + c) * 3];
+            out[0] = clamp_scale(R * rGain);
+            out[1] = clamp_scale(G * gGain);
+            out[2] = clamp_scale(B * bGain);
+        }
+    }
+    return rgb;
+}
+
+// libjpeg's RGB to YCbCr conversion and h2v2 downsampling, the last column
+// and row repeated for odd sizes as its preprocessing does
+struct Planes {
+    std::vector<uint8_t> y, cb, cr;
+};
+
+Planes reference_ycbcr(const std::vector<uint8_t>& rgb, int width, int height) {
+    auto fix = [](double x) { return static_cast<int32_t>(x * 65536 + 0.5); };
+    std::vector<int> y(width * height), cb(width * height), cr(width * height);
+    for (int i = 0; i < width * height; i++) {
+        const int r = rgb[i * 3], g = rgb[i * 3 + 1], b = rgb[i * 3 + 2];
+        y[i] = (fix(0.299) * r + fix(0.587) * g + fix(0.114) * b + 32768) >> 16;
+        cb[i] = (-fix(0.16874) * r - fix(0.33126) * g + fix(0.5) * b + (128 << 16) + 32767) >> 16;
+        cr[i] = (fix(0.5) * r - fix(0.41869) * g - fix(0.08131) * b + (128 << 16) + 32767) >> 16;
+    }
+    const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    Planes planes;
+    planes.y.assign(y.begin(), y.end());
+    for (int i = 0; i < ch; i++) {
+        const int r0 = 2 * i, r1 = std::min(2 * i + 1, height - 1);
+        for (int j = 0; j < cw; j++) {
+            const int c0 = 2 * j, c1 = std::min(2 * j + 1, width - 1);
+            const int bias = 1 + j % 2;
+            planes.cb.push_back(static_cast<uint8_t>(
+                (cb[r0 * width + c0] + cb[r0 * width + c1] + cb[r1 * width + c0] + cb[r1 * width + c1] + bias) >> 2));
+            planes.cr.push_back(static_cast<uint8_t>(
+                (cr[r0 * width + c0] + cr[r0 * width + c1] + cr[r1 * width + c0] + cr[r1 * width + c1] + bias) >> 2));
+        }
+    }
+    return planes;
+}
+
+// Runs process_ycbcr() into padded planes and unpacks them
+Planes demosaic_ycbcr(const BayerDemosaic& demosaic, const std::vector<uint16_t>& raw, int width, int height,
+                      int rawStride, int shift, WorkerPool* pool) {
+    const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    std::vector<uint8_t> y(static_cast<size_t>(width + 5) * height), cb((cw + 3) * ch), cr((cw + 3) * ch);
+    const YCbCrPlanes planes = {y.data(), cb.data(), cr.data(), width + 5, cw + 3};
+    if (pool) {
+        demosaic.process_ycbcr(raw.data(), width, height, rawStride, shift, planes, *pool);
+    } else {
+        demosaic.process_ycbcr(raw.data(), width, height, rawStride, shift, planes);
+    }
+    Planes out;
+    for (int r = 0; r < height; r++) out.y.insert(out.y.end(), &y[r * (width + 5)], &y[r * (width + 5) + width]);
+    for (int r = 0; r < ch; r++) {
+        out.cb.insert(out.cb.end(), &cb[r * (cw + 3)], &cb[r * (cw + 3) + cw]);
+        out.cr.insert(out.cr.end(), &cr[r * (cw + 3)], &cr[r * (cw + 3) + cw]);
+    }
+    return out;
+}
+
+std::vector<uint16_t> synthetic_frame(int width, int height, int rawStride, int shift, int pattern, std::mt19937& rng) {
+    std::vector<uint16_t> raw(static_cast<size_t>(rawStride) * height, 0xFFFF);  // Padding must be ignored
+    std::uniform_int_distribution<int> level(0, 1023);
+    for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+            int v;
+            if (pattern == 0) {
+                v = level(rng);  // Noise
+            } else if (pattern == 1) {
+                v = (r / 3 + c / 5) % 2 ? 1023 : level(rng) % 8;  // Saturated edges
+            } else {
+                v = (r * 1023 / std::max(height - 1, 1) + c * 511 / std::max(width - 1, 1)) % 1024;  // Gradient
+            }
+            raw[r * rawStride + c] = static_cast<uint16_t>(shift ? (v << shift) | (level(rng) & ((1 << shift) - 1)) : v);
+        }
+    }
+    return raw;
+}
+
+std::vector<DemosaicKernel> kernels() {
+    std::vector<DemosaicKernel> list;
+    for (DemosaicKernel k : {DemosaicKernel::Scalar, DemosaicKernel::SSE41, DemosaicKernel::AVX2, DemosaicKernel::NEON}) {
+        if (demosaic_kernel_supported(k)) list.push_back(k);
+    }
+    return list;
+}
+
+bool check_against_reference(double rGain, double gGain, double bGain) {
+    bool ok = true;
+    std::mt19937 rng(7);
+    WorkerPool pool(3);
+    for (DemosaicKernel kernel : kernels()) {
+        const BayerDemosaic demosaic(rGain, gGain, bGain, kernel);
+        if (demosaic.kernel() != kernel) {
+            std::cout << "Gains " << rGain << "/" << gGain << "/" << bGain << ": " << demosaic_kernel_name(kernel)
+                      << " not usable, scalar instead" << std::endl;
+        }
+        int mismatched = 0;
+        for (int trial = 0; trial < 120; trial++) {
+            int width = 1 + static_cast<int>(rng() % 70), height = 1 + static_cast<int>(rng() % 40);
+            if (trial == 0) {
+                width = 640;
+                height = 480;
+            }
+            const int rawStride = width + static_cast<int>(rng() % 9);
+            const int shift = trial % 2 ? 6 : 0;
+            const std::vector<uint16_t> raw = synthetic_frame(width, height, rawStride, shift, trial % 3, rng);
+            const std::vector<uint8_t> expected =
+                reference_demosaic(raw.data(), width, height, rawStride, shift, rGain, gGain, bGain);
+            std::vector<uint8_t> rgb(expected.size(), 0xAA);
+            if (trial % 5 >= 3) {
+                demosaic.process(raw.data(), width, height, rawStride, shift, rgb.data(), pool);
+            } else {
+                demosaic.process(raw.data(), width, height, rawStride, shift, rgb.data());
+            }
+            if (rgb != expected) {
+                const size_t at = std::mismatch(rgb.begin(), rgb.end(), expected.begin()).first - rgb.begin();
+                if (mismatched++ == 0) {
+                    std::cerr << demosaic_kernel_name(kernel) << " " << width << "x" << height << ": pixel ("
+                              << at / 3 / width << ", " << at / 3 % width << ") channel " << at % 3 << " is "
+                              << int(rgb[at]) << ", expected " << int(expected[at]) << std::endl;
+                }
+                continue;
+            }
+            const Planes expectedYcc = reference_ycbcr(expected, width, height);
+            const Planes ycc =
+                demosaic_ycbcr(demosaic, raw, width, height, rawStride, shift, trial % 5 >= 3 ? &pool : nullptr);
+            if (ycc.y != expectedYcc.y || ycc.cb != expectedYcc.cb || ycc.cr != expectedYcc.cr) {
+                if (mismatched++ == 0) {
+                    std::cerr << demosaic_kernel_name(kernel) << " " << width << "x" << height
+                              << ": YCbCr planes differ (Y " << (ycc.y == expectedYcc.y ? "ok" : "differs")
+                              << ", Cb " << (ycc.cb == expectedYcc.cb ? "ok" : "differs") << ", Cr "
+                              << (ycc.cr == expectedYcc.cr ? "ok" : "differs") << ")" << std::endl;
+                }
+            }
+        }
+        if (mismatched) {
+            std::cerr << demosaic_kernel_name(demosaic.kernel()) << ": " << mismatched << " frames differ" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void report_speed() {
+    std::mt19937 rng(3);
+    const int sizes[2][2] = {{640, 480}, {1280, 720}};
+    for (const auto& size : sizes) {
+        const int width = size[0], height = size[1];
+        const std::vector<uint16_t> raw = synthetic_frame(width, height, width, 0, 0, rng);
+        std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+        for (DemosaicKernel kernel : kernels()) {
+            const BayerDemosaic demosaic(BAYER_GAIN_R, BAYER_GAIN_G, BAYER_GAIN_B, kernel);
+            double best = 1e9;
+            for (int i = 0; i < 20; i++) {
+                const auto start = std::chrono::steady_clock::now();
+                demosaic.process(raw.data(), width, height, width, 0, rgb.data());
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                                 start).count());
+            }
+            std::cout << width << "x" << height << " " << demosaic_kernel_name(kernel) << ": " << best << " ms"
+                      << std::endl;
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Best kernel: " << demosaic_kernel_name(best_demosaic_kernel()) << std::endl;
+    bool ok = check_against_reference(BAYER_GAIN_R, BAYER_GAIN_G, BAYER_GAIN_B);
+    if (!check_against_reference(1.0, 2.2, 7.3)) ok = false;
+    if (!check_against_reference(0.4, 1.7, 3.1)) ok = false;
+    report_speed();
+    if (!ok) return 1;
+    std::cout << "Demosaic OK" << std::endl;
+    return 0;
+}
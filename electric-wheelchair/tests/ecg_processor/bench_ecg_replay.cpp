@@ -0,0 +1,295 @@
+#include "ecg_processor.hpp"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+// Replays an ECG recording in the "a,b,ecg" CSV format through the full
+// ReliableSerialReader -> StableECGProcessor pipeline as fast as possible and
+// reports throughput, per-stage cost, the latency histograms and beat agreement
+// with an annotation file (one R-peak sample index per line). --min-sensitivity
+// also fails the run when the detected beats yield no heart rate or HRV.
+//
+// With --leads N the input has N ECG columns ("a,b,lead1,...,leadN") and the
+// processor runs in multi-lead mode. --rate HZ sets the sample rate of the
+// recording (one of the supported ECG rates, default 1000). With --classes FILE every classified beat
+// is written as "sample_index,type,correlation,rr_ms" for offline review.
+// --waveform-ratio N overrides the decimation of the low-rate waveform stream.
+//
+// Usage: bench_ecg_replay [--annotations FILE] [--tolerance MS] [--min-sensitivity X]
+//                         [--leads N] [--rate HZ] [--classes FILE] [--waveform-ratio N]
+//                         (--synthetic SECONDS | INPUT)
+
+namespace {
+
+// Write a synthetic recording with P-QRS-T complexes, baseline wander and noise.
+// Each lead sees the same beats with its own gain, polarity and noise.
+// Returns the sample index of every R peak.
+std::vector<uint64_t> write_synthetic_recording(const std::string& path, int seconds, std::size_t leads,
+                                                int sample_rate) {
+    static const double lead_gain[] = {1.0, -0.6, 0.45, 0.8, -0.35, 0.55, 0.7, -0.9};
+    std::mt19937 rng(42);
+    std::normal_distribution<double> noise(0.0, 8.0);
+    std::vector<uint64_t> beats;
+    const int total = seconds * sample_rate;
+    // Heart rate drifts between roughly 60 and 100 bpm
+    for (double t = 0.4 * sample_rate; t < total; ) {
+        beats.push_back(static_cast<uint64_t>(t));
+        const double bpm = 80.0 + 20.0 * std::sin(2.0 * M_PI * t / (40.0 * sample_rate));
+        t += 60.0 * sample_rate / bpm;
+    }
+
+    std::ofstream out(path);
+    const uint64_t reach = sample_rate / 2;  // Each complex spans well under +/-500 ms
+    std::size_t first = 0;
+    for (int i = 0; i < total; ++i) {
+        const uint64_t n = static_cast<uint64_t>(i);
+        while (first < beats.size() && beats[first] + reach < n)
+            ++first;
+        double v = 0.0;
+        for (std::size_t b = first; b < beats.size() && beats[b] <= n + reach; ++b) {
+            const double d = (static_cast<double>(i) - beats[b]) * 1000.0 / sample_rate;  // ms
+            v += 100.0 * std::exp(-(d + 170.0) * (d + 170.0) / (2 * 25.0 * 25.0));  // P
+            v += 900.0 * std::exp(-d * d / (2 * 9.0 * 9.0));                        // R
+            v -= 150.0 * std::exp(-(d - 25.0) * (d - 25.0) / (2 * 8.0 * 8.0));      // S
+            v += 220.0 * std::exp(-(d - 300.0) * (d - 300.0) / (2 * 45.0 * 45.0));  // T
+        }
+        out << i << ",0";
+        for (std::size_t lead = 0; lead < leads; ++lead) {
+            const double wander = 60.0 * std::sin(2.0 * M_PI * (0.3 + 0.05 * lead) * i / sample_rate);
+            out << "," << std::fixed << std::setprecision(1) << 512.0 + wander + lead_gain[lead] * v + noise(rng);
+        }
+        out << "\n";
+    }
+    return beats;
+}
+
+std::vector<uint64_t> read_annotations(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Cannot open annotation file " + path);
+    std::vector<uint64_t> beats;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        beats.push_back(std::stoull(line));
+    }
+    std::sort(beats.begin(), beats.end());
+    return beats;
+}
+
+struct Agreement {
+    std::size_t true_positive = 0;
+    std::size_t false_positive = 0;
+    std::size_t false_negative = 0;
+    double mean_error_ms = 0.0;
+};
+
+// Match detections to reference beats within tolerance (both lists sorted)
+Agreement compare_beats(const std::vector<uint64_t>& reference, const std::vector<uint64_t>& detected,
+                        double tolerance_ms, int sample_rate) {
+    const auto tolerance = static_cast<int64_t>(tolerance_ms * sample_rate / 1000.0);
+    Agreement result;
+    double error_sum = 0.0;
+    std::size_t r = 0, d = 0;
+    while (r < reference.size() && d < detected.size()) {
+        const int64_t diff = static_cast<int64_t>(detected[d]) - static_cast<int64_t>(reference[r]);
+        if (std::llabs(diff) <= tolerance) {
+            ++result.true_positive;
+            error_sum += std::llabs(diff) * 1000.0 / sample_rate;
+            ++r;
+            ++d;
+        } else if (diff < 0) {
+            ++result.false_positive;
+            ++d;
+        } else {
+            ++result.false_negative;
+            ++r;
+        }
+    }
+    result.false_positive += detected.size() - d;
+    result.false_negative += reference.size() - r;
+    if (result.true_positive > 0)
+        result.mean_error_ms = error_sum / result.true_positive;
+    return result;
+}
+
+const char* beat_type_name(BeatType type) {
+    switch (type) {
+    case BeatType::Learning: return "learning";
+    case BeatType::Normal: return "normal";
+    case BeatType::Premature: return "premature";
+    case BeatType::Ectopic: return "ectopic";
+    }
+    return "?";
+}
+
+void usage() {
+    std::cerr << "Usage: bench_ecg_replay [--annotations FILE] [--tolerance MS] [--min-sensitivity X]\n"
+              << "                        [--leads N] [--rate HZ] [--classes FILE] [--waveform-ratio N]\n"
+              << "                        (--synthetic SECONDS | INPUT)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string input;
+    std::string annotation_path;
+    std::string classes_path;
+    int synthetic_seconds = 0;
+    double tolerance_ms = 150.0;
+    double min_sensitivity = 0.0;
+    std::size_t leads = 1;
+    int sample_rate = SAMPLE_RATE;
+    std::size_t waveform_ratio = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--annotations" && i + 1 < argc) {
+            annotation_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance_ms = std::atof(argv[++i]);
+        } else if (arg == "--synthetic" && i + 1 < argc) {
+            synthetic_seconds = std::atoi(argv[++i]);
+        } else if (arg == "--min-sensitivity" && i + 1 < argc) {
+            min_sensitivity = std::atof(argv[++i]);
+        } else if (arg == "--leads" && i + 1 < argc) {
+            leads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--rate" && i + 1 < argc) {
+            sample_rate = std::atoi(argv[++i]);
+        } else if (arg == "--classes" && i + 1 < argc) {
+            classes_path = argv[++i];
+        } else if (arg == "--waveform-ratio" && i + 1 < argc) {
+            waveform_ratio = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!arg.empty() && arg[0] != '-') {
+            input = arg;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (input.empty() == (synthetic_seconds == 0) || leads == 0 || leads > ECG_MAX_LEADS) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::vector<uint64_t> reference;
+        std::string temp_path;
+        if (synthetic_seconds > 0) {
+            char path[] = "/tmp/ecg_replay_XXXXXX";
+            int tmp = mkstemp(path);
+            if (tmp < 0) throw std::runtime_error("Cannot create temporary recording");
+            ::close(tmp);
+            temp_path = input = path;
+            reference = write_synthetic_recording(input, synthetic_seconds, leads, sample_rate);
+        }
+        if (!annotation_path.empty())
+            reference = read_annotations(annotation_path);
+
+        StableECGProcessor processor(leads, sample_rate);
+        std::vector<uint64_t> detected;
+        processor.set_beat_callback([&detected](uint64_t index) { detected.push_back(index); });
+        std::vector<BeatInfo> classes;
+        processor.set_beat_class_callback([&classes](const BeatInfo& beat) { classes.push_back(beat); });
+        if (waveform_ratio > 0) processor.set_waveform_ratio(waveform_ratio);
+        processor.set_profiling(true);
+        ReliableSerialReader reader(input, processor);
+
+        const auto start = std::chrono::steady_clock::now();
+        processor.start();
+        reader.start();
+        // Wait for the reader to hit end of file and the processor to drain
+        while (!reader.finished() || processor.samples_processed() < reader.samples_parsed()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        reader.stop();
+        processor.stop();
+        if (!temp_path.empty())
+            std::remove(temp_path.c_str());
+
+        const uint64_t samples = processor.samples_processed();
+        const EcgStageTimes times = processor.stage_times();
+        auto per_sample = [samples](uint64_t ns) { return samples ? static_cast<double>(ns) / samples : 0.0; };
+
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "Samples:        " << samples << " (" << samples / static_cast<double>(sample_rate) << " s of ECG at "
+                  << sample_rate << " Hz)\n";
+        std::cout << "Leads:          " << leads << " (" << simd::NAME << " filter)\n";
+        std::cout << "Wall time:      " << elapsed * 1000.0 << " ms\n";
+        std::cout << "Throughput:     " << samples / elapsed << " samples/s ("
+                  << samples / elapsed / sample_rate << "x real time)\n";
+        std::cout << "Dropped:        " << processor.dropped_samples() << "\n";
+        const SerialReadStats io = reader.read_stats();
+        std::cout << "Reads:          " << io.reads << " (" << (io.reads ? io.bytes / static_cast<double>(io.reads) : 0.0)
+                  << " bytes/read), " << io.wakeups << " wakeups\n";
+        std::cout << "Stage cost (total ms, ns/sample):\n";
+        std::cout << "  parse         " << reader.parse_time_ns() / 1e6 << "  " << per_sample(reader.parse_time_ns()) << "\n";
+        std::cout << "  quality       " << times.quality_ns / 1e6 << "  " << per_sample(times.quality_ns) << "\n";
+        std::cout << "  filter        " << times.filter_ns / 1e6 << "  " << per_sample(times.filter_ns) << "\n";
+        std::cout << "  detect        " << times.detect_ns / 1e6 << "  " << per_sample(times.detect_ns) << "\n";
+        std::cout << "  decimate      " << times.decimate_ns / 1e6 << "  " << per_sample(times.decimate_ns) << "\n";
+        std::cout << "  classify      " << times.classify_ns / 1e6 << "  " << per_sample(times.classify_ns)
+                  << "  (" << (classes.empty() ? 0.0 : times.classify_ns / 1e3 / classes.size()) << " us/beat)\n";
+        std::cout << "Waveform:       " << processor.waveform().end() << " frames at " << processor.waveform_rate()
+                  << " Hz (" << processor.waveform_ratio() << ":1)\n";
+        processor.write_latency_report(std::cout);
+        std::cout << "Beats detected: " << detected.size() << ", final HR " << processor.current_hr() << " bpm\n";
+        const HrvMetrics hrv = processor.hrv_metrics();
+        std::cout << "HRV over " << hrv.beats << " beats: SDNN " << hrv.sdnn << " ms, RMSSD " << hrv.rmssd
+                  << " ms, pNN50 " << hrv.pnn50 << "%\n";
+        const RhythmStatus rhythm = processor.rhythm();
+        std::cout << "Beat classes:   " << rhythm.normal << " normal, " << rhythm.premature << " premature, "
+                  << rhythm.ectopic << " ectopic\n";
+        std::cout << std::setprecision(3) << "Rhythm:         irregularity " << rhythm.irregularity << ", RR entropy "
+                  << rhythm.rr_entropy << (rhythm.af_like ? " (AF-like)" : "") << "\n";
+        const SignalQuality quality = processor.signal_quality();
+        std::cout << "Signal quality: " << quality.score << " (noise " << quality.noise_ratio << ", clipping "
+                  << quality.clipping << ", wander " << quality.wander << ")" << (quality.detecting ? "" : ", detection suspended")
+                  << "\n" << std::setprecision(1);
+        if (!classes_path.empty()) {
+            std::ofstream out(classes_path);
+            out << std::fixed;
+            if (!out) throw std::runtime_error("Cannot write " + classes_path);
+            for (const BeatInfo& beat : classes) {
+                out << beat.sample_index << "," << beat_type_name(beat.type) << "," << std::setprecision(3)
+                    << beat.correlation << "," << std::setprecision(1) << beat.rr_ms << "\n";
+            }
+        }
+
+        if (!reference.empty()) {
+            const Agreement a = compare_beats(reference, detected, tolerance_ms, sample_rate);
+            const double sensitivity = static_cast<double>(a.true_positive) / reference.size();
+            const double ppv = detected.empty() ? 0.0 : static_cast<double>(a.true_positive) / detected.size();
+            std::cout << std::setprecision(3);
+            std::cout << "Agreement (+/-" << tolerance_ms << " ms): TP " << a.true_positive
+                      << ", FP " << a.false_positive << ", FN " << a.false_negative << "\n";
+            std::cout << "  sensitivity " << sensitivity << ", positive predictivity " << ppv
+                      << ", mean |error| " << a.mean_error_ms << " ms" << std::endl;
+            if (sensitivity < min_sensitivity || ppv < min_sensitivity) {
+                std::cerr << "Beat agreement below " << min_sensitivity << std::endl;
+                return EXIT_FAILURE;
+            }
+            // Beats found but lost on the way to the heart rate, e.g. timed out of order
+            if (min_sensitivity > 0.0 && (processor.current_hr() <= 0.0 || hrv.beats == 0)) {
+                std::cerr << "No heart rate or HRV from " << detected.size() << " detected beats" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include "ecg_processor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Runs synthetic recordings through StableECGProcessor and checks the beat
+// classifier: premature ventricular beats (wide, inverted, early) must be
+// flagged as ectopic, early beats of normal shape as premature, and an
+// irregularly irregular rhythm without P waves as AF-like while a regular
+// rhythm with occasional ectopics or missed beats is not.
+
+namespace {
+
+enum class Kind { Normal, Pac, Pvc };
+
+struct SyntheticBeat {
+    uint64_t index;
+    Kind kind;
+};
+
+double complex_at(Kind kind, double d, bool p_wave) {
+    if (kind == Kind::Pvc) {
+        return 500.0 * std::exp(-(d + 25.0) * (d + 25.0) / (2 * 12.0 * 12.0)) -
+               1300.0 * std::exp(-(d - 10.0) * (d - 10.0) / (2 * 16.0 * 16.0)) +
+               250.0 * std::exp(-(d - 320.0) * (d - 320.0) / (2 * 50.0 * 50.0));
+    }
+    double v = 900.0 * std::exp(-d * d / (2 * 9.0 * 9.0)) -
+               150.0 * std::exp(-(d - 25.0) * (d - 25.0) / (2 * 8.0 * 8.0)) +
+               220.0 * std::exp(-(d - 300.0) * (d - 300.0) / (2 * 45.0 * 45.0));
+    if (p_wave) v += 100.0 * std::exp(-(d + 170.0) * (d + 170.0) / (2 * 25.0 * 25.0));
+    return v;
+}
+
+std::vector<double> render(const std::vector<SyntheticBeat>& beats, int total, bool p_waves, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 8.0);
+    std::vector<double> samples(total);
+    std::size_t first = 0;
+    for (int i = 0; i < total; ++i) {
+        while (first < beats.size() && beats[first].index + 500 < static_cast<uint64_t>(i)) ++first;
+        double v = 0.0;
+        for (std::size_t b = first; b < beats.size() && beats[b].index <= static_cast<uint64_t>(i) + 500; ++b) {
+            v += complex_at(beats[b].kind, static_cast<double>(i) - beats[b].index, p_waves);
+        }
+        samples[i] = 512.0 + 40.0 * std::sin(2.0 * M_PI * 0.3 * i / SAMPLE_RATE) + v + noise(rng);
+    }
+    return samples;
+}
+
+struct Run {
+    std::vector<BeatInfo> beats;
+    RhythmStatus rhythm;
+};
+
+Run classify(const std::vector<double>& samples) {
+    StableECGProcessor processor;
+    Run run;
+    processor.set_beat_class_callback([&run](const BeatInfo& beat) { run.beats.push_back(beat); });
+    processor.process_samples(samples.data(), samples.size());
+    run.rhythm = processor.rhythm();
+    return run;
+}
+
+const BeatInfo* find_beat(const Run& run, uint64_t index) {
+    for (const BeatInfo& b : run.beats) {
+        if (std::llabs(static_cast<int64_t>(b.sample_index) - static_cast<int64_t>(index)) <= 60) return &b;
+    }
+    return nullptr;
+}
+
+// Sinus rhythm at 75 bpm, every 7th beat a PVC and every 11th a PAC
+bool check_ectopics() {
+    const int total = 120 * SAMPLE_RATE;
+    std::vector<SyntheticBeat> beats;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> jitter(-15, 15);
+    for (int n = 0, t = 600; t < total - 1000; ++n) {
+        Kind kind = Kind::Normal;
+        int rr = 800 + jitter(rng);
+        if (n > 12 && n % 7 == 0) {
+            kind = Kind::Pvc;
+            rr = 520;
+        } else if (n > 12 && n % 11 == 0 && n % 7 != 1) {  // Not straight after a PVC
+            kind = Kind::Pac;
+            rr = 560;
+        }
+        t += rr;
+        beats.push_back({static_cast<uint64_t>(t), kind});
+        // Compensatory pause after a PVC
+        if (kind == Kind::Pvc) t += 1080 - 800;
+    }
+    const Run run = classify(render(beats, total, true, 1));
+
+    std::size_t pvc = 0, pvc_flagged = 0, pac = 0, pac_flagged = 0, normal = 0, normal_wrong = 0;
+    for (const SyntheticBeat& b : beats) {
+        const BeatInfo* found = find_beat(run, b.index);
+        if (!found || found->type == BeatType::Learning) continue;
+        switch (b.kind) {
+        case Kind::Pvc:
+            ++pvc;
+            if (found->type == BeatType::Ectopic) ++pvc_flagged;
+            break;
+        case Kind::Pac:
+            ++pac;
+            if (found->type == BeatType::Premature) ++pac_flagged;
+            break;
+        case Kind::Normal:
+            ++normal;
+            if (found->type != BeatType::Normal) ++normal_wrong;
+            break;
+        }
+    }
+    std::cout << "Ectopics: PVC " << pvc_flagged << "/" << pvc << " ectopic, PAC " << pac_flagged << "/" << pac
+              << " premature, normal misclassified " << normal_wrong << "/" << normal << ", irregularity "
+              << run.rhythm.irregularity << ", entropy " << run.rhythm.rr_entropy << std::endl;
+    return pvc > 10 && pvc_flagged * 10 >= pvc * 9 && pac > 5 && pac_flagged * 10 >= pac * 9 &&
+           normal_wrong * 50 <= normal && !run.rhythm.af_like;
+}
+
+// Regular 75 bpm with +/-15 ms jitter and two missed beats, fed straight to
+// the classifier at the true R peaks: the doubled intervals are pauses, not
+// an irregular rhythm, at any point of the recording
+bool check_missed_beats() {
+    const int total = 90 * SAMPLE_RATE;
+    std::vector<SyntheticBeat> beats;
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> jitter(-15, 15);
+    for (int t = 600; t < total - 1000; ) {
+        t += 800 + jitter(rng);
+        beats.push_back({static_cast<uint64_t>(t), Kind::Normal});
+    }
+    const std::vector<double> samples = render(beats, total, true, 3);
+    beats.erase(beats.begin() + 80);  // Missed by the detector
+    beats.erase(beats.begin() + 40);
+
+    BeatClassifier classifier(SAMPLE_RATE);
+    std::size_t next = 0, af_beats = 0, pauses = 0;
+    double worst_irregularity = 0.0, worst_entropy = 0.0;
+    classifier.set_callback([&](const BeatInfo& beat) {
+        const RhythmStatus rhythm = classifier.status();
+        if (rhythm.af_like) ++af_beats;
+        if (beat.rr_ms > 1500.0) ++pauses;
+        worst_irregularity = std::max(worst_irregularity, rhythm.irregularity);
+        worst_entropy = std::max(worst_entropy, rhythm.rr_entropy);
+    });
+    for (std::size_t at = 0; at < samples.size(); at += 100) {
+        const std::size_t count = std::min<std::size_t>(100, samples.size() - at);
+        classifier.add_samples(samples.data() + at, count);
+        for (; next < beats.size() && beats[next].index < at + count; ++next) classifier.add_beat(beats[next].index);
+    }
+    const RhythmStatus rhythm = classifier.status();
+    std::cout << "Missed beats: " << rhythm.beats << " beats, " << pauses << " pauses, " << rhythm.ectopic
+              << " ectopic, worst irregularity " << worst_irregularity << ", entropy " << worst_entropy
+              << ", AF-like on " << af_beats << " beats" << std::endl;
+    return pauses == 2 && rhythm.ectopic == 0 && af_beats == 0 && worst_irregularity < AF_MIN_IRREGULARITY &&
+           worst_entropy < AF_MIN_ENTROPY;
+}
+
+// Irregularly irregular intervals and no P waves
+bool check_af() {
+    const int total = 90 * SAMPLE_RATE;
+    std::vector<SyntheticBeat> beats;
+    std::mt19937 rng(9);
+    std::uniform_int_distribution<int> rr(420, 1000);
+    for (int t = 600 + rr(rng); t < total - 1000; t += rr(rng)) {
+        beats.push_back({static_cast<uint64_t>(t), Kind::Normal});
+    }
+    const Run run = classify(render(beats, total, false, 2));
+    std::cout << "AF: " << run.beats.size() << " beats, irregularity " << run.rhythm.irregularity << ", entropy "
+              << run.rhythm.rr_entropy << ", ectopic " << run.rhythm.ectopic << std::endl;
+    return run.rhythm.af_like && run.rhythm.ectopic * 20 <= run.rhythm.beats;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = true;
+    if (!check_ectopics()) {
+        std::cerr << "Premature and ectopic beats misclassified" << std::endl;
+        ok = false;
+    }
+    if (!check_missed_beats()) {
+        std::cerr << "Missed beats flagged as an irregular rhythm" << std::endl;
+        ok = false;
+    }
+    if (!check_af()) {
+        std::cerr << "Irregular rhythm not flagged as AF-like" << std::endl;
+        ok = false;
+    }
+    if (!ok) return 1;
+    std::cout << "Beat classification OK" << std::endl;
+    return 0;
+}
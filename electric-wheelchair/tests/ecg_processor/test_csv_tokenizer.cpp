@@ -0,0 +1,104 @@
+#include "ecg_csv_parser.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Checks the streaming CSV tokenizer: lines split at every byte across reads,
+// CRLF endings, blank lines, empty and garbage fields, the malformed-line
+// count, and the MAX_LINE limit whether or not a long line spans two reads.
+
+namespace {
+
+struct Result {
+    std::vector<double> values;
+    uint64_t lines;
+    uint64_t malformed;
+};
+
+// Feed text in reads of at most chunk bytes
+Result run(const std::string& text, std::size_t chunk, std::size_t columns = 1) {
+    EcgCsvTokenizer tokenizer(2, columns);
+    Result result;
+    std::vector<double> frames((chunk + 1) * columns);
+    for (std::size_t at = 0; at < text.size(); at += chunk) {
+        const std::size_t count = std::min(chunk, text.size() - at);
+        const std::size_t n = tokenizer.feed(text.data() + at, count, frames.data(), chunk + 1);
+        result.values.insert(result.values.end(), frames.begin(), frames.begin() + n * columns);
+    }
+    result.lines = tokenizer.lines();
+    result.malformed = tokenizer.malformed_lines();
+    return result;
+}
+
+// The same text in one read and in reads of 1, 2, 7 and all but one bytes
+bool check(const char* name, const std::string& text, const std::vector<double>& values, uint64_t lines,
+           uint64_t malformed) {
+    for (std::size_t chunk : {text.size(), std::size_t(1), std::size_t(2), std::size_t(7), text.size() - 1}) {
+        if (chunk == 0) continue;
+        const Result r = run(text, chunk);
+        if (r.values != values || r.lines != lines || r.malformed != malformed) {
+            std::cerr << name << " in reads of " << chunk << ": " << r.values.size() << " values, " << r.lines
+                      << " lines, " << r.malformed << " malformed (expected " << values.size() << ", " << lines
+                      << ", " << malformed << ")" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_lines() {
+    bool ok = check("Plain lines", "0,1,512\n1,1,-3.25\n2,1,+7\n", {512, -3.25, 7}, 3, 0);
+    if (!check("CRLF lines", "0,1,512\r\n1,1,600.5\r\n", {512, 600.5}, 2, 0)) ok = false;
+    // Blank lines are not data; an empty field before the value is skipped
+    if (!check("Blank lines and empty fields", "\n\r\n0,1,,5\n  \n1,,1,6\n", {5, 6}, 2, 0)) ok = false;
+    if (!check("Garbage fields", "0,1,abc\n1,1,9\n2,1\n3,1, \n4,1,x7\n", {9}, 5, 4)) ok = false;
+    // Text after the last newline waits for the rest of its line
+    if (!check("Unterminated tail", "0,1,1\n1,1,2", {1}, 1, 0)) ok = false;
+    return ok;
+}
+
+// A line of exactly MAX_LINE bytes is parsed, one byte more is rejected,
+// and the next line is read normally either way
+bool check_max_line() {
+    bool ok = true;
+    const std::string start = "0,1,42,";
+    const std::string fits = start + std::string(EcgCsvTokenizer::MAX_LINE - start.size(), '0');
+    const std::string crlf = fits.substr(0, fits.size() - 1) + "\r";
+    const std::string too_long = fits + "0";
+    if (!check("MAX_LINE line", fits + "\n1,1,5\n", {42, 5}, 2, 0)) ok = false;
+    if (!check("MAX_LINE line with CR", crlf + "\n1,1,5\n", {42, 5}, 2, 0)) ok = false;
+    if (!check("Over-long line", too_long + "\n1,1,5\n", {5}, 2, 1)) ok = false;
+    if (!check("Very long line", std::string(1000, '1') + "\n1,1,5\n", {5}, 2, 1)) ok = false;
+    return ok;
+}
+
+// reset() drops a partial line and the counters
+bool check_reset() {
+    EcgCsvTokenizer tokenizer;
+    double values[4];
+    const char head[] = "0,1,99\nbad\n1,1,1";
+    const char tail[] = "2\n2,1,3\n";
+    tokenizer.feed(head, std::strlen(head), values, 4);
+    tokenizer.reset();
+    const std::size_t n = tokenizer.feed(tail, std::strlen(tail), values, 4);
+    // "2" completes no line after the reset and is itself malformed
+    if (n != 1 || values[0] != 3 || tokenizer.lines() != 2 || tokenizer.malformed_lines() != 1) {
+        std::cerr << "reset() kept state: " << n << " frames, " << tokenizer.lines() << " lines, "
+                  << tokenizer.malformed_lines() << " malformed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_lines();
+    if (!check_max_line()) ok = false;
+    if (!check_reset()) ok = false;
+    if (!ok) return 1;
+    std::cout << "CSV tokenizer OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include "ecg_processor.hpp"
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Checks the polyphase decimator (anti-aliasing response, block and stride
+// independence), the broadcast waveform ring under a concurrent reader, and
+// the low-rate waveform stream of StableECGProcessor.
+
+namespace {
+
+bool near(double value, double expected, double tolerance) {
+    return std::abs(value - expected) <= tolerance;
+}
+
+std::vector<double> tone(double frequency, int rate, std::size_t count) {
+    std::vector<double> samples(count);
+    for (std::size_t i = 0; i < count; ++i) samples[i] = std::sin(2.0 * M_PI * frequency * i / rate);
+    return samples;
+}
+
+bool check_filter() {
+    bool ok = true;
+    PolyphaseDecimator decimator(8);
+    const std::vector<double>& h = decimator.filter();
+    double sum = 0.0;
+    for (std::size_t k = 0; k < h.size(); ++k) {
+        sum += h[k];
+        if (h[k] != h[h.size() - 1 - k]) ok = false;
+    }
+    if (!ok || h.size() != DECIMATOR_TAPS_PER_PHASE * 8 || !near(sum, 1.0, 1e-12)) {
+        std::cerr << "Decimation filter is not a symmetric unity-gain low-pass" << std::endl;
+        ok = false;
+    }
+
+    // 5 Hz passes with its delay accounted for; 110 Hz, which would fold to
+    // 15 Hz at 125 Hz, is removed
+    const std::size_t count = 8000;
+    const std::vector<double> pass = tone(5.0, 1000, count);
+    std::vector<double> out(decimator.output_capacity(count));
+    const std::size_t frames = decimator.process(pass.data(), count, 1, out.data());
+    double pass_error = 0.0;
+    for (std::size_t m = 20; m < frames; ++m) {
+        const double centre = (m + 1) * 8.0 - 1.0 - decimator.delay();
+        pass_error = std::max(pass_error, std::abs(out[m] - std::sin(2.0 * M_PI * 5.0 * centre / 1000.0)));
+    }
+    decimator.reset();
+    const std::vector<double> stop = tone(110.0, 1000, count);
+    decimator.process(stop.data(), count, 1, out.data());
+    double alias = 0.0;
+    for (std::size_t m = 20; m < frames; ++m) alias = std::max(alias, std::abs(out[m]));
+    std::cout << "Ratio 8: " << frames << " frames, 5 Hz error " << pass_error << ", 110 Hz leak "
+              << 20.0 * std::log10(alias) << " dB" << std::endl;
+    if (frames != count / 8 || pass_error > 0.01 || alias > 0.005) {
+        std::cerr << "Decimator response is off" << std::endl;
+        ok = false;
+    }
+
+    // Ratio 1 is a pass-through
+    PolyphaseDecimator identity(1);
+    std::vector<double> copy(identity.output_capacity(count));
+    if (identity.process(pass.data(), count, 1, copy.data()) != count || copy[123] != pass[123]) {
+        std::cerr << "Ratio 1 does not pass samples through" << std::endl;
+        ok = false;
+    }
+
+    try {
+        PolyphaseDecimator bad(0);
+        std::cerr << "Ratio 0 accepted" << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument&) {
+    }
+    return ok;
+}
+
+// Three leads at a stride of 4, fed in one go and in odd-sized pieces
+bool check_blocks() {
+    const std::size_t count = 3000, stride = 4;
+    std::vector<double> frames(count * stride);
+    for (std::size_t i = 0; i < count; ++i) {
+        for (std::size_t lead = 0; lead < 3; ++lead) frames[i * stride + lead] = std::sin(0.01 * i * (lead + 1));
+    }
+    PolyphaseDecimator whole(5, 3), pieces(5, 3);
+    std::vector<double> a(whole.output_capacity(count) * 3), b(a.size() + 3 * 8);
+    const std::size_t na = whole.process(frames.data(), count, stride, a.data());
+    std::size_t nb = 0;
+    for (std::size_t i = 0; i < count; i += 7) {
+        const std::size_t n = std::min<std::size_t>(7, count - i);
+        nb += pieces.process(frames.data() + i * stride, n, stride, b.data() + nb * 3);
+    }
+    for (std::size_t k = 0; k < na * 3; ++k) {
+        if (na != nb || a[k] != b[k]) {
+            std::cerr << "Decimator output depends on block size" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_ring() {
+    bool ok = true;
+    // A reader that falls behind skips to the oldest frame held
+    WaveformRing ring(100, 2);
+    if (ring.capacity() != 128) ok = false;
+    std::vector<double> data(2 * 300);
+    for (std::size_t i = 0; i < 300; ++i) {
+        data[2 * i] = i;
+        data[2 * i + 1] = -static_cast<double>(i);
+    }
+    ring.write(data.data(), 300);
+    uint64_t cursor = 0, lost = 0;
+    std::vector<double> out(2 * 50);
+    const std::size_t n = ring.read(cursor, out.data(), 50, &lost);
+    if (n != 50 || lost != 300 - 128 || out[0] != 300 - 128 || out[1] != -(300.0 - 128) || cursor != 300 - 128 + 50) {
+        std::cerr << "Lagging reader not resynchronised" << std::endl;
+        ok = false;
+    }
+
+    // Concurrent writer: every frame read must be whole and in order
+    WaveformRing shared(256, 2);
+    const uint64_t total = 200000;
+    std::atomic<bool> done(false);
+    uint64_t bad_frames = 0, received = 0, skipped = 0;
+    std::thread reader([&]() {
+        uint64_t position = 0;
+        double frames[2 * 16];
+        while (!done.load() || position < shared.end()) {
+            const uint64_t first = position;
+            uint64_t gap = 0;
+            const std::size_t got = shared.read(position, frames, 16, &gap);
+            skipped += gap;
+            for (std::size_t i = 0; i < got; ++i) {
+                const double expected = static_cast<double>(first + gap + i);
+                if (frames[2 * i] != expected || frames[2 * i + 1] != -expected) ++bad_frames;
+            }
+            received += got;
+        }
+    });
+    double chunk[2 * 10];
+    for (uint64_t i = 0; i < total; i += 10) {
+        for (std::size_t k = 0; k < 10; ++k) {
+            chunk[2 * k] = static_cast<double>(i + k);
+            chunk[2 * k + 1] = -static_cast<double>(i + k);
+        }
+        shared.write(chunk, 10);
+        if (i % 1000 == 0) std::this_thread::yield();
+    }
+    done.store(true);
+    reader.join();
+    std::cout << "Ring: " << received << " frames read, " << skipped << " skipped, " << bad_frames << " torn"
+              << std::endl;
+    if (bad_frames != 0 || received + skipped != total) {
+        std::cerr << "Concurrent reader saw torn or missing frames" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// The waveform stream follows the ECG and lines up with the detected beats
+bool check_processor() {
+    bool ok = true;
+    const int seconds = 20;
+    const std::size_t total = seconds * SAMPLE_RATE;
+    std::vector<uint64_t> beats;
+    for (uint64_t t = 500; t + 500 < total; t += 800) beats.push_back(t);
+    std::vector<double> samples(total);
+    for (std::size_t i = 0; i < total; ++i) {
+        double v = 512.0;
+        for (uint64_t b : beats) {
+            const double d = static_cast<double>(i) - b;
+            if (std::abs(d) < 400.0) v += 900.0 * std::exp(-d * d / (2 * 9.0 * 9.0));
+        }
+        samples[i] = v;
+    }
+
+    StableECGProcessor processor;
+    if (processor.waveform_ratio() != SAMPLE_RATE / ECG_WAVEFORM_RATE_HZ ||
+        !near(processor.waveform_rate(), ECG_WAVEFORM_RATE_HZ, 1e-9)) {
+        std::cerr << "Default waveform rate is not " << ECG_WAVEFORM_RATE_HZ << " Hz" << std::endl;
+        ok = false;
+    }
+    processor.process_samples(samples.data(), total);
+    const WaveformRing& ring = processor.waveform();
+    if (ring.end() != total / processor.waveform_ratio()) {
+        std::cerr << "Waveform has " << ring.end() << " frames" << std::endl;
+        ok = false;
+    }
+
+    // The band-passed QRS is a short oscillation; the centre of its energy
+    // must fall on the beat once the filter and decimator delays are removed
+    uint64_t cursor = ring.end() - 4 * ECG_WAVEFORM_RATE_HZ;
+    std::vector<double> wave(4 * ECG_WAVEFORM_RATE_HZ);
+    const uint64_t first = cursor;
+    const std::size_t n = ring.read(cursor, wave.data(), wave.size());
+    std::size_t matched = 0, checked = 0;
+    for (uint64_t b : beats) {
+        double energy = 0.0, moment = 0.0;
+        bool complete = true;
+        for (double t = b - 300.0; t <= b + 300.0; t += 1.0) {
+            complete = complete && processor.waveform_sample_index(first) <= t &&
+                       t <= processor.waveform_sample_index(first + n - 1);
+        }
+        if (!complete) continue;
+        for (std::size_t m = 0; m < n; ++m) {
+            const double at = processor.waveform_sample_index(first + m);
+            if (std::abs(at - static_cast<double>(b)) > 300.0) continue;
+            energy += wave[m] * wave[m];
+            moment += at * wave[m] * wave[m];
+        }
+        ++checked;
+        if (energy > 0.0 && std::abs(moment / energy - static_cast<double>(b)) <= 15.0) ++matched;
+    }
+    std::cout << "Processor: " << ring.end() << " frames at " << processor.waveform_rate() << " Hz, " << matched
+              << "/" << checked << " QRS complexes on their beat" << std::endl;
+    if (checked < 3 || matched != checked) {
+        std::cerr << "Waveform does not line up with the beats" << std::endl;
+        ok = false;
+    }
+
+    StableECGProcessor quarter;
+    quarter.set_waveform_ratio(4);
+    quarter.process_samples(samples.data(), total);
+    if (quarter.waveform().end() != total / 4) {
+        std::cerr << "Ratio 4 produced " << quarter.waveform().end() << " frames" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_filter();
+    if (!check_blocks()) ok = false;
+    if (!check_ring()) ok = false;
+    if (!check_processor()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Decimator OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "ecg_processor.hpp"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Simulates an ECG board speaking the binary frame protocol on a pty and checks
+// that ReliableSerialReader decodes the samples, counts sequence gaps and CRC
+// failures, resynchronises after line noise and stops promptly on a silent port.
+
+namespace {
+
+constexpr int FRAMES = 200;
+constexpr int SAMPLES_PER_FRAME = 10;
+
+std::vector<uint8_t> encode_frame(uint16_t sequence, const std::vector<int16_t>& samples) {
+    std::vector<uint8_t> frame = {ECG_FRAME_SYNC0, ECG_FRAME_SYNC1,
+                                  static_cast<uint8_t>(sequence & 0xFF), static_cast<uint8_t>(sequence >> 8),
+                                  1, static_cast<uint8_t>(samples.size())};
+    for (int16_t s : samples) {
+        frame.push_back(static_cast<uint8_t>(s & 0xFF));
+        frame.push_back(static_cast<uint8_t>((static_cast<uint16_t>(s) >> 8) & 0xFF));
+    }
+    const uint16_t crc = ecg_frame_crc16(frame.data() + 2, frame.size() - 2);
+    frame.push_back(static_cast<uint8_t>(crc & 0xFF));
+    frame.push_back(static_cast<uint8_t>(crc >> 8));
+    return frame;
+}
+
+bool write_all(int fd, const std::vector<uint8_t>& bytes) {
+    std::size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (n < 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::cerr << "Failed to create pty" << std::endl;
+        return 1;
+    }
+    const std::string slave = ptsname(master);
+
+    try {
+        StableECGProcessor processor;
+        ReliableSerialReader reader(slave, processor, SerialFormat::BinaryFrame);
+        processor.start();
+        reader.start();
+
+        // Frames 50..52 are never sent, frame 100 is corrupted and
+        // frame 150 is preceded by line noise that contains a false sync byte
+        int expected_samples = 0;
+        for (int f = 0; f < FRAMES; ++f) {
+            if (f >= 50 && f <= 52) continue;
+            std::vector<int16_t> samples;
+            for (int i = 0; i < SAMPLES_PER_FRAME; ++i) {
+                samples.push_back(static_cast<int16_t>(300 * std::sin((f * SAMPLES_PER_FRAME + i) * 0.05)));
+            }
+            std::vector<uint8_t> bytes = encode_frame(static_cast<uint16_t>(f), samples);
+            if (f == 100) {
+                bytes[8] ^= 0x40;
+            } else {
+                expected_samples += SAMPLES_PER_FRAME;
+            }
+            if (f == 150) {
+                bytes.insert(bytes.begin(), {0x00, 0x13, ECG_FRAME_SYNC0, 0x42, 0x37});
+            }
+            if (!write_all(master, bytes)) {
+                std::cerr << "pty write failed" << std::endl;
+                ::close(master);
+                return 1;
+            }
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        while (processor.samples_processed() < static_cast<uint64_t>(expected_samples) &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        // The device is now silent; stop() must not wait for more input
+        const auto stop_start = std::chrono::steady_clock::now();
+        reader.stop();
+        const auto stop_time = std::chrono::steady_clock::now() - stop_start;
+        processor.stop();
+        ::close(master);
+        master = -1;
+
+        bool ok = true;
+        if (stop_time > std::chrono::milliseconds(500)) {
+            std::cerr << "Reader took too long to stop on a silent port" << std::endl;
+            ok = false;
+        }
+        if (reader.samples_parsed() != static_cast<uint64_t>(expected_samples)) {
+            std::cerr << "Expected " << expected_samples << " samples, got " << reader.samples_parsed() << std::endl;
+            ok = false;
+        }
+        if (reader.dropped_frames() != 4) {
+            std::cerr << "Expected 4 dropped frames, got " << reader.dropped_frames() << std::endl;
+            ok = false;
+        }
+        if (reader.crc_errors() < 1) {
+            std::cerr << "Corrupted frame was not reported" << std::endl;
+            ok = false;
+        }
+        if (!ok) return 1;
+        std::cout << "Binary frame decoding OK: " << reader.samples_parsed() << " samples, "
+                  << reader.dropped_frames() << " dropped frames, " << reader.crc_errors() << " CRC errors, "
+                  << reader.read_stats().reads << " reads, " << reader.read_stats().wakeups << " wakeups" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        if (master >= 0) ::close(master);
+        return 1;
+    }
+    return 0;
+}
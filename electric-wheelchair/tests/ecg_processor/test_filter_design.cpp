@@ -0,0 +1,106 @@
+#include "ecg_processor.hpp"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Checks the compile-time filter design: band edges, centre gain and notch
+// depth of every precomputed ECG profile, and that the processor finds the
+// beats of the same recording at each supported sample rate.
+
+namespace {
+
+// Evaluated by the compiler
+constexpr auto BANDPASS_1000 = filter_design::butterworth_bandpass<2>(1000.0, ECG_BAND_LOW_HZ, ECG_BAND_HIGH_HZ);
+static_assert(filter_design::is_stable(BANDPASS_1000), "Band-pass must be stable");
+static_assert(filter_design::abs(filter_design::magnitude(BANDPASS_1000, 1000.0, ECG_BAND_LOW_HZ) - M_SQRT1_2) < 1e-6,
+              "Lower band edge must be at -3 dB");
+static_assert(ECG_RATE_PROFILES[0].sample_rate == 250 && ECG_RATE_PROFILES[3].sample_rate == 2000,
+              "Profiles cover 250 to 2000 Hz");
+
+bool near(double value, double expected, double tolerance) {
+    return std::abs(value - expected) <= tolerance;
+}
+
+bool check_profiles() {
+    bool ok = true;
+    const double centre = std::sqrt(ECG_BAND_LOW_HZ * ECG_BAND_HIGH_HZ);
+    for (const EcgRateProfile& profile : ECG_RATE_PROFILES) {
+        const double fs = profile.sample_rate;
+        // The notch barely touches the pass band, so the band-pass figures hold
+        const double low = filter_design::magnitude(profile.sections, fs, ECG_BAND_LOW_HZ);
+        const double high = filter_design::magnitude(profile.sections, fs, ECG_BAND_HIGH_HZ);
+        const double mid = filter_design::magnitude(profile.sections, fs, centre);
+        const double mains = filter_design::magnitude(profile.sections, fs, ECG_MAINS_HZ);
+        const double dc = filter_design::magnitude(profile.sections, fs, 0.0);
+        std::cout << profile.sample_rate << " Hz: edges " << low << " / " << high << ", centre " << mid
+                  << ", mains " << mains << ", delay " << profile.filter_delay << " samples" << std::endl;
+        if (!near(low, M_SQRT1_2, 0.02) || !near(high, M_SQRT1_2, 0.02) || !near(mid, 1.0, 0.01) ||
+            mains > 1e-6 || dc > 1e-9) {
+            std::cerr << profile.sample_rate << " Hz filter response is off" << std::endl;
+            ok = false;
+        }
+    }
+    try {
+        ecg_rate_profile(300);
+        std::cerr << "Unsupported rate accepted" << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument&) {
+    }
+    return ok;
+}
+
+// 70 bpm with 50 Hz interference, rendered at each rate
+bool check_rates() {
+    bool ok = true;
+    for (const EcgRateProfile& profile : ECG_RATE_PROFILES) {
+        const int rate = profile.sample_rate;
+        const int total = 60 * rate;
+        std::vector<uint64_t> beats;
+        for (int t = rate / 2; t < total - rate; t += rate * 6 / 7) beats.push_back(t);
+        std::vector<double> samples(total);
+        for (int i = 0; i < total; ++i) {
+            double v = 512.0 + 80.0 * std::sin(2.0 * M_PI * ECG_MAINS_HZ * i / rate);
+            for (uint64_t b : beats) {
+                const double d = (static_cast<double>(i) - b) * 1000.0 / rate;  // ms
+                if (std::abs(d) < 400.0) {
+                    v += 900.0 * std::exp(-d * d / (2 * 9.0 * 9.0)) +
+                         200.0 * std::exp(-(d - 300.0) * (d - 300.0) / (2 * 45.0 * 45.0));
+                }
+            }
+            samples[i] = v;
+        }
+
+        StableECGProcessor processor(1, rate);
+        std::vector<uint64_t> detected;
+        processor.set_beat_callback([&detected](uint64_t index) { detected.push_back(index); });
+        processor.process_samples(samples.data(), samples.size());
+
+        // Reported positions are corrected for the filter delay
+        std::size_t matched = 0;
+        for (uint64_t b : beats) {
+            for (uint64_t d : detected) {
+                if (std::llabs(static_cast<int64_t>(d) - static_cast<int64_t>(b)) <= rate / 100) {
+                    ++matched;
+                    break;
+                }
+            }
+        }
+        std::cout << rate << " Hz: " << matched << "/" << beats.size() << " beats within 10 ms, HR "
+                  << processor.current_hr() << " bpm" << std::endl;
+        if (matched + 3 < beats.size() || detected.size() > beats.size() || !near(processor.current_hr(), 70.0, 1.0)) {
+            std::cerr << "Beat detection at " << rate << " Hz failed" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_profiles();
+    if (!check_rates()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Filter design OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "hrv_analyzer.hpp"
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks the incremental HRV metrics against a direct computation over the
+// same window, and that the spectrum puts respiratory (0.25 Hz) and
+// baroreflex (0.1 Hz) RR modulation in the right band.
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+bool close_to(double a, double b, double tolerance) {
+    return std::abs(a - b) <= tolerance * std::max(1.0, std::abs(b));
+}
+
+bool check_time_domain() {
+    constexpr std::size_t WINDOW = 50;
+    HRVAnalyzer hrv(WINDOW);
+    std::mt19937 rng(7);
+    std::normal_distribution<double> jitter(0.0, 40.0);
+    std::vector<double> all;
+    double t = 0.0;
+    for (int beat = 0; beat < 1000; ++beat) {
+        const double rr = 800.0 + jitter(rng);
+        t += rr / 1000.0;
+        all.push_back(rr);
+        hrv.add_interval(rr, t);
+
+        const std::size_t n = std::min(all.size(), WINDOW);
+        const double* w = all.data() + all.size() - n;
+        double mean = 0.0;
+        for (std::size_t i = 0; i < n; ++i) mean += w[i];
+        mean /= n;
+        double var = 0.0, diff2 = 0.0;
+        std::size_t over = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            var += (w[i] - mean) * (w[i] - mean);
+            if (i > 0) {
+                const double d = w[i] - w[i - 1];
+                diff2 += d * d;
+                if (std::abs(d) > 50.0) ++over;
+            }
+        }
+        const HrvMetrics m = hrv.metrics();
+        if (m.beats != n || !close_to(m.mean_rr, mean, 1e-9)) {
+            std::cerr << "Beat " << beat << ": wrong window or mean RR" << std::endl;
+            return false;
+        }
+        if (n < 2) continue;
+        const double sdnn = std::sqrt(var / (n - 1));
+        const double rmssd = std::sqrt(diff2 / (n - 1));
+        const double pnn50 = 100.0 * over / (n - 1);
+        if (!close_to(m.sdnn, sdnn, 1e-6) || !close_to(m.rmssd, rmssd, 1e-6) || !close_to(m.pnn50, pnn50, 1e-9)) {
+            std::cerr << "Beat " << beat << ": SDNN " << m.sdnn << "/" << sdnn << ", RMSSD " << m.rmssd << "/"
+                      << rmssd << ", pNN50 " << m.pnn50 << "/" << pnn50 << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+HrvMetrics modulated_spectrum(double frequency_hz) {
+    HRVAnalyzer hrv;
+    double t = 0.0;
+    while (t < 300.0) {
+        const double rr = 800.0 + 50.0 * std::sin(2.0 * PI * frequency_hz * t);
+        t += rr / 1000.0;
+        hrv.add_interval(rr, t);
+        if (static_cast<int>(t) % 60 == 0) hrv.update_spectrum();  // Keep the queue drained
+    }
+    hrv.update_spectrum();
+    return hrv.metrics();
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_time_domain();
+
+    const HrvMetrics hf = modulated_spectrum(0.25);
+    const HrvMetrics lf = modulated_spectrum(0.10);
+    std::cout << "0.25 Hz modulation: LF " << hf.lf_power << " ms^2, HF " << hf.hf_power << " ms^2" << std::endl;
+    std::cout << "0.10 Hz modulation: LF " << lf.lf_power << " ms^2, HF " << lf.hf_power << " ms^2" << std::endl;
+    // A 50 ms sine carries 1250 ms^2 of power; linear interpolation between
+    // beats attenuates 0.25 Hz by about a quarter at 75 bpm
+    if (!(hf.hf_power > 10 * hf.lf_power) || !close_to(hf.hf_power, 1250.0, 0.3)) {
+        std::cerr << "Respiratory modulation not found in the HF band" << std::endl;
+        ok = false;
+    }
+    if (!(lf.lf_power > 10 * lf.hf_power) || !close_to(lf.lf_power, 1250.0, 0.2)) {
+        std::cerr << "Baroreflex modulation not found in the LF band" << std::endl;
+        ok = false;
+    }
+
+    // The spectrum thread starts and stops cleanly with beats in flight
+    HRVAnalyzer threaded;
+    threaded.start();
+    for (int i = 0; i < 1000; ++i) threaded.add_interval(800.0, i * 0.8);
+    threaded.stop();
+    if (threaded.metrics().beats != HRV_WINDOW_BEATS) {
+        std::cerr << "Threaded analyzer lost beats" << std::endl;
+        ok = false;
+    }
+
+    if (!ok) return 1;
+    std::cout << "HRV analysis OK" << std::endl;
+    return 0;
+}
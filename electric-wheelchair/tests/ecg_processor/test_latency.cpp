@@ -0,0 +1,126 @@
+#include "ecg_processor.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Checks the log-linear latency histogram (bucket precision, percentiles,
+// concurrent recording) and that a live pty feed at 1 kHz fills every stage of
+// the pipeline's latency histograms, including beat-to-heart-rate latency.
+
+namespace {
+
+bool check_histogram() {
+    bool ok = true;
+    for (uint64_t v = 0; v < 5000000; v = v < 100 ? v + 1 : v + v / 97) {
+        const std::size_t b = LatencyHistogram::bucket(v);
+        const uint64_t high = LatencyHistogram::upper_bound(b);
+        const uint64_t low = b == 0 ? 0 : LatencyHistogram::upper_bound(b - 1) + 1;
+        if (v < low || v > high || static_cast<double>(high - low) > v / 16.0 + 1.0) {
+            std::cerr << "Value " << v << " in bucket [" << low << ", " << high << "]" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+    if (LatencyHistogram::bucket(UINT64_MAX) >= LatencyHistogram::BUCKETS) {
+        std::cerr << "Largest value has no bucket" << std::endl;
+        ok = false;
+    }
+
+    // Four threads record 1..100000 us each; percentiles within bucket precision
+    LatencyHistogram h;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&h]() {
+            for (uint64_t v = 1; v <= 100000; ++v) h.record(v * 1000);
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    const double p50 = h.percentile(0.5) / 1e3, p99 = h.percentile(0.99) / 1e3;
+    std::cout << "Histogram: " << h.count() << " values, p50 " << p50 << " us, p99 " << p99 << " us, max "
+              << h.max() / 1e3 << " us" << std::endl;
+    if (h.count() != 400000 || h.max() != 100000000 || std::abs(p50 - 50000.0) > 50000.0 / 16 ||
+        std::abs(p99 - 99000.0) > 99000.0 / 16 || std::abs(h.mean() / 1e3 - 50000.5) > 1.0) {
+        std::cerr << "Histogram statistics are off" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// 75 bpm, one "a,b,ecg" line per millisecond sent in 5 ms bursts
+bool check_pipeline() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::cerr << "Failed to create pty" << std::endl;
+        return false;
+    }
+    bool ok = true;
+    try {
+        StableECGProcessor processor;
+        ReliableSerialReader reader(ptsname(master), processor);
+        processor.start();
+        reader.start();
+
+        const int total = 5000;
+        std::mt19937 rng(5);
+        std::normal_distribution<double> noise(0.0, 8.0);
+        auto next = std::chrono::steady_clock::now();
+        std::string burst;
+        for (int i = 0; i < total; ++i) {
+            const double d = (i + 300) % 800 - 400.0;
+            const double v = 512.0 + 900.0 * std::exp(-d * d / (2 * 9.0 * 9.0)) +
+                             200.0 * std::exp(-(d - 300.0) * (d - 300.0) / (2 * 45.0 * 45.0)) + noise(rng);
+            burst += "0,0," + std::to_string(static_cast<int>(v / ECG_VALUE_SCALE)) + "\n";
+            if (i % 5 == 4) {
+                if (::write(master, burst.data(), burst.size()) != static_cast<ssize_t>(burst.size())) {
+                    throw std::runtime_error("pty write failed");
+                }
+                burst.clear();
+                next += std::chrono::milliseconds(5);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        reader.stop();
+        processor.stop();
+
+        processor.write_latency_report(std::cout);
+        for (std::size_t i = 0; i < LATENCY_STAGES; ++i) {
+            if (processor.latency(static_cast<LatencyStage>(i)).count() == 0) {
+                std::cerr << "Nothing recorded for " << latency_stage_name(static_cast<LatencyStage>(i)) << std::endl;
+                ok = false;
+            }
+        }
+        const LatencyHistogram& read = processor.latency(LatencyStage::Read);
+        const LatencyHistogram& total_latency = processor.latency(LatencyStage::Total);
+        const LatencyHistogram& beat = processor.latency(LatencyStage::Beat);
+        // Reads wait for the coalescing delay; a batch is published well within
+        // a frame of the display, and a beat needs the samples after its R peak
+        if (read.percentile(0.5) < SERIAL_COALESCE_US * 900u || total_latency.percentile(0.5) > 50000000u ||
+            beat.count() < 3 || beat.percentile(0.5) < 50000000u || beat.max() > 2000000000u) {
+            std::cerr << "Stage latencies are implausible" << std::endl;
+            ok = false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        ok = false;
+    }
+    ::close(master);
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_histogram();
+    if (!check_pipeline()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Latency instrumentation OK" << std::endl;
+    return 0;
+}
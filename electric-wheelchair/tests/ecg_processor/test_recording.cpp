@@ -0,0 +1,263 @@
+#include "ecg_processor.hpp"
+#include "ecg_recording.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// Checks the ECG recording format: lossless round trip of the board's
+// samples, seeking, the filtered stream, gaps left by a lagging recorder,
+// files cut short or damaged on the card, replay into a new processor with
+// identical beats, and recording from a running pipeline.
+
+namespace {
+
+// Board samples are whole ADC counts scaled by ECG_VALUE_SCALE
+std::vector<double> synthetic_ecg(std::size_t total, std::size_t leads) {
+    std::mt19937 rng(11);
+    std::normal_distribution<double> noise(0.0, 3.0);
+    std::vector<double> samples(total * leads);
+    for (std::size_t i = 0; i < total; ++i) {
+        const double phase = std::fmod(static_cast<double>(i), 830.0) - 415.0;
+        const double wander = 40.0 * std::sin(2.0 * M_PI * 0.2 * i / SAMPLE_RATE);
+        for (std::size_t lead = 0; lead < leads; ++lead) {
+            const double counts = 512.0 + wander + (600.0 - 150.0 * lead) * std::exp(-phase * phase / 162.0) + noise(rng);
+            samples[i * leads + lead] = std::round(counts) * ECG_VALUE_SCALE;
+        }
+    }
+    return samples;
+}
+
+std::string temp_path() {
+    char path[] = "/tmp/ecg_recording_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd >= 0) ::close(fd);
+    return path;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+}
+
+// Every frame in [first, last) of the recording against the input
+bool matches(const EcgRecording& recording, const std::vector<double>& samples, uint64_t first, uint64_t last,
+             uint64_t& delivered) {
+    const std::size_t leads = recording.leads();
+    bool ok = true;
+    uint64_t expected = first;
+    delivered = recording.replay(RecordingStream::Raw, first, last,
+                                 [&](uint64_t index, const double* frames, std::size_t count) {
+        if (index < expected) ok = false;
+        for (std::size_t i = 0; i < count * leads; ++i) {
+            if (std::abs(frames[i] - samples[index * leads + i]) > RECORDING_STEP / 2) ok = false;
+        }
+        expected = index + count;
+    });
+    return ok;
+}
+
+bool check_round_trip(std::size_t leads) {
+    bool ok = true;
+    const std::size_t total = 120 * SAMPLE_RATE, chunk = SAMPLE_RATE / 10;
+    const std::vector<double> samples = synthetic_ecg(total, leads);
+    const std::string path = temp_path();
+    StableECGProcessor processor(leads);
+    std::vector<uint64_t> beats;
+    processor.set_beat_callback([&beats](uint64_t r_index) { beats.push_back(r_index); });
+    {
+        EcgRecorder recorder(processor, path);
+        for (std::size_t at = 0; at < total; at += chunk) {
+            processor.process_samples(samples.data() + at * leads, chunk);
+            recorder.poll();
+        }
+        recorder.stop();
+        const double bytes_per_value = static_cast<double>(recorder.bytes_written()) / (total * leads);
+        std::cout << leads << " lead(s): " << recorder.bytes_written() << " bytes for " << total << " frames ("
+                  << bytes_per_value << " bytes/value, " << bytes_per_value * leads * SAMPLE_RATE * 86400 / 1e6
+                  << " MB/day)" << std::endl;
+        if (recorder.frames_recorded(RecordingStream::Raw) != total || recorder.frames_lost(RecordingStream::Raw) != 0 ||
+            bytes_per_value > 2.5) {
+            std::cerr << "Recorder did not take every frame compactly" << std::endl;
+            ok = false;
+        }
+    }
+
+    EcgRecording recording(path);
+    uint64_t delivered = 0;
+    if (!recording.complete() || recording.leads() != leads || recording.begin(RecordingStream::Raw) != 0 ||
+        recording.end(RecordingStream::Raw) != total || !matches(recording, samples, 0, total, delivered) ||
+        delivered != total) {
+        std::cerr << "Raw stream does not round-trip" << std::endl;
+        ok = false;
+    }
+    // Seek into the middle of a block
+    if (!matches(recording, samples, 61234, 61334, delivered) || delivered != 100) {
+        std::cerr << "Seek returned the wrong frames" << std::endl;
+        ok = false;
+    }
+    // The filtered stream is the processor's waveform
+    const WaveformRing& waveform = processor.waveform();
+    uint64_t cursor = waveform.end() - 500;
+    std::vector<double> tail(500 * leads);
+    waveform.read(cursor, tail.data(), 500);
+    double filtered_error = 0.0;
+    const uint64_t filtered = recording.replay(RecordingStream::Filtered, waveform.end() - 500, waveform.end(),
+                                               [&](uint64_t index, const double* frames, std::size_t count) {
+        for (std::size_t i = 0; i < count * leads; ++i) {
+            const double expected = tail[(index - (waveform.end() - 500)) * leads + i];
+            filtered_error = std::max(filtered_error, std::abs(frames[i] - expected));
+        }
+    });
+    if (recording.end(RecordingStream::Filtered) != waveform.end() || filtered != 500 ||
+        filtered_error > RECORDING_STEP / 2) {
+        std::cerr << "Filtered stream does not match the waveform" << std::endl;
+        ok = false;
+    }
+    // Wall-clock seeks follow the sample clock
+    const int64_t t = recording.start_time_ns() + 20000000000LL;
+    const uint64_t at20 = recording.index_at(RecordingStream::Raw, t);
+    const uint64_t at30 = recording.index_at(RecordingStream::Raw, t + 10000000000LL);
+    if (at30 - at20 != 10 * SAMPLE_RATE || std::abs(static_cast<double>(at20) - 20 * SAMPLE_RATE) > SAMPLE_RATE) {
+        std::cerr << "Time seek landed on " << at20 << " and " << at30 << std::endl;
+        ok = false;
+    }
+
+    // Replaying the recording reproduces the beats exactly
+    StableECGProcessor replayed(leads);
+    std::vector<uint64_t> replay_beats;
+    replayed.set_beat_callback([&replay_beats](uint64_t r_index) { replay_beats.push_back(r_index); });
+    recording.replay_into(replayed, 0, total);
+    if (beats.size() < 100 || replay_beats != beats) {
+        std::cerr << "Replay found " << replay_beats.size() << " beats, live " << beats.size() << std::endl;
+        ok = false;
+    }
+    std::remove(path.c_str());
+    return ok;
+}
+
+// A recorder that is not polled for longer than the processor's history
+// leaves a gap; a cut or damaged file still reads up to the damage
+bool check_gaps_and_damage() {
+    bool ok = true;
+    const std::size_t total = 60 * SAMPLE_RATE, chunk = SAMPLE_RATE / 10;
+    const std::size_t stall_from = 20 * SAMPLE_RATE, stall_to = 35 * SAMPLE_RATE;
+    const std::vector<double> samples = synthetic_ecg(total, 1);
+    const std::string path = temp_path();
+    StableECGProcessor processor;
+    uint64_t lost = 0;
+    {
+        EcgRecorder recorder(processor, path);
+        for (std::size_t at = 0; at < total; at += chunk) {
+            processor.process_samples(samples.data() + at, chunk);
+            if (at < stall_from || at >= stall_to) recorder.poll();
+        }
+        recorder.stop();
+        lost = recorder.frames_lost(RecordingStream::Raw);
+    }
+    EcgRecording recording(path);
+    uint64_t delivered = 0, gap_at = 0, previous_end = 0;
+    recording.replay(RecordingStream::Raw, 0, total, [&](uint64_t index, const double*, std::size_t count) {
+        if (index != previous_end) gap_at = previous_end;
+        delivered += count;
+        previous_end = index + count;
+    });
+    const uint64_t expected_lost = stall_to + chunk - stall_from - processor.raw().capacity();
+    std::cout << "Stalled recorder: " << lost << " samples lost from " << gap_at << std::endl;
+    if (lost != expected_lost || delivered != total - lost || gap_at == 0 || gap_at > stall_from + chunk) {
+        std::cerr << "Gap not recorded as expected" << std::endl;
+        ok = false;
+    }
+
+    // Power lost mid-write: no index and half a block at the end
+    const std::string bytes = read_file(path);
+    const std::string cut_path = temp_path();
+    write_file(cut_path, bytes.substr(0, bytes.size() / 2 + 77));
+    {
+        EcgRecording cut(cut_path);
+        uint64_t cut_delivered = 0;
+        if (cut.complete() || !matches(cut, samples, 0, total, cut_delivered) || cut_delivered < delivered / 3 ||
+            cut_delivered >= delivered || cut.end(RecordingStream::Raw) >= total) {
+            std::cerr << "Cut recording not recovered" << std::endl;
+            ok = false;
+        }
+        std::cout << "Cut recording: " << cut_delivered << " samples readable" << std::endl;
+    }
+
+    // One flipped payload byte loses that block only
+    std::string damaged = bytes;
+    damaged[32 + 32 + 100] ^= 0x5A;
+    write_file(cut_path, damaged);
+    {
+        EcgRecording bad(cut_path);
+        uint64_t bad_delivered = 0;
+        if (!matches(bad, samples, 0, total, bad_delivered) || bad.corrupt_blocks() != 1 ||
+            bad_delivered != total - lost - RECORDING_BLOCK_FRAMES) {
+            std::cerr << "Damaged block not skipped" << std::endl;
+            ok = false;
+        }
+    }
+    std::remove(cut_path.c_str());
+    std::remove(path.c_str());
+
+    try {
+        write_file(cut_path, "not a recording");
+        EcgRecording junk(cut_path);
+        std::cerr << "Junk file accepted" << std::endl;
+        ok = false;
+    } catch (const std::runtime_error&) {
+    }
+    std::remove(cut_path.c_str());
+    return ok;
+}
+
+// The recorder thread keeps up with a running pipeline
+bool check_live() {
+    const std::size_t total = 3 * SAMPLE_RATE, chunk = 50;
+    const std::vector<double> samples = synthetic_ecg(total, 1);
+    const std::string path = temp_path();
+    StableECGProcessor processor;
+    EcgRecorder recorder(processor, path);
+    processor.start();
+    recorder.start();
+    for (std::size_t at = 0; at < total; at += chunk) {
+        while (processor.try_add_samples(samples.data() + at, chunk) < chunk) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    while (processor.samples_processed() < total) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    processor.stop();
+    recorder.stop();
+    EcgRecording recording(path);
+    uint64_t delivered = 0;
+    const bool ok = matches(recording, samples, 0, total, delivered) && delivered == total &&
+                    recorder.frames_lost(RecordingStream::Raw) == 0;
+    std::cout << "Live: " << delivered << " of " << total << " samples recorded" << std::endl;
+    if (!ok) std::cerr << "Live recording incomplete" << std::endl;
+    std::remove(path.c_str());
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_round_trip(1);
+    if (!check_round_trip(3)) ok = false;
+    if (!check_gaps_and_damage()) ok = false;
+    if (!check_live()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Recording OK" << std::endl;
+    return 0;
+}
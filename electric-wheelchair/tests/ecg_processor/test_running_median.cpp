@@ -0,0 +1,92 @@
+#include "running_median.hpp"
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks RunningMedian against sorting the last values: odd and even window
+// widths, partly filled windows, streams with many duplicates (where the
+// value leaving the window has equal copies in the sorted view), and clear().
+
+namespace {
+
+// Upper middle value of the reference window, as median() documents
+int reference_median(const std::deque<int>& window) {
+    std::vector<int> sorted(window.begin(), window.end());
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[sorted.size() / 2];
+}
+
+bool compare(const char* name, std::size_t width, const std::vector<int>& values) {
+    RunningMedian<int> median(width);
+    std::deque<int> window;
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        median.push(values[i]);
+        window.push_back(values[i]);
+        if (window.size() > width) window.pop_front();
+        const int expected = reference_median(window);
+        if (median.median() != expected || median.size() != window.size()) {
+            std::cerr << name << ", width " << width << ", value " << i << ": median " << median.median()
+                      << " (expected " << expected << ")" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_streams() {
+    bool ok = true;
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<int> few(0, 3);
+    std::uniform_int_distribution<int> wide(300, 1500);  // RR intervals in ms
+    std::vector<int> duplicates(2000), spread(2000), steps;
+    for (int& v : duplicates) v = few(rng);
+    for (int& v : spread) v = wide(rng);
+    for (int i = 0; i < 600; ++i) steps.push_back(i / 50 % 2 ? 800 : 600);  // Plateaus longer than the window
+    for (std::size_t width : {1, 2, 3, 4, 5, 8, 9, 31}) {
+        if (!compare("Duplicates", width, duplicates)) ok = false;
+        if (!compare("Random", width, spread)) ok = false;
+        if (!compare("Steps", width, steps)) ok = false;
+    }
+    return ok;
+}
+
+// Hand-checked windows: odd, even (upper middle) and duplicates of the median
+bool check_known() {
+    RunningMedian<double> median(4);
+    bool ok = true;
+    median.push(700.0);
+    ok = ok && median.median() == 700.0;
+    median.push(900.0);
+    ok = ok && median.median() == 900.0;  // {700, 900}
+    median.push(800.0);
+    ok = ok && median.median() == 800.0;  // {700, 800, 900}
+    median.push(800.0);
+    ok = ok && median.median() == 800.0;  // {700, 800, 800, 900}
+    median.push(1000.0);                  // 700 leaves: {800, 800, 900, 1000}
+    ok = ok && median.median() == 900.0;
+    median.push(600.0);                   // 900 leaves: {600, 800, 800, 1000}
+    ok = ok && median.median() == 800.0;
+    if (!ok) {
+        std::cerr << "Median of a hand-checked window is wrong" << std::endl;
+        return false;
+    }
+    median.clear();
+    median.push(650.0);
+    if (median.size() != 1 || median.median() != 650.0) {
+        std::cerr << "clear() kept old values" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_streams();
+    if (!check_known()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Running median OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include "ecg_processor.hpp"
+#include "sample_clock.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Checks sample-clock recovery from bursty serial arrivals: an ADC running
+// 3000 ppm fast behind a link with buffering jitter and slow patches, with
+// samples lost and sent twice. The recovered rate, the slip counts and R-R
+// intervals taken from time_of() are compared with the true ADC clock, and a
+// processor fed timed batches reports the true heart rate. A replay faster
+// than real time keeps the nominal clock and still reports heart rate and HRV.
+
+namespace {
+
+constexpr double TRUE_RATE = SAMPLE_RATE * 1.003;
+constexpr uint64_t BEAT_SAMPLES = 830;
+constexpr uint64_t DROP_AT = 40000, DROP_COUNT = 5;
+constexpr uint64_t DUPLICATE_AT = 70000, DUPLICATE_COUNT = 3;
+constexpr uint64_t START_NS = 1000000000000ULL;
+
+struct Batch {
+    uint64_t end;      // Stream samples received so far
+    uint64_t arrival;  // ns
+};
+
+// The stream as the host sees it: the ADC index of every received sample,
+// and the batches the link delivered it in
+struct Link {
+    std::vector<uint64_t> adc;
+    std::vector<Batch> batches;
+};
+
+double acquired_ns(uint64_t adc_index) {
+    return START_NS + adc_index * 1e9 / TRUE_RATE;
+}
+
+Link simulate_link(uint64_t adc_samples) {
+    Link link;
+    for (uint64_t a = 0; a < adc_samples; ++a) {
+        if (a >= DROP_AT && a < DROP_AT + DROP_COUNT) continue;
+        link.adc.push_back(a);
+        if (a == DUPLICATE_AT + DUPLICATE_COUNT - 1) {
+            for (uint64_t d = DUPLICATE_AT; d <= a; ++d) link.adc.push_back(d);
+        }
+    }
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> batch_size(1, 40);
+    std::exponential_distribution<double> jitter(1.0 / 2e6);  // Mean 2 ms
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    uint64_t end = 0, last_arrival = 0;
+    while (end < link.adc.size()) {
+        end = std::min<uint64_t>(end + batch_size(rng), link.adc.size());
+        double delay = 200e3 + jitter(rng);
+        if (uniform(rng) < 0.01) delay += 40e6;  // Slow patch on the link
+        const uint64_t arrival =
+            std::max(last_arrival, static_cast<uint64_t>(acquired_ns(link.adc[end - 1]) + delay));
+        link.batches.push_back({end, arrival});
+        last_arrival = arrival;
+    }
+    return link;
+}
+
+// Beats every BEAT_SAMPLES of the ADC, timed as the processor would: when the
+// detector sees them, shortly after their batch arrives
+bool check_clock() {
+    bool ok = true;
+    const uint64_t total = 150 * SAMPLE_RATE;
+    const Link link = simulate_link(total);
+    SampleClock clock(SAMPLE_RATE);
+    const double true_rr = BEAT_SAMPLES * 1000.0 / TRUE_RATE;
+    const double nominal_error = std::abs(BEAT_SAMPLES * 1000.0 / SAMPLE_RATE - true_rr);
+    double last_ms = 0.0, worst = 0.0;
+    uint64_t next = BEAT_SAMPLES, checked = 0;
+    for (const Batch& b : link.batches) {
+        clock.add_batch(b.end, b.arrival);
+        while (next + 100 < b.end) {
+            const uint64_t adc = link.adc[next];
+            const double ms = clock.time_of(next) / 1e6;
+            const bool near_slip = (adc > DROP_AT - 2000 && adc < DROP_AT + 4000) ||
+                                   (adc > DUPLICATE_AT - 2000 && adc < DUPLICATE_AT + 4000);
+            if (last_ms > 0.0 && adc > 10 * SAMPLE_RATE && !near_slip) {
+                worst = std::max(worst, std::abs(ms - last_ms - true_rr));
+                ++checked;
+            }
+            last_ms = ms;
+            // Next beat, found by its ADC index since slips shift the stream
+            next += BEAT_SAMPLES - 10;
+            while (next < link.adc.size() && link.adc[next] % BEAT_SAMPLES != 0) ++next;
+        }
+    }
+    const SampleClockStatus s = clock.status();
+    std::cout << "Recovered " << s.rate_hz << " Hz (" << s.ppm << " ppm) for " << TRUE_RATE << " Hz, delay "
+              << s.delay_us << " us, " << s.dropped << " dropped, " << s.duplicated << " duplicated" << std::endl;
+    std::cout << checked << " R-R intervals within " << worst << " ms (nominal clock " << nominal_error << " ms)"
+              << std::endl;
+    if (!s.locked || std::abs(s.rate_hz - TRUE_RATE) > TRUE_RATE * 50e-6 || !(s.delay_us > 0.0)) {
+        std::cerr << "ADC rate not recovered" << std::endl;
+        ok = false;
+    }
+    if (s.dropped != DROP_COUNT || s.duplicated != DUPLICATE_COUNT) {
+        std::cerr << "Slips miscounted" << std::endl;
+        ok = false;
+    }
+    if (checked < 100 || worst > 0.5 || worst > nominal_error / 4) {
+        std::cerr << "R-R intervals not on the ADC clock" << std::endl;
+        ok = false;
+    }
+
+    // Samples after the slips map back onto the ADC clock
+    const uint64_t late = link.adc.size() - 5000;
+    const double step = clock.time_of(late) - clock.time_of(late - 40000);
+    const double expected = acquired_ns(link.adc[late]) - acquired_ns(link.adc[late - 40000]);
+    if (std::abs(step - expected) > 1e6) {
+        std::cerr << "Index mapping off by " << (step - expected) / 1e6 << " ms" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// A file replayed far faster than real time never locks; times stay nominal
+// and a sample's time does not move once it has been handed out
+bool check_replay() {
+    bool ok = true;
+    SampleClock clock(SAMPLE_RATE);
+    double last_ms = 0.0;
+    for (uint64_t end = 100; end <= 60 * SAMPLE_RATE; end += 100) {
+        const double before = end > 100 ? clock.time_of(end - 101) : 0.0;
+        clock.add_batch(end, START_NS + end * 1000);
+        const double ms = clock.time_of(end - 1) / 1e6;
+        if ((end > 100 && clock.time_of(end - 101) != before) || ms <= last_ms) {
+            std::cerr << "Fast replay moved earlier samples at " << end << std::endl;
+            ok = false;
+            break;
+        }
+        last_ms = ms;
+    }
+    const SampleClockStatus s = clock.status();
+    const double rr = (clock.time_of(5000 + BEAT_SAMPLES) - clock.time_of(5000)) / 1e6;
+    if (s.locked || s.rate_hz != SAMPLE_RATE || s.delay_us != 0.0 || std::abs(rr - BEAT_SAMPLES) > 1e-6) {
+        std::cerr << "Fast replay changed the clock" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// Periodic beats with the given ADC index, as the link would carry them
+std::vector<double> beat_samples(const std::vector<uint64_t>& adc) {
+    std::mt19937 rng(3);
+    std::normal_distribution<double> noise(0.0, 3.0);
+    std::vector<double> samples(adc.size());
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        const double phase = static_cast<double>(adc[i] % BEAT_SAMPLES) - BEAT_SAMPLES / 2.0;
+        samples[i] = 512.0 + 600.0 * std::exp(-phase * phase / 162.0) + noise(rng);
+    }
+    return samples;
+}
+
+// Feed timed batches to a running processor and wait for it to drain
+void run_processor(StableECGProcessor& processor, const std::vector<double>& samples, const std::vector<Batch>& batches) {
+    processor.start();
+    uint64_t sent = 0;
+    for (const Batch& b : batches) {
+        const BatchTiming timing = {b.arrival, b.arrival, b.arrival};
+        while (sent < b.end) {
+            sent += processor.try_add_samples(samples.data() + sent, b.end - sent, &timing);
+            if (sent < b.end) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (processor.samples_processed() < sent && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    processor.stop();
+}
+
+// Periodic beats through a running processor with timed batches
+bool check_processor() {
+    const uint64_t total = 40 * SAMPLE_RATE;
+    const Link link = simulate_link(total);
+    StableECGProcessor processor;
+    run_processor(processor, beat_samples(link.adc), link.batches);
+    const double hr = processor.current_hr();
+    const double true_hr = 60.0 * TRUE_RATE / BEAT_SAMPLES;
+    const SampleClockStatus s = processor.sample_clock();
+    std::cout << "Processor: " << hr << " bpm for " << true_hr << " bpm, clock " << s.ppm << " ppm" << std::endl;
+    if (!s.locked || std::abs(hr - true_hr) > 0.05) {
+        std::cerr << "Heart rate not on the ADC clock" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The same beats from a file, arriving 50 times faster than real time:
+// heart rate and HRV come out on the nominal clock
+bool check_processor_replay() {
+    const uint64_t total = 40 * SAMPLE_RATE;
+    std::vector<uint64_t> adc(total);
+    for (uint64_t i = 0; i < total; ++i) adc[i] = i;
+    std::vector<Batch> batches;
+    for (uint64_t end = 64; end <= total; end += 64) batches.push_back({end, START_NS + end * 20000});
+    StableECGProcessor processor;
+    run_processor(processor, beat_samples(adc), batches);
+    const double hr = processor.current_hr();
+    const double nominal_hr = 60.0 * SAMPLE_RATE / BEAT_SAMPLES;
+    const HrvMetrics hrv = processor.hrv_metrics();
+    std::cout << "Fast replay: " << hr << " bpm for " << nominal_hr << " bpm, HRV over " << hrv.beats << " beats"
+              << std::endl;
+    if (processor.sample_clock().locked || std::abs(hr - nominal_hr) > 0.05 || hrv.beats < 40) {
+        std::cerr << "Fast replay lost the heart rate" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_clock();
+    if (!check_replay()) ok = false;
+    if (!check_processor()) ok = false;
+    if (!check_processor_replay()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Sample clock OK" << std::endl;
+    return 0;
+}
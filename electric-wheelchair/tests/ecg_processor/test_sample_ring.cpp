@@ -0,0 +1,180 @@
+#include "sample_ring.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Checks the SPSC sample ring: order across many wraparounds, truncation and
+// overrun counting when full, the notify()/pop_wait() eventfd handshake with
+// a producer on another thread, and wake() releasing a blocked consumer.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Batches of 5 through 8 slots wrap the indices on nearly every push
+bool check_wraparound() {
+    SpscRing<uint32_t, 8> ring;
+    uint32_t next_in = 0, next_out = 0;
+    for (int round = 0; round < 1000; ++round) {
+        uint32_t in[5], out[8];
+        for (uint32_t& v : in) v = next_in++;
+        if (ring.push(in, 5) != 5 || ring.size() != 5) {
+            std::cerr << "Push of 5 into an empty ring of 8 fell short" << std::endl;
+            return false;
+        }
+        const std::size_t n = ring.pop(out, 8);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (out[i] != next_out++) {
+                std::cerr << "Item " << out[i] << " out of order after wraparound" << std::endl;
+                return false;
+            }
+        }
+        if (n != 5 || ring.size() != 0) {
+            std::cerr << "Popped " << n << " of 5 items" << std::endl;
+            return false;
+        }
+    }
+    if (ring.overruns() != 0) {
+        std::cerr << "Overruns counted without a full ring" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// try_push() stores what fits; push() also counts the rest as overruns
+bool check_full() {
+    bool ok = true;
+    SpscRing<int, 8> ring;
+    std::vector<int> items(12);
+    for (int i = 0; i < 12; ++i) items[i] = i;
+    if (ring.try_push(items.data(), 3) != 3 || ring.try_push(items.data() + 3, 9) != 5 || ring.free_space() != 0) {
+        std::cerr << "try_push did not fill the ring exactly" << std::endl;
+        ok = false;
+    }
+    if (ring.overruns() != 0) {
+        std::cerr << "try_push counted overruns" << std::endl;
+        ok = false;
+    }
+    if (ring.push(items.data() + 8, 4) != 0 || ring.overruns() != 4) {
+        std::cerr << "Push into a full ring stored items or missed overruns" << std::endl;
+        ok = false;
+    }
+    int out[8];
+    if (ring.pop(out, 3) != 3 || ring.free_space() != 3) {
+        std::cerr << "Popping did not free space" << std::endl;
+        ok = false;
+    }
+    if (ring.push(items.data() + 8, 4) != 3 || ring.overruns() != 5) {
+        std::cerr << "Partial push miscounted" << std::endl;
+        ok = false;
+    }
+    const int expected[] = {3, 4, 5, 6, 7, 8, 9, 10};
+    if (ring.pop(out, 8) != 8 || !std::equal(out, out + 8, expected)) {
+        std::cerr << "Truncated pushes left the wrong items" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// A producer pushing bursts with notify() to a consumer sleeping in
+// pop_wait(): every item arrives in order, none of the waits runs into its
+// timeout, and there is at most one wakeup per notify()
+bool check_handshake() {
+    bool ok = true;
+    constexpr uint32_t BURSTS = 2000, BURST = 20;
+    SpscRing<uint32_t, 64> ring;
+    ring.notify();  // Nobody asleep: no wakeup
+    if (ring.wakeups() != 0) {
+        std::cerr << "notify() woke an idle consumer" << std::endl;
+        ok = false;
+    }
+
+    std::atomic<bool> in_order{true};
+    std::atomic<bool> missed{false};  // A wait ran into its timeout
+    std::atomic<double> slowest_ms{0.0};
+    std::thread consumer([&] {
+        uint32_t out[64], next = 0;
+        while (next < BURSTS * BURST) {
+            const auto start = Clock::now();
+            const std::size_t n = ring.pop_wait(out, 64, 1000);
+            slowest_ms.store(std::max(slowest_ms.load(), elapsed_ms(start)));
+            if (n == 0 || slowest_ms.load() >= 1000.0) {
+                missed = true;
+                break;
+            }
+            for (std::size_t i = 0; i < n; ++i) {
+                if (out[i] != next++) in_order = false;
+            }
+        }
+    });
+    uint32_t next = 0;
+    uint64_t notifies = 0;
+    for (uint32_t b = 0; b < BURSTS && !missed; ++b) {
+        uint32_t burst[BURST];
+        for (uint32_t& v : burst) v = next++;
+        for (std::size_t sent = 0; sent < BURST && !missed; ) {
+            sent += ring.try_push(burst + sent, BURST - sent);
+            ring.notify();
+            ++notifies;
+            if (sent < BURST) std::this_thread::yield();
+        }
+        if (b % 8 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));  // Let the consumer sleep
+    }
+    consumer.join();
+    std::cout << "Handshake: " << BURSTS << " bursts, " << ring.wakeups() << " wakeups, slowest wait "
+              << slowest_ms.load() << " ms" << std::endl;
+    if (missed) {
+        std::cerr << "A wait ran into its timeout: a notify() was missed" << std::endl;
+        ok = false;
+    } else if (!in_order || ring.size() != 0) {
+        std::cerr << "Items lost or reordered between threads" << std::endl;
+        ok = false;
+    }
+    if (ring.wakeups() == 0 || ring.wakeups() > notifies) {
+        std::cerr << "Wakeups not tied to the sleeping consumer" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// wake() releases a consumer blocked on an empty ring long before its timeout
+bool check_wake() {
+    SpscRing<int, 16> ring;
+    std::atomic<std::size_t> popped{1};
+    std::atomic<double> waited_ms{0.0};
+    std::thread consumer([&] {
+        int out[16];
+        const auto start = Clock::now();
+        popped = ring.pop_wait(out, 16, 5000);
+        waited_ms = elapsed_ms(start);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ring.wake();
+    consumer.join();
+    std::cout << "wake() released the consumer after " << waited_ms.load() << " ms" << std::endl;
+    if (popped != 0 || waited_ms.load() > 2000.0) {
+        std::cerr << "wake() did not release the blocked consumer" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_wraparound();
+    if (!check_full()) ok = false;
+    if (!check_handshake()) ok = false;
+    if (!check_wake()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Sample ring OK" << std::endl;
+    return 0;
+}
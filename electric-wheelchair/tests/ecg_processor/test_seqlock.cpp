@@ -0,0 +1,117 @@
+#include "seqlock.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Checks the SeqLock snapshot: a writer publishing as fast as it can to
+// several readers spinning on load(). Every snapshot must be one the writer
+// stored (no fields from two different stores), and each reader must see the
+// published values in order.
+
+namespace {
+
+constexpr std::size_t FIELDS = 9;  // More than a cache line of payload
+
+// Every field derives from the same counter, so a torn copy shows
+struct Snapshot {
+    uint64_t counter;
+    uint64_t fields[FIELDS];
+    double value;
+};
+
+Snapshot make_snapshot(uint64_t counter) {
+    Snapshot s;
+    s.counter = counter;
+    for (std::size_t i = 0; i < FIELDS; ++i) s.fields[i] = counter * (i + 3) + i;
+    s.value = static_cast<double>(counter) * 0.5;
+    return s;
+}
+
+bool consistent(const Snapshot& s) {
+    for (std::size_t i = 0; i < FIELDS; ++i) {
+        if (s.fields[i] != s.counter * (i + 3) + i) return false;
+    }
+    return s.value == static_cast<double>(s.counter) * 0.5;
+}
+
+bool check_single_thread() {
+    SeqLock<Snapshot> lock;
+    const Snapshot initial = lock.load();
+    if (initial.counter != 0 || initial.fields[FIELDS - 1] != 0 || lock.version() != 0) {
+        std::cerr << "A new SeqLock does not hold a zero value" << std::endl;
+        return false;
+    }
+    lock.store(make_snapshot(7));
+    lock.store(make_snapshot(8));
+    const Snapshot s = lock.load();
+    if (s.counter != 8 || !consistent(s) || lock.version() != 2) {
+        std::cerr << "SeqLock lost the last stored value" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// One writer, several readers, for a fixed time
+bool check_concurrent() {
+    constexpr int READERS = 3;
+    SeqLock<Snapshot> lock;
+    lock.store(make_snapshot(1));
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> torn{0}, backwards{0}, loads{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; ++r) {
+        readers.emplace_back([&] {
+            uint64_t last = 0, count = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                const Snapshot s = lock.load();
+                if (!consistent(s)) ++torn;
+                if (s.counter < last) ++backwards;
+                last = s.counter;
+                ++count;
+            }
+            loads += count;
+        });
+    }
+    uint64_t counter = 1;
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(1500);
+    while (std::chrono::steady_clock::now() < end) {
+        for (int i = 0; i < 1000; ++i) lock.store(make_snapshot(++counter));
+    }
+    done = true;
+    for (std::thread& t : readers) t.join();
+
+    std::cout << "Concurrent: " << counter << " stores, " << loads.load() << " loads, " << torn.load() << " torn, "
+              << backwards.load() << " out of order" << std::endl;
+    bool ok = true;
+    if (torn != 0) {
+        std::cerr << "A reader returned a torn snapshot" << std::endl;
+        ok = false;
+    }
+    if (backwards != 0) {
+        std::cerr << "A reader saw an older snapshot after a newer one" << std::endl;
+        ok = false;
+    }
+    if (lock.version() != counter || lock.load().counter != counter) {
+        std::cerr << "Version " << lock.version() << " after " << counter << " stores" << std::endl;
+        ok = false;
+    }
+    if (loads == 0) {
+        std::cerr << "Readers never completed a load" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_single_thread();
+    if (!check_concurrent()) ok = false;
+    if (!ok) return 1;
+    std::cout << "SeqLock OK" << std::endl;
+    return 0;
+}
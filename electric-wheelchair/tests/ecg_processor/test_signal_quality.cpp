@@ -0,0 +1,158 @@
+#include "ecg_processor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Runs a synthetic recording with an electrode coming off, an amplifier stuck
+// at its rail and a burst of motion noise through StableECGProcessor. While the
+// signal is bad QRS detection must be suspended and the heart rate cleared;
+// once it is clean again detection must resume and find the beats, and the
+// beat classifier must not take the gap for an R-R interval.
+
+namespace {
+
+constexpr int BEAT_INTERVAL = SAMPLE_RATE * 4 / 5;  // 75 bpm
+
+enum class Defect { None, LeadOff, Clipped, Noise };
+
+struct Period {
+    int start_s, end_s;
+    Defect defect;
+};
+
+const std::vector<Period> PERIODS = {
+    {0, 20, Defect::None},   {20, 30, Defect::LeadOff}, {30, 40, Defect::None}, {40, 50, Defect::Clipped},
+    {50, 60, Defect::None},  {60, 70, Defect::Noise},   {70, 85, Defect::None},
+};
+
+const char* defect_name(Defect defect) {
+    switch (defect) {
+        case Defect::LeadOff: return "lead-off";
+        case Defect::Clipped: return "clipping";
+        case Defect::Noise: return "noise";
+        default: return "clean";
+    }
+}
+
+std::vector<double> render(std::vector<uint64_t>& beats) {
+    const int total = PERIODS.back().end_s * SAMPLE_RATE;
+    for (int t = SAMPLE_RATE / 2; t < total; t += BEAT_INTERVAL) beats.push_back(t);
+    std::mt19937 rng(3);
+    std::normal_distribution<double> noise(0.0, 8.0);
+    std::normal_distribution<double> motion(0.0, 300.0);
+    std::vector<double> samples(total);
+    std::size_t period = 0;
+    for (int i = 0; i < total; ++i) {
+        while (i >= PERIODS[period].end_s * SAMPLE_RATE) ++period;
+        double v = 512.0 + 40.0 * std::sin(2.0 * M_PI * 0.3 * i / SAMPLE_RATE) + noise(rng);
+        for (uint64_t b : beats) {
+            const double d = static_cast<double>(i) - b;
+            if (std::abs(d) < 500.0) {
+                v += 900.0 * std::exp(-d * d / (2 * 9.0 * 9.0)) +
+                     220.0 * std::exp(-(d - 300.0) * (d - 300.0) / (2 * 45.0 * 45.0));
+            }
+        }
+        switch (PERIODS[period].defect) {
+            case Defect::LeadOff: v = 512.0; break;                          // Amplifier output idles
+            case Defect::Clipped: v = std::min(1023.0, v + 700.0); break;    // Offset drives it into the rail
+            case Defect::Noise: v += motion(rng); break;
+            default: break;
+        }
+        samples[i] = v;
+    }
+    return samples;
+}
+
+std::size_t count_in(const std::vector<uint64_t>& indices, uint64_t from, uint64_t to) {
+    return std::count_if(indices.begin(), indices.end(), [from, to](uint64_t i) { return i >= from && i < to; });
+}
+
+// Splitting the stream differently must not change the result
+bool check_block_independence(const std::vector<double>& samples) {
+    SignalQualityIndex whole(SAMPLE_RATE, 1), pieces(SAMPLE_RATE, 1);
+    const std::size_t count = 25 * SAMPLE_RATE;
+    whole.update(samples.data(), count);
+    for (std::size_t i = 0; i < count; i += 7) pieces.update(samples.data() + i, std::min<std::size_t>(7, count - i));
+    const SignalQuality a = whole.last(), b = pieces.last();
+    if (a.score != b.score || a.flat != b.flat || a.detecting != b.detecting) {
+        std::cerr << "Quality depends on block size: " << a.score << " vs " << b.score << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<uint64_t> beats;
+    const std::vector<double> samples = render(beats);
+    bool ok = check_block_independence(samples);
+
+    StableECGProcessor processor;
+    std::vector<uint64_t> detected;
+    processor.set_beat_callback([&detected](uint64_t index) { detected.push_back(index); });
+    double longest_rr = 0.0;
+    processor.set_beat_class_callback([&longest_rr](const BeatInfo& beat) {
+        longest_rr = std::max(longest_rr, beat.rr_ms);
+    });
+    bool af_like = false;
+
+    // Feed one second at a time and watch the published state
+    for (const Period& period : PERIODS) {
+        double worst_score = 1.0;
+        bool suspended = true, cleared = true;
+        for (int s = period.start_s; s < period.end_s; ++s) {
+            processor.process_samples(samples.data() + static_cast<std::size_t>(s) * SAMPLE_RATE, SAMPLE_RATE);
+            const SignalQuality quality = processor.signal_quality();
+            worst_score = std::min(worst_score, quality.score);
+            af_like = af_like || processor.rhythm().af_like;
+            // Allow 3 s for a full quality window of the new signal
+            if (s >= period.start_s + 3) {
+                suspended = suspended && !quality.detecting;
+                cleared = cleared && processor.latest().heart_rate == 0.0;
+            }
+        }
+
+        const uint64_t from = static_cast<uint64_t>(period.start_s) * SAMPLE_RATE;
+        const uint64_t to = static_cast<uint64_t>(period.end_s) * SAMPLE_RATE;
+        const std::size_t expected = count_in(beats, from, to);
+        const std::size_t found = count_in(detected, from, to);
+        const SignalQuality quality = processor.signal_quality();
+        std::cout << period.start_s << "-" << period.end_s << " s " << defect_name(period.defect) << ": " << found
+                  << "/" << expected << " beats, quality " << quality.score << " (lowest " << worst_score
+                  << "), HR " << processor.current_hr() << " bpm" << std::endl;
+
+        if (period.defect == Defect::None) {
+            // Detection resumes within the recovery time plus relearning
+            if (!quality.detecting || found + 8 < expected || found > expected) {
+                std::cerr << "Detection did not recover after the " << period.start_s << " s mark" << std::endl;
+                ok = false;
+            }
+        } else {
+            if (!suspended || !cleared || found > 3) {
+                std::cerr << defect_name(period.defect) << " was not gated" << std::endl;
+                ok = false;
+            }
+            if (period.defect == Defect::LeadOff && !quality.flat) {
+                std::cerr << "Lead-off not reported as flat" << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    // Beats either side of a gap are not consecutive
+    std::cout << "Longest classified R-R " << longest_rr << " ms" << std::endl;
+    if (longest_rr > 2.0 * BEAT_INTERVAL || af_like) {
+        std::cerr << "Beat classifier took a gap for an R-R interval" << (af_like ? " (AF-like)" : "") << std::endl;
+        ok = false;
+    }
+    if (std::abs(processor.current_hr() - 75.0) > 1.5) {
+        std::cerr << "Final heart rate " << processor.current_hr() << " bpm, expected 75" << std::endl;
+        ok = false;
+    }
+    if (!ok) return 1;
+    std::cout << "Signal quality gating OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "sliding_window.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks the monotonic-queue max and min of SlidingWindow against a full
+// scan of the last samples: random streams with many duplicates, long
+// monotonic runs that fill the queues before eviction, window lengths down
+// to one sample, and clear().
+
+namespace {
+
+// Push samples into a window and a reference deque, comparing after each
+bool compare(const char* name, std::size_t capacity, const std::vector<int>& samples) {
+    SlidingWindow<int> window(capacity);
+    std::deque<int> reference;
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        window.push(samples[i]);
+        reference.push_back(samples[i]);
+        if (reference.size() > capacity) reference.pop_front();
+        const int max = *std::max_element(reference.begin(), reference.end());
+        const int min = *std::min_element(reference.begin(), reference.end());
+        if (window.max() != max || window.min() != min || window.size() != reference.size() ||
+            window.full() != (reference.size() == capacity)) {
+            std::cerr << name << ", window " << capacity << ", sample " << i << ": max " << window.max()
+                      << " min " << window.min() << " (expected " << max << ", " << min << ")" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_streams() {
+    bool ok = true;
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> few(0, 4);  // Mostly duplicates
+    std::uniform_int_distribution<int> wide(-1000, 1000);
+    std::vector<int> duplicates(3000), spread(3000), ramps;
+    for (int& v : duplicates) v = few(rng);
+    for (int& v : spread) v = wide(rng);
+    // Falling then rising runs longer than the window: the max (then min)
+    // queue holds every sample and evicts from its front each push
+    for (int run = 0; run < 6; ++run) {
+        for (int i = 0; i < 200; ++i) ramps.push_back(run % 2 ? i : 200 - i);
+    }
+    for (std::size_t capacity : {1, 2, 7, 64, 150}) {
+        if (!compare("Duplicates", capacity, duplicates)) ok = false;
+        if (!compare("Random", capacity, spread)) ok = false;
+        if (!compare("Ramps", capacity, ramps)) ok = false;
+    }
+    return ok;
+}
+
+// The largest sample leaves the window and the next largest takes over
+bool check_eviction() {
+    SlidingWindow<double> window(4);
+    const double samples[] = {9.0, 1.0, 5.0, 5.0, 2.0, 3.0, 0.5};
+    window.push(samples, 4);
+    bool ok = window.max() == 9.0 && window.min() == 1.0;
+    window.push(samples[4]);  // 9 evicted
+    ok = ok && window.max() == 5.0 && window.min() == 1.0;
+    window.push(samples[5]);  // 1 evicted
+    ok = ok && window.max() == 5.0 && window.min() == 2.0;
+    window.push(samples[6]);  // First 5 evicted, the duplicate still holds the max
+    ok = ok && window.max() == 5.0 && window.min() == 0.5;
+    if (!ok) {
+        std::cerr << "Max/min wrong after eviction" << std::endl;
+        return false;
+    }
+    window.clear();
+    window.push(-4.0);
+    if (!window.empty() && window.size() == 1 && window.max() == -4.0 && window.min() == -4.0 && window.total() == 1) {
+        return true;
+    }
+    std::cerr << "clear() kept old samples" << std::endl;
+    return false;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_streams();
+    if (!check_eviction()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Sliding window OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include "ecg_processor.hpp"
+#include "ecg_stream.hpp"
+#include "delta_codec.hpp"
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks the delta codec and base64 used by the live waveform stream, that a
+// client polling the stream receives every frame and every R peak of the
+// processor's waveform, and that a client which stops reading skips ahead
+// instead of holding anything up.
+
+namespace {
+
+struct Event {
+    uint64_t seq = 0;
+    std::size_t leads = 0;
+    double step = 0.0;
+    std::vector<double> frames;
+    std::vector<uint64_t> beats;
+};
+
+std::string field(const std::string& json, const std::string& name) {
+    const std::size_t at = json.find("\"" + name + "\":");
+    if (at == std::string::npos) return std::string();
+    std::size_t begin = at + name.size() + 3, end;
+    if (json[begin] == '"') {
+        end = json.find('"', ++begin);
+    } else if (json[begin] == '[') {
+        end = json.find(']', ++begin);
+    } else {
+        end = json.find_first_of(",}", begin);
+    }
+    return json.substr(begin, end - begin);
+}
+
+std::string base64_decode(const std::string& text) {
+    static const std::string ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    uint32_t group = 0;
+    int bits = 0;
+    for (char c : text) {
+        if (c == '=') break;
+        group = (group << 6) | static_cast<uint32_t>(ALPHABET.find(c));
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((group >> bits) & 0xFF));
+        }
+    }
+    return out;
+}
+
+// Parses one "event: ecg" block the way the dashboard does
+bool parse(const std::string& text, Event& event) {
+    const std::string prefix = "event: ecg\ndata: ";
+    if (text.compare(0, prefix.size(), prefix) != 0 || text.size() < 2 || text.substr(text.size() - 2) != "\n\n") {
+        return false;
+    }
+    const std::string json = text.substr(prefix.size(), text.size() - prefix.size() - 2);
+    event.seq = std::stoull(field(json, "seq"));
+    event.leads = std::stoul(field(json, "leads"));
+    event.step = std::stod(field(json, "step"));
+    const std::string bytes = base64_decode(field(json, "d"));
+    std::vector<int64_t> previous(event.leads, 0);
+    event.frames.clear();
+    delta_codec::decode(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), event.leads, event.step,
+                        previous.data(), event.frames);
+    event.beats.clear();
+    const std::string beats = field(json, "r");
+    for (std::size_t at = 0; at < beats.size();) {
+        std::size_t used;
+        event.beats.push_back(std::stoull(beats.substr(at), &used));
+        at += used + 1;
+    }
+    return true;
+}
+
+bool check_codec() {
+    bool ok = true;
+    const char* plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    const char* coded[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    for (int i = 0; i < 7; ++i) {
+        if (base64_encode(plain[i]) != coded[i]) {
+            std::cerr << "base64 of \"" << plain[i] << "\" is " << base64_encode(plain[i]) << std::endl;
+            ok = false;
+        }
+    }
+
+    // Three leads with small steps, large jumps and both signs
+    std::mt19937 rng(7);
+    std::normal_distribution<double> small(0.0, 3.0);
+    const std::size_t leads = 3, count = 2000;
+    std::vector<double> frames(count * leads);
+    for (std::size_t i = 0; i < count * leads; ++i) {
+        frames[i] = (i < leads ? 0.0 : frames[i - leads]) + small(rng) + (i % 397 == 0 ? -5000.0 : 0.0);
+    }
+    std::string bytes;
+    std::vector<int64_t> previous(leads, 0);
+    delta_codec::encode(bytes, frames.data(), count, leads, 0.1, previous.data());
+    std::vector<int64_t> state(leads, 0);
+    std::vector<double> decoded;
+    const std::size_t n = delta_codec::decode(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), leads,
+                                              0.1, state.data(), decoded);
+    double error = 0.0;
+    for (std::size_t i = 0; i < decoded.size(); ++i) error = std::max(error, std::abs(decoded[i] - frames[i]));
+    std::cout << "Codec: " << count * leads << " values in " << bytes.size() << " bytes, max error " << error
+              << std::endl;
+    if (n != count || error > 0.05 + 1e-9 || state != previous || bytes.size() > 2 * count * leads) {
+        std::cerr << "Delta codec does not round-trip" << std::endl;
+        ok = false;
+    }
+
+    // A truncated varint ends decoding at the last whole frame
+    decoded.clear();
+    std::fill(state.begin(), state.end(), 0);
+    std::string cut = bytes.substr(0, 10);
+    cut.push_back(static_cast<char>(0x80));
+    if (delta_codec::decode(reinterpret_cast<const uint8_t*>(cut.data()), cut.size(), leads, 0.1, state.data(),
+                            decoded) != decoded.size() / leads || decoded.size() % leads != 0) {
+        std::cerr << "Truncated input decoded a partial frame" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+std::vector<double> synthetic_ecg(std::size_t total, std::size_t leads) {
+    std::mt19937 rng(3);
+    std::normal_distribution<double> noise(0.0, 4.0);
+    std::vector<double> samples(total * leads);
+    for (std::size_t i = 0; i < total; ++i) {
+        const double phase = std::fmod(static_cast<double>(i), 820.0) - 410.0;
+        for (std::size_t lead = 0; lead < leads; ++lead) {
+            samples[i * leads + lead] = 512.0 + (900.0 - 200.0 * lead) * std::exp(-phase * phase / 162.0) + noise(rng);
+        }
+    }
+    return samples;
+}
+
+// A client polling every 100 ms sees the whole waveform and every beat
+bool check_live(std::size_t leads) {
+    bool ok = true;
+    const std::size_t total = 30 * SAMPLE_RATE, poll = SAMPLE_RATE / 10;
+    const std::vector<double> samples = synthetic_ecg(total, leads);
+    StableECGProcessor processor(leads);
+    std::vector<uint64_t> beats;
+    processor.set_beat_callback([&beats](uint64_t r_index) { beats.push_back(r_index); });
+
+    EcgStream stream(processor);
+    uint64_t reference_cursor = 0, next_seq = 0;
+    std::vector<double> reference(ECG_STREAM_MAX_FRAMES * leads);
+    std::vector<uint64_t> markers;
+    std::size_t events = 0, bytes = 0, mismatched = 0, gaps = 0;
+    for (std::size_t at = 0; at < total; at += poll) {
+        processor.process_samples(samples.data() + at * leads, poll);
+        const std::string text = stream.next_event(processor);
+        if (text.empty()) continue;
+        Event event;
+        if (!parse(text, event) || event.leads != leads) {
+            std::cerr << "Malformed event: " << text << std::endl;
+            return false;
+        }
+        ++events;
+        bytes += text.size();
+        if (event.seq != next_seq) ++gaps;
+        next_seq = event.seq + event.frames.size() / leads;
+        const std::size_t n = processor.waveform().read(reference_cursor, reference.data(), event.frames.size() / leads);
+        for (std::size_t i = 0; i < n * leads; ++i) {
+            if (std::abs(event.frames[i] - reference[i]) > ECG_STREAM_STEP / 2 + 1e-9) ++mismatched;
+        }
+        markers.insert(markers.end(), event.beats.begin(), event.beats.end());
+    }
+
+    std::size_t placed = 0;
+    for (std::size_t b = 0; b < beats.size() && b < markers.size(); ++b) {
+        if (markers[b] == processor.waveform_frame(beats[b]) &&
+            std::abs(processor.waveform_sample_index(markers[b]) - static_cast<double>(beats[b])) <=
+                processor.waveform_ratio()) {
+            ++placed;
+        }
+    }
+    const double seconds = static_cast<double>(total) / SAMPLE_RATE;
+    std::cout << leads << " lead(s): " << events << " events, " << next_seq << " frames, " << markers.size()
+              << " markers for " << beats.size() << " beats, " << bytes / seconds << " bytes/s" << std::endl;
+    if (next_seq != processor.waveform().end() || gaps != 0 || mismatched != 0 || stream.skipped_frames() != 0) {
+        std::cerr << "Stream lost or altered frames (" << gaps << " gaps, " << mismatched << " mismatched)" << std::endl;
+        ok = false;
+    }
+    if (beats.size() < 30 || markers.size() != beats.size() || placed != beats.size()) {
+        std::cerr << "Beat markers do not match the detected beats" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// A client that stops reading is skipped ahead to the oldest frame held
+bool check_slow_client() {
+    const std::size_t total = 30 * SAMPLE_RATE;
+    const std::vector<double> samples = synthetic_ecg(total, 1);
+    StableECGProcessor processor;
+    processor.process_samples(samples.data(), SAMPLE_RATE);
+    EcgStream stream(processor, 500);
+    const uint64_t start = processor.waveform().end() - static_cast<uint64_t>(processor.waveform_rate() / 2);
+    processor.process_samples(samples.data() + SAMPLE_RATE, total - SAMPLE_RATE);
+
+    Event event;
+    if (!parse(stream.next_event(processor), event)) {
+        std::cerr << "No event after the client fell behind" << std::endl;
+        return false;
+    }
+    const WaveformRing& ring = processor.waveform();
+    const uint64_t oldest = ring.end() - ring.capacity();
+    while (!stream.next_event(processor).empty()) {}
+    std::cout << "Slow client: resumed at frame " << event.seq << " of " << ring.end() << ", "
+              << stream.skipped_frames() << " skipped" << std::endl;
+    if (event.seq != oldest || stream.skipped_frames() != oldest - start ||
+        event.frames.size() != ECG_STREAM_MAX_FRAMES) {
+        std::cerr << "Slow client was not moved to the oldest frame held" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool ok = check_codec();
+    if (!check_live(1)) ok = false;
+    if (!check_live(3)) ok = false;
+    if (!check_slow_client()) ok = false;
+    if (!ok) return 1;
+    std::cout << "Waveform stream OK" << std::endl;
+    return 0;
+}